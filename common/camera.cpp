@@ -0,0 +1,162 @@
+#include <math.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.hpp"
+
+CameraController::CameraController(const CameraSettings & settings)
+	: config(settings), accumulator(0.0), steps(0), head(0), tail(0), dropped(0),
+	  viewChanged(true), projectionChanged(true)
+{
+	for ( int i=0; i<CAMERA_ACTION_COUNT; i++ )
+		actions[i] = false;
+}
+
+bool CameraController::push(const CameraInput & input){
+	unsigned int t = tail.load(std::memory_order_relaxed);
+	if ( t - head.load(std::memory_order_acquire) == QueueSize ){
+		dropped++;
+		return false;
+	}
+	queue[t % QueueSize] = input;
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+bool CameraController::pushAction(CameraAction action, bool pressed){
+	CameraInput input = { CAMERA_INPUT_ACTION, action, pressed, 0.0f, 0.0f };
+	return push(input);
+}
+
+bool CameraController::pushCursorMove(float dx, float dy){
+	CameraInput input = { CAMERA_INPUT_CURSOR, 0, false, dx, dy };
+	return push(input);
+}
+
+bool CameraController::pushScroll(float dy){
+	CameraInput input = { CAMERA_INPUT_SCROLL, 0, false, 0.0f, dy };
+	return push(input);
+}
+
+void CameraController::apply(const CameraInput & input){
+	switch ( input.type ){
+	case CAMERA_INPUT_ACTION:
+		if ( input.action >= 0 && input.action < CAMERA_ACTION_COUNT )
+			actions[input.action] = input.pressed;
+		break;
+	case CAMERA_INPUT_CURSOR:
+		if ( input.x != 0.0f || input.y != 0.0f ){
+			current.horizontalAngle -= config.mouseSpeed * input.x;
+			current.verticalAngle   -= config.mouseSpeed * input.y;
+			viewChanged = true;
+		}
+		break;
+	case CAMERA_INPUT_SCROLL:
+		if ( config.scrollSpeed != 0.0f && input.y != 0.0f ){
+			current.fieldOfView -= config.scrollSpeed * input.y;
+			current.fieldOfView = glm::clamp(current.fieldOfView, 1.0f, 120.0f);
+			projectionChanged = true;
+		}
+		break;
+	}
+}
+
+void CameraController::step(){
+
+	// Everything that arrived before this step
+	unsigned int h = head.load(std::memory_order_relaxed);
+	unsigned int t = tail.load(std::memory_order_acquire);
+	for ( ; h != t; h++ )
+		apply(queue[h % QueueSize]);
+	head.store(h, std::memory_order_release);
+
+	// Move
+	if ( actions[CAMERA_FORWARD] != actions[CAMERA_BACKWARD] || actions[CAMERA_RIGHT] != actions[CAMERA_LEFT] ){
+
+		// Direction : Spherical coordinates to Cartesian coordinates conversion
+		glm::vec3 direction(
+			cos(current.verticalAngle) * sin(current.horizontalAngle),
+			sin(current.verticalAngle),
+			cos(current.verticalAngle) * cos(current.horizontalAngle)
+		);
+
+		// Right vector
+		glm::vec3 right = glm::vec3(
+			sin(current.horizontalAngle - 3.14f/2.0f),
+			0,
+			cos(current.horizontalAngle - 3.14f/2.0f)
+		);
+
+		float distance = float(config.fixedStep) * config.speed;
+		if ( actions[CAMERA_FORWARD] )  current.position += direction * distance;
+		if ( actions[CAMERA_BACKWARD] ) current.position -= direction * distance;
+		if ( actions[CAMERA_RIGHT] )    current.position += right * distance;
+		if ( actions[CAMERA_LEFT] )     current.position -= right * distance;
+		viewChanged = true;
+	}
+
+	steps++;
+}
+
+unsigned int CameraController::update(double deltaTime){
+	accumulator += deltaTime;
+
+	unsigned int count = 0;
+	while ( accumulator >= config.fixedStep && count < config.maxSteps ){
+		step();
+		accumulator -= config.fixedStep;
+		count++;
+	}
+
+	// Too far behind : forget it instead of catching up during the next frames
+	if ( count == config.maxSteps && accumulator >= config.fixedStep )
+		accumulator = 0.0;
+	return count;
+}
+
+const glm::mat4 & CameraController::viewMatrix() const {
+	if ( viewChanged ){
+		glm::vec3 direction(
+			cos(current.verticalAngle) * sin(current.horizontalAngle),
+			sin(current.verticalAngle),
+			cos(current.verticalAngle) * cos(current.horizontalAngle)
+		);
+		glm::vec3 right = glm::vec3(
+			sin(current.horizontalAngle - 3.14f/2.0f),
+			0,
+			cos(current.horizontalAngle - 3.14f/2.0f)
+		);
+		glm::vec3 up = glm::cross( right, direction );
+
+		// Camera matrix
+		view = glm::lookAt(
+			current.position,           // Camera is here
+			current.position+direction, // and looks here : at the same position, plus "direction"
+			up                          // Head is up (set to 0,-1,0 to look upside-down)
+		);
+		viewChanged = false;
+	}
+	return view;
+}
+
+const glm::mat4 & CameraController::projectionMatrix() const {
+	if ( projectionChanged ){
+		projection = glm::perspective(current.fieldOfView, config.aspectRatio, config.nearPlane, config.farPlane);
+		projectionChanged = false;
+	}
+	return projection;
+}
+
+void CameraController::setState(const CameraState & state){
+	current = state;
+	viewChanged = true;
+	projectionChanged = true;
+}
+
+void CameraController::setAspectRatio(float aspectRatio){
+	if ( aspectRatio != config.aspectRatio ){
+		config.aspectRatio = aspectRatio;
+		projectionChanged = true;
+	}
+}
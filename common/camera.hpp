@@ -0,0 +1,124 @@
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+#include <atomic>
+
+#include <glm/glm.hpp>
+
+// A first person camera, like the one of computeMatricesFromInputs (see
+// controls.hpp), but in an object : each viewport (or each thread) can have
+// its own, and nothing here needs GLFW or OpenGL.
+//
+// - Input arrives as events (see attachCameraCallbacks in controls.hpp for
+//   GLFW callbacks), in a fixed-size queue : pushing never allocates, and one
+//   thread can push while another one updates.
+// - update() moves the camera in fixed steps, whatever the frame rate. The
+//   events are applied at the beginning of the next step, so the same events
+//   pushed before the same steps always give the same camera : replays are
+//   exact.
+// - The matrices are only recomputed when the camera moved.
+
+// What the keys do
+enum CameraAction{
+	CAMERA_FORWARD,
+	CAMERA_BACKWARD,
+	CAMERA_RIGHT,
+	CAMERA_LEFT,
+	CAMERA_ACTION_COUNT
+};
+
+enum CameraInputType{
+	CAMERA_INPUT_ACTION, // The action starts (pressed) or stops
+	CAMERA_INPUT_CURSOR, // The mouse moved by x, y pixels
+	CAMERA_INPUT_SCROLL  // The wheel turned by y
+};
+
+struct CameraInput{
+	CameraInputType type;
+	int action;   // CAMERA_INPUT_ACTION
+	bool pressed; // CAMERA_INPUT_ACTION
+	float x, y;   // CAMERA_INPUT_CURSOR, CAMERA_INPUT_SCROLL
+};
+
+struct CameraSettings{
+	float speed;          // Units per second
+	float mouseSpeed;     // Radians per pixel
+	float scrollSpeed;    // Degrees of Field of View per step of the wheel. 0 : the wheel does nothing.
+	float aspectRatio;
+	float nearPlane, farPlane;
+	double fixedStep;     // In seconds
+	unsigned int maxSteps; // At most this many steps per update(), so that a long frame doesn't make the next one longer
+
+	CameraSettings() : speed(3.0f), mouseSpeed(0.005f), scrollSpeed(5.0f), aspectRatio(4.0f/3.0f),
+	                   nearPlane(0.1f), farPlane(100.0f), fixedStep(1.0/120.0), maxSteps(12) {}
+};
+
+// Where the camera is, and where it looks. Saving this and the events is
+// enough to replay.
+struct CameraState{
+	glm::vec3 position;
+	float horizontalAngle; // 3.14 : toward -Z
+	float verticalAngle;
+	float fieldOfView;     // In degrees
+
+	CameraState() : position(0, 0, 5), horizontalAngle(3.14f), verticalAngle(0.0f), fieldOfView(45.0f) {}
+};
+
+class CameraController{
+public:
+	explicit CameraController(const CameraSettings & settings = CameraSettings());
+
+	// Input. Only one thread may push, but it doesn't have to be the one
+	// that updates. Returns false if the queue is full : the event is lost.
+	bool push(const CameraInput & input);
+	bool pushAction(CameraAction action, bool pressed);
+	bool pushCursorMove(float dx, float dy);
+	bool pushScroll(float dy);
+
+	// Advances the time by deltaTime seconds : runs as many fixed steps as
+	// fit (the rest is kept for the next update). Returns the number of steps.
+	unsigned int update(double deltaTime);
+
+	// Runs exactly one step, now : for replays and tests
+	void step();
+
+	// Computed again only if the camera moved since the last call
+	const glm::mat4 & viewMatrix() const;
+	const glm::mat4 & projectionMatrix() const;
+
+	const CameraState & state() const { return current; }
+	void setState(const CameraState & state);
+
+	const CameraSettings & settings() const { return config; }
+	void setAspectRatio(float aspectRatio);
+
+	unsigned long long stepCount() const { return steps; }
+	unsigned int droppedInputs() const { return dropped.load(); }
+
+private:
+	CameraController(const CameraController &);            // Not copyable
+	CameraController & operator=(const CameraController &);
+
+	void apply(const CameraInput & input);
+
+	CameraSettings config;
+	CameraState current;
+	bool actions[CAMERA_ACTION_COUNT];
+	double accumulator;
+	unsigned long long steps;
+
+	// Single producer, single consumer ring : the pushing thread only
+	// writes tail, the updating one only writes head
+	enum { QueueSize = 256 };
+	CameraInput queue[QueueSize];
+	std::atomic<unsigned int> head;
+	std::atomic<unsigned int> tail;
+	std::atomic<unsigned int> dropped;
+
+	mutable glm::mat4 view;
+	mutable glm::mat4 projection;
+	mutable bool viewChanged;
+	mutable bool projectionChanged;
+};
+
+#endif
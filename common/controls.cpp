@@ -7,33 +7,21 @@ extern GLFWwindow* window; // The "extern" keyword here is to access the variabl
 #include <glm/gtc/matrix_transform.hpp>
 using namespace glm;
 
+#include "camera.hpp"
 #include "controls.hpp"
 
-glm::mat4 ViewMatrix;
-glm::mat4 ProjectionMatrix;
+CameraController & defaultCamera(){
+	static CameraController camera; // Initial position : on +Z, toward -Z. 3 units / second.
+	return camera;
+}
 
 glm::mat4 getViewMatrix(){
-	return ViewMatrix;
+	return defaultCamera().viewMatrix();
 }
 glm::mat4 getProjectionMatrix(){
-	return ProjectionMatrix;
+	return defaultCamera().projectionMatrix();
 }
 
-
-// Initial position : on +Z
-glm::vec3 position = glm::vec3( 0, 0, 5 ); 
-// Initial horizontal angle : toward -Z
-float horizontalAngle = 3.14f;
-// Initial vertical angle : none
-float verticalAngle = 0.0f;
-// Initial Field of View
-float initialFoV = 45.0f;
-
-float speed = 3.0f; // 3 units / second
-float mouseSpeed = 0.005f;
-
-
-
 void computeMatricesFromInputs(){
 
 	// glfwGetTime is called only once, the first time this function is called
@@ -43,6 +31,8 @@ void computeMatricesFromInputs(){
 	double currentTime = glfwGetTime();
 	float deltaTime = float(currentTime - lastTime);
 
+	CameraController & camera = defaultCamera();
+
 	// Get mouse position
 	double xpos, ypos;
 	glfwGetCursorPos(window, &xpos, &ypos);
@@ -50,55 +40,78 @@ void computeMatricesFromInputs(){
 	// Reset mouse position for next frame
 	glfwSetCursorPos(window, 1024/2, 768/2);
 
-	// Compute new orientation
-	horizontalAngle += mouseSpeed * float(1024/2 - xpos );
-	verticalAngle   += mouseSpeed * float( 768/2 - ypos );
-
-	// Direction : Spherical coordinates to Cartesian coordinates conversion
-	glm::vec3 direction(
-		cos(verticalAngle) * sin(horizontalAngle), 
-		sin(verticalAngle),
-		cos(verticalAngle) * cos(horizontalAngle)
-	);
-	
-	// Right vector
-	glm::vec3 right = glm::vec3(
-		sin(horizontalAngle - 3.14f/2.0f), 
-		0,
-		cos(horizontalAngle - 3.14f/2.0f)
-	);
-	
-	// Up vector
-	glm::vec3 up = glm::cross( right, direction );
-
-	// Move forward
-	if (glfwGetKey( window, GLFW_KEY_UP ) == GLFW_PRESS){
-		position += direction * deltaTime * speed;
-	}
-	// Move backward
-	if (glfwGetKey( window, GLFW_KEY_DOWN ) == GLFW_PRESS){
-		position -= direction * deltaTime * speed;
-	}
-	// Strafe right
-	if (glfwGetKey( window, GLFW_KEY_RIGHT ) == GLFW_PRESS){
-		position += right * deltaTime * speed;
+	// The mouse moved by this much since the last frame. Not moving isn't an
+	// event : the view matrix is only computed again when something changed.
+	if ( xpos != 1024/2 || ypos != 768/2 )
+		camera.pushCursorMove(float(xpos - 1024/2), float(ypos - 768/2));
+
+	// The keys that changed since the last frame
+	static const int keys[CAMERA_ACTION_COUNT] = { GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_RIGHT, GLFW_KEY_LEFT };
+	static bool pressed[CAMERA_ACTION_COUNT] = { false, false, false, false };
+	for ( int i=0; i<CAMERA_ACTION_COUNT; i++ ){
+		bool now = glfwGetKey( window, keys[i] ) == GLFW_PRESS;
+		if ( now != pressed[i] )
+			camera.pushAction(CameraAction(i), now);
+		pressed[i] = now;
 	}
-	// Strafe left
-	if (glfwGetKey( window, GLFW_KEY_LEFT ) == GLFW_PRESS){
-		position -= right * deltaTime * speed;
-	}
-
-	float FoV = initialFoV;// - 5 * glfwGetMouseWheel(); // Now GLFW 3 requires setting up a callback for this. It's a bit too complicated for this beginner's tutorial, so it's disabled instead.
 
-	// Projection matrix : 45 Field of View, 4:3 ratio, display range : 0.1 unit <-> 100 units
-	ProjectionMatrix = glm::perspective(FoV, 4.0f / 3.0f, 0.1f, 100.0f);
-	// Camera matrix
-	ViewMatrix       = glm::lookAt(
-								position,           // Camera is here
-								position+direction, // and looks here : at the same position, plus "direction"
-								up                  // Head is up (set to 0,-1,0 to look upside-down)
-						   );
+	// Move, in steps of 1/120th of a second. The wheel needs a callback, see attachCameraCallbacks.
+	camera.update(deltaTime);
 
 	// For the next frame, the "last time" will be "now"
 	lastTime = currentTime;
-}
\ No newline at end of file
+}
+
+// What attachCameraCallbacks remembers about each window
+struct CameraCallbacks{
+	CameraController * camera;
+	double lastX, lastY; // GLFW gives the position of the cursor, the camera wants how much it moved
+	bool hasLast;
+};
+
+static void cameraKeyCallback(GLFWwindow * window, int key, int /*scancode*/, int action, int /*mods*/){
+	CameraCallbacks * callbacks = (CameraCallbacks *)glfwGetWindowUserPointer(window);
+	if ( action == GLFW_REPEAT )
+		return;
+	switch ( key ){
+	case GLFW_KEY_UP:    callbacks->camera->pushAction(CAMERA_FORWARD,  action == GLFW_PRESS); break;
+	case GLFW_KEY_DOWN:  callbacks->camera->pushAction(CAMERA_BACKWARD, action == GLFW_PRESS); break;
+	case GLFW_KEY_RIGHT: callbacks->camera->pushAction(CAMERA_RIGHT,    action == GLFW_PRESS); break;
+	case GLFW_KEY_LEFT:  callbacks->camera->pushAction(CAMERA_LEFT,     action == GLFW_PRESS); break;
+	}
+}
+
+static void cameraCursorCallback(GLFWwindow * window, double x, double y){
+	CameraCallbacks * callbacks = (CameraCallbacks *)glfwGetWindowUserPointer(window);
+	if ( callbacks->hasLast && (x != callbacks->lastX || y != callbacks->lastY) )
+		callbacks->camera->pushCursorMove(float(x - callbacks->lastX), float(y - callbacks->lastY));
+	callbacks->lastX = x;
+	callbacks->lastY = y;
+	callbacks->hasLast = true;
+}
+
+static void cameraScrollCallback(GLFWwindow * window, double /*x*/, double y){
+	CameraCallbacks * callbacks = (CameraCallbacks *)glfwGetWindowUserPointer(window);
+	callbacks->camera->pushScroll(float(y));
+}
+
+void attachCameraCallbacks(GLFWwindow * window, CameraController * camera){
+
+	// Only delete the user pointer if it's ours
+	if ( glfwSetKeyCallback(window, NULL) == cameraKeyCallback ){
+		delete (CameraCallbacks *)glfwGetWindowUserPointer(window);
+		glfwSetWindowUserPointer(window, NULL);
+	}
+	glfwSetCursorPosCallback(window, NULL);
+	glfwSetScrollCallback(window, NULL);
+	if ( !camera )
+		return;
+
+	CameraCallbacks * callbacks = new CameraCallbacks;
+	callbacks->camera = camera;
+	callbacks->hasLast = false;
+	glfwSetWindowUserPointer(window, callbacks);
+	glfwSetKeyCallback(window, cameraKeyCallback);
+	glfwSetCursorPosCallback(window, cameraCursorCallback);
+	glfwSetScrollCallback(window, cameraScrollCallback);
+}
@@ -1,8 +1,25 @@
 #ifndef CONTROLS_HPP
 #define CONTROLS_HPP
 
+class CameraController;
+struct GLFWwindow;
+
+// The simple way : once per frame, reads the keyboard and the mouse of the
+// window, and moves the camera of the tutorials (see defaultCamera)
 void computeMatricesFromInputs();
 glm::mat4 getViewMatrix();
 glm::mat4 getProjectionMatrix();
 
-#endif
\ No newline at end of file
+// The camera that computeMatricesFromInputs moves
+CameraController & defaultCamera();
+
+// The other way : the GLFW callbacks of window push their events in camera
+// (arrow keys, mouse moves, wheel), and the application only calls
+// camera.update(deltaTime). Replaces the key, cursor and scroll callbacks of
+// the window, and its user pointer. NULL removes them.
+// The callbacks keep a little state, allocated here and owned by the window :
+// attachCameraCallbacks(window, NULL) frees it. Call it before destroying
+// the window, or the camera (the callbacks would still use it).
+void attachCameraCallbacks(GLFWwindow * window, CameraController * camera);
+
+#endif
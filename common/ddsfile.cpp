@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "image.hpp"
+#include "ddsfile.hpp"
+
+#define FOURCC(a,b,c,d) ( (unsigned int)(a) | ((unsigned int)(b)<<8) | ((unsigned int)(c)<<16) | ((unsigned int)(d)<<24) )
+
+#define FOURCC_DXT1 FOURCC('D','X','T','1')
+#define FOURCC_DXT3 FOURCC('D','X','T','3')
+#define FOURCC_DXT5 FOURCC('D','X','T','5')
+#define FOURCC_ATI1 FOURCC('A','T','I','1') // Old name of BC4
+#define FOURCC_BC4U FOURCC('B','C','4','U')
+#define FOURCC_BC4S FOURCC('B','C','4','S')
+#define FOURCC_ATI2 FOURCC('A','T','I','2') // Old name of BC5
+#define FOURCC_BC5U FOURCC('B','C','5','U')
+#define FOURCC_BC5S FOURCC('B','C','5','S')
+#define FOURCC_DX10 FOURCC('D','X','1','0') // An extended header follows
+
+// Offsets in the file
+#define DDS_MAGIC_SIZE     4
+#define DDS_HEADER_SIZE    124
+#define DDS_DX10_SIZE      20
+#define DDS_HEIGHT         (DDS_MAGIC_SIZE + 8)
+#define DDS_WIDTH          (DDS_MAGIC_SIZE + 12)
+#define DDS_MIPMAPCOUNT    (DDS_MAGIC_SIZE + 24)
+#define DDS_PF_FLAGS       (DDS_MAGIC_SIZE + 76)
+#define DDS_PF_FOURCC      (DDS_MAGIC_SIZE + 80)
+#define DDS_CAPS2          (DDS_MAGIC_SIZE + 108)
+#define DX10_FORMAT        (DDS_MAGIC_SIZE + DDS_HEADER_SIZE + 0)
+#define DX10_DIMENSION     (DDS_MAGIC_SIZE + DDS_HEADER_SIZE + 4)
+#define DX10_MISCFLAG      (DDS_MAGIC_SIZE + DDS_HEADER_SIZE + 8)
+#define DX10_ARRAYSIZE     (DDS_MAGIC_SIZE + DDS_HEADER_SIZE + 12)
+
+#define DDPF_FOURCC             0x4
+#define DDSCAPS2_CUBEMAP        0x200
+#define DDSCAPS2_CUBEMAP_FACES  0xFC00 // All 6 faces
+#define DDSCAPS2_VOLUME         0x200000
+#define DX10_DIMENSION_TEXTURE2D 3
+#define DX10_MISC_TEXTURECUBE   0x4
+
+#define DDS_MAX_SIZE       65536 // Pixels, in each direction
+#define DDS_MAX_ARRAY_SIZE 2048
+
+// The DXGI_FORMATs we support
+enum{
+	DXGI_BC1_TYPELESS = 70, DXGI_BC1_UNORM, DXGI_BC1_UNORM_SRGB,
+	DXGI_BC2_TYPELESS,      DXGI_BC2_UNORM, DXGI_BC2_UNORM_SRGB,
+	DXGI_BC3_TYPELESS,      DXGI_BC3_UNORM, DXGI_BC3_UNORM_SRGB,
+	DXGI_BC4_TYPELESS,      DXGI_BC4_UNORM, DXGI_BC4_SNORM,
+	DXGI_BC5_TYPELESS,      DXGI_BC5_UNORM, DXGI_BC5_SNORM,
+	DXGI_BC7_TYPELESS = 97, DXGI_BC7_UNORM, DXGI_BC7_UNORM_SRGB
+};
+
+// The file may not be aligned, and is always little endian
+static unsigned int readU32(const unsigned char * p){
+	return (unsigned int)p[0] | ((unsigned int)p[1]<<8) | ((unsigned int)p[2]<<16) | ((unsigned int)p[3]<<24);
+}
+
+static bool formatFromFourCC(unsigned int fourCC, Image & image){
+	switch(fourCC){
+	case FOURCC_DXT1: image.format = IMAGE_DXT1; return true;
+	case FOURCC_DXT3: image.format = IMAGE_DXT3; return true;
+	case FOURCC_DXT5: image.format = IMAGE_DXT5; return true;
+	case FOURCC_ATI1:
+	case FOURCC_BC4U: image.format = IMAGE_BC4; return true;
+	case FOURCC_BC4S: image.format = IMAGE_BC4_SIGNED; return true;
+	case FOURCC_ATI2:
+	case FOURCC_BC5U: image.format = IMAGE_BC5; return true;
+	case FOURCC_BC5S: image.format = IMAGE_BC5_SIGNED; return true;
+	}
+	return false;
+}
+
+static bool formatFromDXGI(unsigned int dxgiFormat, Image & image){
+	switch(dxgiFormat){
+	case DXGI_BC1_UNORM_SRGB: image.srgb = true; // fall through
+	case DXGI_BC1_TYPELESS:
+	case DXGI_BC1_UNORM:      image.format = IMAGE_DXT1; return true;
+	case DXGI_BC2_UNORM_SRGB: image.srgb = true; // fall through
+	case DXGI_BC2_TYPELESS:
+	case DXGI_BC2_UNORM:      image.format = IMAGE_DXT3; return true;
+	case DXGI_BC3_UNORM_SRGB: image.srgb = true; // fall through
+	case DXGI_BC3_TYPELESS:
+	case DXGI_BC3_UNORM:      image.format = IMAGE_DXT5; return true;
+	case DXGI_BC4_TYPELESS:
+	case DXGI_BC4_UNORM:      image.format = IMAGE_BC4; return true;
+	case DXGI_BC4_SNORM:      image.format = IMAGE_BC4_SIGNED; return true;
+	case DXGI_BC5_TYPELESS:
+	case DXGI_BC5_UNORM:      image.format = IMAGE_BC5; return true;
+	case DXGI_BC5_SNORM:      image.format = IMAGE_BC5_SIGNED; return true;
+	case DXGI_BC7_UNORM_SRGB: image.srgb = true; // fall through
+	case DXGI_BC7_TYPELESS:
+	case DXGI_BC7_UNORM:      image.format = IMAGE_BC7; return true;
+	}
+	return false;
+}
+
+bool parseDDS(const unsigned char * data, size_t size, Image & image, const char * name){
+
+	image = Image();
+
+	/* verify the type of file */
+	if ( size < DDS_MAGIC_SIZE + DDS_HEADER_SIZE || memcmp(data, "DDS ", 4) != 0 ){
+		printf("%s is not a DDS file\n", name);
+		return false;
+	}
+
+	/* get the surface desc */
+	unsigned int height      = readU32(data + DDS_HEIGHT);
+	unsigned int width       = readU32(data + DDS_WIDTH);
+	unsigned int mipMapCount = readU32(data + DDS_MIPMAPCOUNT);
+	unsigned int pfFlags     = readU32(data + DDS_PF_FLAGS);
+	unsigned int fourCC      = readU32(data + DDS_PF_FOURCC);
+	unsigned int caps2       = readU32(data + DDS_CAPS2);
+
+	size_t dataOffset = DDS_MAGIC_SIZE + DDS_HEADER_SIZE;
+
+	if ( !(pfFlags & DDPF_FOURCC) ){
+		printf("%s : uncompressed DDS files are not supported\n", name);
+		return false;
+	}
+
+	if ( fourCC == FOURCC_DX10 ){
+		if ( size < DDS_MAGIC_SIZE + DDS_HEADER_SIZE + DDS_DX10_SIZE ){
+			printf("%s is truncated\n", name);
+			return false;
+		}
+		dataOffset += DDS_DX10_SIZE;
+
+		unsigned int dxgiFormat = readU32(data + DX10_FORMAT);
+		unsigned int dimension  = readU32(data + DX10_DIMENSION);
+		unsigned int miscFlag   = readU32(data + DX10_MISCFLAG);
+		unsigned int arraySize  = readU32(data + DX10_ARRAYSIZE);
+
+		if ( !formatFromDXGI(dxgiFormat, image) ){
+			printf("%s : DXGI format %u is not supported\n", name, dxgiFormat);
+			return false;
+		}
+		if ( dimension != DX10_DIMENSION_TEXTURE2D ){
+			printf("%s : only 2D textures and cubemaps are supported\n", name);
+			return false;
+		}
+		if ( arraySize == 0 || arraySize > DDS_MAX_ARRAY_SIZE ){
+			printf("%s : wrong array size (%u)\n", name, arraySize);
+			return false;
+		}
+		image.layerCount = arraySize; // For cubemaps, a number of cubes
+		image.faceCount = (miscFlag & DX10_MISC_TEXTURECUBE) ? 6 : 1;
+	}else{
+		if ( !formatFromFourCC(fourCC, image) ){
+			printf("%s : format %.4s is not supported\n", name, (const char *)(data + DDS_PF_FOURCC));
+			return false;
+		}
+		if ( caps2 & DDSCAPS2_VOLUME ){
+			printf("%s : volume textures are not supported\n", name);
+			return false;
+		}
+		if ( caps2 & DDSCAPS2_CUBEMAP ){
+			if ( (caps2 & DDSCAPS2_CUBEMAP_FACES) != DDSCAPS2_CUBEMAP_FACES ){
+				printf("%s : cubemaps with missing faces are not supported\n", name);
+				return false;
+			}
+			image.faceCount = 6;
+		}
+	}
+
+	if ( width == 0 || height == 0 || width > DDS_MAX_SIZE || height > DDS_MAX_SIZE ){
+		printf("%s : wrong size (%ux%u)\n", name, width, height);
+		return false;
+	}
+	if ( image.faceCount == 6 && width != height ){
+		printf("%s : the faces of a cubemap must be square\n", name);
+		return false;
+	}
+	image.width  = width;
+	image.height = height;
+
+	// mipMapCount is 0 in some files without mipmaps
+	if ( mipMapCount == 0 )
+		mipMapCount = 1;
+
+	// The size of each mip, in each face. Computed from the format : the
+	// "linear size" in the header is often wrong or missing.
+	size_t offset = 0;
+	for (unsigned int level = 0; level < mipMapCount; ++level)
+	{
+		ImageMip mip;
+		mip.width  = width;
+		mip.height = height;
+		mip.offset = offset;
+		mip.size   = imageMipSize(image.format, width, height);
+		image.mips.push_back(mip);
+		offset += mip.size;
+
+		if ( width == 1 && height == 1 && level + 1 < mipMapCount ){
+			printf("%s : too many mipmaps (%u)\n", name, mipMapCount);
+			image = Image();
+			return false;
+		}
+
+		// Deal with Non-Power-Of-Two textures.
+		width  /= 2;
+		height /= 2;
+		if(width < 1) width = 1;
+		if(height < 1) height = 1;
+	}
+	image.faceSize = offset;
+
+	// Everything must be in the file. Can't overflow : faceSize < 2^34, and
+	// there are at most 6*2048 faces.
+	unsigned long long totalSize = (unsigned long long)image.faceSize * image.faceCount * image.layerCount;
+	if ( totalSize > size - dataOffset ){
+		printf("%s is truncated : %llu bytes of pixels expected, %llu found\n", name, totalSize, (unsigned long long)(size - dataOffset));
+		image = Image();
+		return false;
+	}
+
+	image.pixels = data + dataOffset;
+	return true;
+}
@@ -0,0 +1,28 @@
+#ifndef DDSFILE_HPP
+#define DDSFILE_HPP
+
+// The .DDS container, as written by the DirectX texture tools, Compressonator,
+// nvcompress, etc.
+//
+// File layout (little endian) :
+// - "DDS "
+// - a 124-byte header : size, mip count, pixel format (a FourCC like "DXT1")
+//   and flags (cubemap faces)
+// - if the FourCC is "DX10", a 20-byte extended header : DXGI format
+//   (BC4, BC5, BC7, sRGB...), array size, cubemap flag
+// - the pixels, without any padding : for each array layer, for each face
+//   (6 for a cubemap), each mip from the largest to 1x1.
+//
+// Supported : DXT1/3/5 (BC1/2/3), BC4, BC5, BC7, with mips, cubemaps and arrays.
+// Not supported : uncompressed formats, volume textures, cubemaps with missing faces.
+
+struct Image;
+
+// Reads a .DDS file that is already in memory, and fills image with its
+// description. image.pixels points into data : nothing is copied, so data
+// must live as long as the image. Every surface is checked to be inside data.
+// name is only used in the error messages.
+// Prints why and returns false if the file is corrupted or not supported.
+bool parseDDS(const unsigned char * data, size_t size, Image & image, const char * name);
+
+#endif
@@ -0,0 +1,654 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "image.hpp"
+#include "mappedfile.hpp"
+#include "fontatlas.hpp"
+
+#define FONTATLAS_MAGIC   0x41544E46 // "FNTA" in ASCII
+#define FONTATLAS_VERSION 1
+
+struct FontAtlasHeader{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int width, height;
+	int lineHeight;
+	int ascent;
+	unsigned int flags; // 1 : distance field
+	float spread;
+	unsigned int glyphCount;
+	unsigned int kerningCount;
+};
+
+const FontGlyph * FontAtlas::glyph(unsigned int codepoint) const {
+	if ( codepoint < 256 )
+		return lookup[codepoint] < 0 ? NULL : &glyphs[lookup[codepoint]];
+
+	// Binary search for the others
+	size_t low = 0, high = glyphs.size();
+	while ( low < high ){
+		size_t middle = (low + high) / 2;
+		if ( glyphs[middle].codepoint < codepoint ) low = middle + 1;
+		else high = middle;
+	}
+	return low < glyphs.size() && glyphs[low].codepoint == codepoint ? &glyphs[low] : NULL;
+}
+
+float FontAtlas::kerning(unsigned int first, unsigned int second) const {
+	unsigned int pair = (first << 16) | second;
+	size_t low = 0, high = kernings.size();
+	while ( low < high ){
+		size_t middle = (low + high) / 2;
+		if ( (((unsigned int)kernings[middle].first << 16) | kernings[middle].second) < pair ) low = middle + 1;
+		else high = middle;
+	}
+	if ( low < kernings.size() && kernings[low].first == first && kernings[low].second == second )
+		return kernings[low].amount / 64.0f;
+	return 0.0f;
+}
+
+void FontAtlas::buildLookup(){
+	for ( int c=0; c<256; c++ )
+		lookup[c] = -1;
+	for ( size_t i=0; i<glyphs.size(); i++ )
+		if ( glyphs[i].codepoint < 256 )
+			lookup[glyphs[i].codepoint] = (short)i;
+}
+
+// The alpha of the first mip, top row first (.BMP files are bottom row first,
+// .DDS files top row first). Only the formats where the alpha is easy to read.
+static bool imageAlpha(const Image & image, std::vector<unsigned char> & alpha){
+
+	unsigned int width = image.width;
+	unsigned int height = image.height;
+	const unsigned char * data = image.mipData(0);
+	alpha.assign((size_t)width * height, 0);
+
+	if ( image.format == IMAGE_BGRA8 || image.format == IMAGE_BGR8 ){
+		unsigned int channels = image.format == IMAGE_BGRA8 ? 4 : 3;
+		size_t rowSize = image.format == IMAGE_BGRA8 ? width*4 : (width*3 + 3) & ~3;
+		for ( unsigned int y=0; y<height; y++ ){
+			const unsigned char * row = data + (height - 1 - y) * rowSize;
+			for ( unsigned int x=0; x<width; x++ ){
+				const unsigned char * pixel = row + x*channels;
+				// Without alpha, white text on black : the brightest channel
+				alpha[(size_t)y*width + x] = channels == 4 ? pixel[3] : std::max(pixel[0], std::max(pixel[1], pixel[2]));
+			}
+		}
+		return true;
+	}
+
+	if ( image.format != IMAGE_DXT3 && image.format != IMAGE_DXT5 )
+		return false;
+
+	// DXT3 and DXT5 : the alpha is in the first 8 bytes of each 16 bytes block
+	unsigned int blocksWide = (width + 3) / 4;
+	unsigned int blocksHigh = (height + 3) / 4;
+	for ( unsigned int by=0; by<blocksHigh; by++ ){
+		for ( unsigned int bx=0; bx<blocksWide; bx++ ){
+			const unsigned char * block = data + 16 * ((size_t)by * blocksWide + bx);
+			unsigned char values[16];
+
+			if ( image.format == IMAGE_DXT3 ){
+				// 4 bits per pixel
+				for ( int p=0; p<16; p++ )
+					values[p] = ((block[p/2] >> (4*(p%2))) & 15) * 17;
+			}else{
+				// 2 endpoints, and 3 bits per pixel to choose between them and 6 (or 4) values in between
+				unsigned char palette[8];
+				palette[0] = block[0];
+				palette[1] = block[1];
+				if ( palette[0] > palette[1] ){
+					for ( int i=1; i<7; i++ )
+						palette[i+1] = (unsigned char)(((7-i)*palette[0] + i*palette[1]) / 7);
+				}else{
+					for ( int i=1; i<5; i++ )
+						palette[i+1] = (unsigned char)(((5-i)*palette[0] + i*palette[1]) / 5);
+					palette[6] = 0;
+					palette[7] = 255;
+				}
+				unsigned long long bits = 0;
+				for ( int i=0; i<6; i++ )
+					bits |= (unsigned long long)block[2+i] << (8*i);
+				for ( int p=0; p<16; p++ )
+					values[p] = palette[(bits >> (3*p)) & 7];
+			}
+
+			for ( int p=0; p<16; p++ ){
+				unsigned int x = bx*4 + p%4;
+				unsigned int y = by*4 + p/4;
+				if ( x < width && y < height )
+					alpha[(size_t)y*width + x] = values[p];
+			}
+		}
+	}
+	return true;
+}
+
+bool glyphsFromGrid(const Image & grid, GlyphSet & out){
+
+	std::vector<unsigned char> alpha;
+	if ( grid.width < 16 || grid.height < 16 || !imageAlpha(grid, alpha) ){
+		printf("The font grid must be an uncompressed, DXT3 or DXT5 image\n");
+		return false;
+	}
+
+	int cellWidth = grid.width / 16;
+	int cellHeight = grid.height / 16;
+	int side = std::max(1, cellWidth / 32); // Space on each side of a glyph
+
+	// The box around the pixels of each cell
+	int boxes[256][4]; // x0, y0, x1, y1 in the cell, y down. x0 > x1 : empty.
+	std::vector<int> bottoms(cellHeight + 1, 0);
+	for ( int c=0; c<256; c++ ){
+		int x0 = cellWidth, y0 = cellHeight, x1 = -1, y1 = -1;
+		const unsigned char * cell = &alpha[(size_t)(c/16) * cellHeight * grid.width + (c%16) * cellWidth];
+		for ( int y=0; y<cellHeight; y++ ){
+			for ( int x=0; x<cellWidth; x++ ){
+				if ( cell[(size_t)y*grid.width + x] == 0 )
+					continue;
+				x0 = std::min(x0, x); x1 = std::max(x1, x);
+				y0 = std::min(y0, y); y1 = std::max(y1, y);
+			}
+		}
+		boxes[c][0] = x0; boxes[c][1] = y0; boxes[c][2] = x1; boxes[c][3] = y1;
+		if ( x1 >= x0 )
+			bottoms[y1 + 1]++;
+	}
+
+	// Most glyphs sit on the baseline : it's just below the most common bottom
+	int baseline = (int)(std::max_element(bottoms.begin(), bottoms.end()) - bottoms.begin());
+
+	out.lineHeight = cellHeight;
+	out.ascent = baseline;
+	out.glyphs.clear();
+	out.kernings.clear();
+	for ( int c=0; c<256; c++ ){
+		int x0 = boxes[c][0], y0 = boxes[c][1], x1 = boxes[c][2], y1 = boxes[c][3];
+		if ( x1 < x0 && c != ' ' )
+			continue; // Nothing there
+
+		GlyphBitmap glyph;
+		glyph.codepoint = c;
+		if ( x1 < x0 ){
+			glyph.width = glyph.height = 0;
+			glyph.left = glyph.top = 0;
+			glyph.advance = cellWidth / 3.0f;
+		}else{
+			glyph.width = x1 - x0 + 1;
+			glyph.height = y1 - y0 + 1;
+			glyph.left = side;
+			glyph.top = baseline - y0;
+			glyph.advance = (float)(glyph.width + 2*side);
+			glyph.coverage.resize(glyph.width * glyph.height);
+			const unsigned char * cell = &alpha[(size_t)(c/16) * cellHeight * grid.width + (c%16) * cellWidth];
+			for ( int y=0; y<glyph.height; y++ )
+				memcpy(&glyph.coverage[y*glyph.width], cell + (size_t)(y0+y)*grid.width + x0, glyph.width);
+		}
+		out.glyphs.push_back(glyph);
+	}
+	return true;
+}
+
+void computeKerning(GlyphSet & set){
+
+	set.kernings.clear();
+
+	// Rows relative to the baseline, y up, from rowMin to rowMax
+	int rowMin = 0, rowMax = 0;
+	for ( size_t i=0; i<set.glyphs.size(); i++ ){
+		const GlyphBitmap & g = set.glyphs[i];
+		if ( g.height == 0 ) continue;
+		rowMin = std::min(rowMin, g.top - g.height + 1);
+		rowMax = std::max(rowMax, g.top);
+	}
+	int rowCount = rowMax - rowMin + 1;
+	const float none = 1e9f;
+
+	// For each row of each glyph : how far its pixels are from the next glyph
+	// (on the right) and from the previous one (on the left)
+	std::vector<const GlyphBitmap *> glyphs;
+	std::vector<float> rightGaps, leftGaps;
+	for ( size_t i=0; i<set.glyphs.size(); i++ ){
+		const GlyphBitmap & g = set.glyphs[i];
+		if ( g.codepoint <= ' ' || g.codepoint > '~' || g.height == 0 )
+			continue;
+		glyphs.push_back(&g);
+		rightGaps.resize(rightGaps.size() + rowCount, none);
+		leftGaps.resize(leftGaps.size() + rowCount, none);
+		float * right = &rightGaps[rightGaps.size() - rowCount];
+		float * left = &leftGaps[leftGaps.size() - rowCount];
+		for ( int y=0; y<g.height; y++ ){
+			const unsigned char * row = &g.coverage[y*g.width];
+			int first = 0, last = g.width - 1;
+			// Any pixel counts, like for the boxes of glyphsFromGrid
+			while ( first < g.width && row[first] == 0 ) first++;
+			while ( last >= 0 && row[last] == 0 ) last--;
+			if ( first > last )
+				continue;
+			int r = g.top - y - rowMin;
+			right[r] = g.advance - (g.left + last + 1);
+			left[r] = (float)(g.left + first);
+		}
+	}
+
+	// Pixels also see the rows just above and below : two glyphs shouldn't
+	// touch by a corner.
+	int reach = std::max(1, set.lineHeight / 16);
+	std::vector<float> nearLeft(leftGaps.size(), none);
+	for ( size_t g=0; g<glyphs.size(); g++ )
+		for ( int r=0; r<rowCount; r++ )
+			for ( int n=std::max(0, r-reach); n<=std::min(rowCount-1, r+reach); n++ )
+				nearLeft[g*rowCount + r] = std::min(nearLeft[g*rowCount + r], leftGaps[g*rowCount + n]);
+
+	// A normal pair ("HH") : the space on both sides
+	float normalGap = 2.0f * std::max(1, set.lineHeight / 32);
+
+	for ( size_t a=0; a<glyphs.size(); a++ ){
+		for ( size_t b=0; b<glyphs.size(); b++ ){
+			float gap = none;
+			for ( int r=0; r<rowCount; r++ )
+				if ( rightGaps[a*rowCount + r] < none && nearLeft[b*rowCount + r] < none )
+					gap = std::min(gap, rightGaps[a*rowCount + r] + nearLeft[b*rowCount + r]);
+			if ( gap >= none )
+				continue; // Not on the same rows : "._" for instance. Leave them alone.
+
+			// Not too much : only what shows
+			float amount = normalGap - gap;
+			float limit = std::min(glyphs[a]->advance, glyphs[b]->advance) / 3.0f;
+			amount = std::max(amount, -limit);
+			if ( amount > -1.0f )
+				continue;
+
+			FontKerning kerning;
+			kerning.first = (unsigned short)glyphs[a]->codepoint;
+			kerning.second = (unsigned short)glyphs[b]->codepoint;
+			kerning.amount = (short)floor(amount * 64.0f + 0.5f);
+			kerning.padding = 0;
+			set.kernings.push_back(kerning);
+		}
+	}
+}
+
+// Exact euclidean distance transform, in one dimension (Felzenszwalb and
+// Huttenlocher) : d[q] = min over p of (q-p)^2 + f[p]
+static void distanceTransform1D(const double * f, double * d, int n, int * v, double * z){
+	int k = 0;
+	v[0] = 0;
+	z[0] = -1e30;
+	z[1] = 1e30;
+	for ( int q=1; q<n; q++ ){
+		double s = ((f[q] + (double)q*q) - (f[v[k]] + (double)v[k]*v[k])) / (2.0*q - 2.0*v[k]);
+		while ( s <= z[k] ){
+			k--;
+			s = ((f[q] + (double)q*q) - (f[v[k]] + (double)v[k]*v[k])) / (2.0*q - 2.0*v[k]);
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = 1e30;
+	}
+	k = 0;
+	for ( int q=0; q<n; q++ ){
+		while ( z[k+1] < q ) k++;
+		d[q] = (double)(q - v[k])*(q - v[k]) + f[v[k]];
+	}
+}
+
+// Squared distance from each pixel to the closest pixel where inside == target
+static void squaredDistances(const std::vector<bool> & inside, bool target, int width, int height, std::vector<double> & out){
+	int n = std::max(width, height);
+	std::vector<double> f(n), d(n), z(n+1);
+	std::vector<int> v(n);
+
+	out.resize(width * height);
+	for ( int i=0; i<width*height; i++ )
+		out[i] = inside[i] == target ? 0.0 : 1e20;
+
+	for ( int x=0; x<width; x++ ){
+		for ( int y=0; y<height; y++ ) f[y] = out[y*width + x];
+		distanceTransform1D(&f[0], &d[0], height, &v[0], &z[0]);
+		for ( int y=0; y<height; y++ ) out[y*width + x] = d[y];
+	}
+	for ( int y=0; y<height; y++ ){
+		distanceTransform1D(&out[y*width], &d[0], width, &v[0], &z[0]);
+		std::copy(d.begin(), d.begin() + width, out.begin() + y*width);
+	}
+}
+
+static int floorMultiple(int value, int multiple){
+	int q = value / multiple;
+	if ( value % multiple != 0 && value < 0 ) q--;
+	return q * multiple;
+}
+
+static int ceilMultiple(int value, int multiple){
+	return -floorMultiple(-value, multiple);
+}
+
+// One glyph, ready to be packed
+struct BakedGlyph{
+	FontGlyph glyph;
+	std::vector<unsigned char> pixels; // glyph.width * glyph.height
+};
+
+static void bakeGlyph(const GlyphBitmap & source, const FontBakeOptions & options, BakedGlyph & out){
+
+	int scale = options.downscale;
+	memset(&out.glyph, 0, sizeof(out.glyph));
+	out.glyph.codepoint = (unsigned short)source.codepoint;
+	out.glyph.advance = (short)floor(source.advance * 64.0f / scale + 0.5f);
+	if ( source.width == 0 || source.height == 0 )
+		return;
+
+	// The distance field goes spread pixels outside the glyph. The box is
+	// aligned on multiples of scale, so that the small glyph is on whole pixels.
+	int margin = options.distanceField ? options.spread : 0;
+	int left = floorMultiple(source.left - margin, scale);
+	int right = ceilMultiple(source.left + source.width + margin, scale);
+	int top = ceilMultiple(source.top + margin, scale);
+	int bottom = floorMultiple(source.top - source.height - margin, scale);
+	int width = right - left;
+	int height = top - bottom;
+	int offsetX = source.left - left;
+	int offsetY = top - source.top;
+
+	// The values at full resolution, from 0 to 1
+	std::vector<float> values(width * height, 0.0f);
+	if ( !options.distanceField ){
+		for ( int y=0; y<source.height; y++ )
+			for ( int x=0; x<source.width; x++ )
+				values[(offsetY + y)*width + offsetX + x] = source.coverage[y*source.width + x] / 255.0f;
+	}else{
+		std::vector<bool> inside(width * height, false);
+		for ( int y=0; y<source.height; y++ )
+			for ( int x=0; x<source.width; x++ )
+				inside[(offsetY + y)*width + offsetX + x] = source.coverage[y*source.width + x] >= 128;
+		std::vector<double> toInside, toOutside;
+		squaredDistances(inside, true, width, height, toInside);
+		squaredDistances(inside, false, width, height, toOutside);
+		for ( int i=0; i<width*height; i++ ){
+			// The edge is half way between the centers of an inside and an outside pixel
+			float distance = inside[i] ? (float)sqrt(toOutside[i]) - 0.5f : 0.5f - (float)sqrt(toInside[i]);
+			values[i] = std::min(1.0f, std::max(0.0f, 0.5f + distance / (2.0f * options.spread)));
+		}
+	}
+
+	// Average each scale x scale square
+	out.glyph.width = (unsigned short)(width / scale);
+	out.glyph.height = (unsigned short)(height / scale);
+	out.glyph.left = (short)(left / scale);
+	out.glyph.top = (short)(top / scale);
+	out.pixels.resize(out.glyph.width * out.glyph.height);
+	for ( int y=0; y<out.glyph.height; y++ ){
+		for ( int x=0; x<out.glyph.width; x++ ){
+			float sum = 0.0f;
+			for ( int sy=0; sy<scale; sy++ )
+				for ( int sx=0; sx<scale; sx++ )
+					sum += values[(y*scale + sy)*width + x*scale + sx];
+			out.pixels[y*out.glyph.width + x] = (unsigned char)(sum / (scale*scale) * 255.0f + 0.5f);
+		}
+	}
+}
+
+// Skyline packing : the top of what is already packed is a list of
+// horizontal segments, and each rectangle goes where its bottom is the
+// highest (y down), then the most on the left.
+class SkylinePacker{
+public:
+	SkylinePacker(int width, int height) : width(width), height(height) {
+		Segment segment = { 0, 0, width };
+		skyline.push_back(segment);
+	}
+
+	bool pack(int w, int h, int & out_x, int & out_y){
+		int bestIndex = -1, bestX = 0, bestBottom = height + 1;
+		for ( size_t i=0; i<skyline.size(); i++ ){
+			int y;
+			if ( fits(i, w, h, y) && y + h < bestBottom ){
+				bestIndex = (int)i;
+				bestX = skyline[i].x;
+				bestBottom = y + h;
+			}
+		}
+		if ( bestIndex < 0 )
+			return false;
+
+		// The new segment, on top of the rectangle
+		Segment segment = { bestX, bestBottom, w };
+		skyline.insert(skyline.begin() + bestIndex, segment);
+
+		// Shorten or remove the segments that it covers
+		for ( size_t i=bestIndex+1; i<skyline.size(); ){
+			int end = skyline[i-1].x + skyline[i-1].width;
+			if ( skyline[i].x >= end )
+				break;
+			int shrink = end - skyline[i].x;
+			if ( shrink >= skyline[i].width ){
+				skyline.erase(skyline.begin() + i);
+				continue;
+			}
+			skyline[i].x += shrink;
+			skyline[i].width -= shrink;
+			break;
+		}
+
+		// Merge the neighbours at the same height
+		for ( size_t i=0; i+1<skyline.size(); ){
+			if ( skyline[i].y == skyline[i+1].y ){
+				skyline[i].width += skyline[i+1].width;
+				skyline.erase(skyline.begin() + i + 1);
+			}else{
+				i++;
+			}
+		}
+
+		out_x = bestX;
+		out_y = bestBottom - h;
+		return true;
+	}
+
+private:
+	struct Segment{ int x, y, width; };
+
+	// Can a w x h rectangle start at segment i ? y : where its top would be.
+	bool fits(size_t i, int w, int h, int & y) const {
+		int x = skyline[i].x;
+		if ( x + w > width )
+			return false;
+		y = 0;
+		int remaining = w;
+		while ( remaining > 0 ){
+			if ( i == skyline.size() )
+				return false;
+			y = std::max(y, skyline[i].y);
+			if ( y + h > height )
+				return false;
+			remaining -= skyline[i].width;
+			i++;
+		}
+		return true;
+	}
+
+	int width, height;
+	std::vector<Segment> skyline;
+};
+
+static bool tallerFirst(const BakedGlyph * a, const BakedGlyph * b){
+	if ( a->glyph.height != b->glyph.height )
+		return a->glyph.height > b->glyph.height;
+	return a->glyph.width > b->glyph.width;
+}
+
+bool bakeFontAtlas(const GlyphSet & set, const FontBakeOptions & options, FontAtlas & out){
+
+	std::vector<BakedGlyph> baked(set.glyphs.size());
+	for ( size_t i=0; i<set.glyphs.size(); i++ )
+		bakeGlyph(set.glyphs[i], options, baked[i]);
+
+	// Tallest first : the skyline stays flat
+	std::vector<BakedGlyph *> order;
+	size_t area = 0;
+	for ( size_t i=0; i<baked.size(); i++ ){
+		if ( baked[i].glyph.width == 0 )
+			continue;
+		order.push_back(&baked[i]);
+		area += (size_t)(baked[i].glyph.width + options.padding) * (baked[i].glyph.height + options.padding);
+	}
+	std::sort(order.begin(), order.end(), tallerFirst);
+
+	// Try the smallest power-of-two atlas that could hold them, then bigger ones
+	unsigned int width = 16, height = 16;
+	while ( (size_t)width * height < area ){
+		if ( width <= height ) width *= 2;
+		else height *= 2;
+	}
+	bool packed = false;
+	while ( !packed && width <= options.maxSize && height <= options.maxSize ){
+		// The padding on the left and on the top of the atlas, then after each glyph
+		SkylinePacker packer(width - options.padding, height - options.padding);
+		packed = true;
+		for ( size_t i=0; i<order.size() && packed; i++ ){
+			int x, y;
+			packed = packer.pack(order[i]->glyph.width + options.padding, order[i]->glyph.height + options.padding, x, y);
+			order[i]->glyph.x = (unsigned short)(x + options.padding);
+			order[i]->glyph.y = (unsigned short)(y + options.padding);
+		}
+		if ( !packed ){
+			if ( width <= height ) width *= 2;
+			else height *= 2;
+		}
+	}
+	if ( !packed ){
+		printf("The glyphs don't fit in a %ux%u atlas\n", options.maxSize, options.maxSize);
+		return false;
+	}
+
+	out.width = width;
+	out.height = height;
+	out.lineHeight = (set.lineHeight + options.downscale/2) / options.downscale;
+	out.ascent = (set.ascent + options.downscale/2) / options.downscale;
+	out.distanceField = options.distanceField;
+	out.spread = options.distanceField ? (float)options.spread / options.downscale : 0.0f;
+
+	out.pixels.assign((size_t)width * height, 0);
+	out.glyphs.clear();
+	for ( size_t i=0; i<baked.size(); i++ ){
+		const BakedGlyph & b = baked[i];
+		for ( int y=0; y<b.glyph.height; y++ )
+			memcpy(&out.pixels[(size_t)(b.glyph.y + y) * width + b.glyph.x], &b.pixels[y * b.glyph.width], b.glyph.width);
+		out.glyphs.push_back(b.glyph);
+	}
+
+	out.kernings = set.kernings;
+	for ( size_t i=0; i<out.kernings.size(); i++ )
+		out.kernings[i].amount = (short)(out.kernings[i].amount / options.downscale);
+
+	// Sorted, for the binary searches
+	struct ByCodepoint{ bool operator()(const FontGlyph & a, const FontGlyph & b) const { return a.codepoint < b.codepoint; } };
+	struct ByPair{ bool operator()(const FontKerning & a, const FontKerning & b) const { return a.first != b.first ? a.first < b.first : a.second < b.second; } };
+	std::sort(out.glyphs.begin(), out.glyphs.end(), ByCodepoint());
+	std::sort(out.kernings.begin(), out.kernings.end(), ByPair());
+
+	out.buildLookup();
+	return true;
+}
+
+bool saveFontAtlas(const char * path, const FontAtlas & atlas){
+
+	FontAtlasHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = FONTATLAS_MAGIC;
+	header.version = FONTATLAS_VERSION;
+	header.width = atlas.width;
+	header.height = atlas.height;
+	header.lineHeight = atlas.lineHeight;
+	header.ascent = atlas.ascent;
+	header.flags = atlas.distanceField ? 1 : 0;
+	header.spread = atlas.spread;
+	header.glyphCount = (unsigned int)atlas.glyphs.size();
+	header.kerningCount = (unsigned int)atlas.kernings.size();
+
+	// Write a temporary file and rename it, so that a crash never leaves a half-written atlas
+	std::string tempPath = std::string(path) + ".tmp";
+	FILE * file = fopen(tempPath.c_str(), "wb");
+	if ( !file )
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	if ( ok && !atlas.glyphs.empty() )
+		ok = fwrite(&atlas.glyphs[0], sizeof(FontGlyph), atlas.glyphs.size(), file) == atlas.glyphs.size();
+	if ( ok && !atlas.kernings.empty() )
+		ok = fwrite(&atlas.kernings[0], sizeof(FontKerning), atlas.kernings.size(), file) == atlas.kernings.size();
+	if ( ok && !atlas.pixels.empty() )
+		ok = fwrite(&atlas.pixels[0], 1, atlas.pixels.size(), file) == atlas.pixels.size();
+	ok = (fclose(file) == 0) && ok;
+	if ( ok ){
+		remove(path); // rename() doesn't overwrite on Windows
+		ok = rename(tempPath.c_str(), path) == 0;
+	}
+	if ( !ok )
+		remove(tempPath.c_str());
+	return ok;
+}
+
+bool loadFontAtlas(const char * path, FontAtlas & atlas){
+
+	MappedFile file;
+	if ( !mapFile(path, file) )
+		return false;
+
+	FontAtlasHeader header;
+	bool ok = file.size >= sizeof(header);
+	if ( ok ){
+		memcpy(&header, file.data, sizeof(header));
+		ok = header.magic == FONTATLAS_MAGIC && header.version == FONTATLAS_VERSION &&
+		     header.width > 0 && header.height > 0 && header.lineHeight > 0 && // Text is scaled by 1/lineHeight, UVs by 1/width and 1/height
+		     header.width <= 16384 && header.height <= 16384 &&
+		     header.glyphCount <= 65536 && header.kerningCount <= 65536*64 &&
+		     file.size == sizeof(header) + header.glyphCount * sizeof(FontGlyph) + header.kerningCount * sizeof(FontKerning)
+		                  + (size_t)header.width * header.height;
+	}
+	if ( !ok ){
+		printf("%s is not a font atlas\n", path);
+		unmapFile(file);
+		return false;
+	}
+
+	const unsigned char * data = file.data + sizeof(header);
+
+	// Every glyph must be inside the atlas, or the quads would show other glyphs, or garbage
+	for ( unsigned int i=0; i<header.glyphCount; i++ ){
+		FontGlyph glyph;
+		memcpy(&glyph, data + i * sizeof(FontGlyph), sizeof(glyph));
+		if ( (unsigned int)glyph.x + glyph.width > header.width || (unsigned int)glyph.y + glyph.height > header.height ){
+			printf("%s is corrupted : glyph %u is outside of the atlas\n", path, (unsigned int)glyph.codepoint);
+			unmapFile(file);
+			return false;
+		}
+	}
+
+	atlas.width = header.width;
+	atlas.height = header.height;
+	atlas.lineHeight = header.lineHeight;
+	atlas.ascent = header.ascent;
+	atlas.distanceField = (header.flags & 1) != 0;
+	atlas.spread = header.spread;
+	atlas.glyphs.resize(header.glyphCount);
+	atlas.kernings.resize(header.kerningCount);
+	if ( header.glyphCount )
+		memcpy(&atlas.glyphs[0], data, header.glyphCount * sizeof(FontGlyph));
+	data += header.glyphCount * sizeof(FontGlyph);
+	if ( header.kerningCount )
+		memcpy(&atlas.kernings[0], data, header.kerningCount * sizeof(FontKerning));
+	data += header.kerningCount * sizeof(FontKerning);
+	atlas.pixels.assign(data, data + (size_t)header.width * header.height);
+	unmapFile(file);
+
+	atlas.buildLookup();
+	return true;
+}
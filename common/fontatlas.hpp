@@ -0,0 +1,120 @@
+#ifndef FONTATLAS_HPP
+#define FONTATLAS_HPP
+
+#include <vector>
+
+// Proportional fonts for text2D, without OpenGL.
+//
+// A 16x16 grid of characters (like Holstein.DDS) gives every character the
+// same width : "i" takes as much room as "W", and "AV" has a big hole in the
+// middle. Here, the glyphs are cut out of the grid, measured, and packed
+// tightly in a smaller atlas, with :
+// - for each glyph, its own width (advance) and its position relative to the
+//   pen (bearing)
+// - a kerning table, for the pairs that look better closer : "AV", "To"...
+// - optionally, a Signed Distance Field instead of the coverage : a small
+//   atlas then gives sharp text at any size (see the DISTANCE_FIELD shader).
+//
+// Baking takes a bit of time, so the result can be saved in a small binary
+// file (see saveFontAtlas) and loaded directly the next time.
+//
+// Coordinates : in atlas pixels, x to the right, y up, relative to the pen
+// which is on the baseline.
+
+struct Image;
+
+// One glyph of an atlas. 16 bytes in the file.
+struct FontGlyph{
+	unsigned short codepoint;
+	unsigned short x, y;          // Up left corner in the atlas (row 0 is the top of the atlas)
+	unsigned short width, height; // 0 for glyphs without pixels, like the space
+	short left;                   // From the pen to the left of the bitmap
+	short top;                    // From the baseline to the top of the bitmap
+	short advance;                // How far the pen moves after this glyph, in 1/64 pixels
+};
+
+// The pen moves by amount after first, when second follows. 8 bytes in the file.
+struct FontKerning{
+	unsigned short first;
+	unsigned short second;
+	short amount;  // In 1/64 pixels, usually negative
+	short padding;
+};
+
+struct FontAtlas{
+	unsigned int width, height; // Of the atlas
+	int lineHeight;             // From one line to the next. Text of size S is scaled by S/lineHeight.
+	int ascent;                 // From the top of the line to the baseline
+	bool distanceField;         // pixels are a Signed Distance Field, not the coverage
+	float spread;               // Distance field : a distance of spread pixels from the edge is 0 or 255. The edge is 128.
+
+	std::vector<FontGlyph> glyphs;     // Sorted by codepoint
+	std::vector<FontKerning> kernings; // Sorted by first, then second
+	std::vector<unsigned char> pixels; // width*height, one channel, top row first
+
+	FontAtlas() : width(0), height(0), lineHeight(0), ascent(0), distanceField(false), spread(0.0f) { buildLookup(); }
+
+	// NULL if the font doesn't have this character
+	const FontGlyph * glyph(unsigned int codepoint) const;
+
+	// In pixels. 0 for most pairs.
+	float kerning(unsigned int first, unsigned int second) const;
+
+	// Makes glyph() instant for characters 0..255. Done by bake and load.
+	void buildLookup();
+
+private:
+	short lookup[256]; // Index in glyphs, -1 if missing
+};
+
+// A glyph before baking : its coverage at the resolution of the source
+struct GlyphBitmap{
+	unsigned int codepoint;
+	int width, height;
+	int left, top;    // Like in FontGlyph
+	float advance;    // In pixels
+	std::vector<unsigned char> coverage; // width*height, top row first. 255 : inside.
+};
+
+// The glyphs of a font, from a source : a grid, a rasterizer...
+struct GlyphSet{
+	int lineHeight;
+	int ascent;
+	std::vector<GlyphBitmap> glyphs;
+	std::vector<FontKerning> kernings;
+};
+
+// Cuts the 256 characters of a 16x16 grid (the alpha of the image, or its
+// brightness if it has no alpha) into tight glyphs. The baseline is guessed
+// from the bottom of the glyphs, and the space gets a third of a cell.
+// Prints why and returns false for unsupported formats (DXT1, BC4...).
+bool glyphsFromGrid(const Image & grid, GlyphSet & out);
+
+// "Optical" kerning : moves second closer to first until their closest
+// pixels, line by line, are as far as in a normal pair ("HH").
+// Only for the printable ASCII characters. Replaces out.kernings.
+void computeKerning(GlyphSet & glyphs);
+
+struct FontBakeOptions{
+	bool distanceField;
+	int downscale;    // The atlas is downscale times smaller than the source : 2 for a 64 pixels grid gives 32 pixels glyphs
+	int spread;       // Distance field : in source pixels
+	int padding;      // Empty atlas pixels around each glyph, so that they don't bleed into each other
+	unsigned int maxSize; // The atlas doesn't get bigger than that
+
+	FontBakeOptions() : distanceField(false), downscale(1), spread(8), padding(1), maxSize(4096) {}
+};
+
+// Packs the glyphs in the smallest atlas that it can (skyline packing, tallest
+// glyphs first). Returns false if they don't fit in maxSize x maxSize.
+bool bakeFontAtlas(const GlyphSet & glyphs, const FontBakeOptions & options, FontAtlas & out);
+
+// In a small binary file : header, glyphs, kernings, pixels. Written to a
+// temporary file, then renamed.
+bool saveFontAtlas(const char * path, const FontAtlas & atlas);
+
+// Returns false if the file is missing, not a font atlas of this version, or
+// corrupted (lineHeight <= 0, glyphs outside of the atlas...).
+bool loadFontAtlas(const char * path, FontAtlas & atlas);
+
+#endif
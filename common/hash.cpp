@@ -0,0 +1,54 @@
+#include <string.h>
+
+#include "mappedfile.hpp"
+#include "hash.hpp"
+
+// MurmurHash2, 64-bit version, by Austin Appleby (public domain)
+unsigned long long hashBytes(const void * data, size_t size, unsigned long long seed){
+	const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+
+	unsigned long long h = seed ^ (size * m);
+
+	const unsigned char * p = (const unsigned char *)data;
+	const unsigned char * end = p + (size & ~(size_t)7);
+
+	while ( p != end ){
+		unsigned long long k;
+		memcpy(&k, p, 8); // Unaligned read
+		p += 8;
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	switch ( size & 7 ){
+		case 7: h ^= (unsigned long long)p[6] << 48; // fall through
+		case 6: h ^= (unsigned long long)p[5] << 40; // fall through
+		case 5: h ^= (unsigned long long)p[4] << 32; // fall through
+		case 4: h ^= (unsigned long long)p[3] << 24; // fall through
+		case 3: h ^= (unsigned long long)p[2] << 16; // fall through
+		case 2: h ^= (unsigned long long)p[1] << 8;  // fall through
+		case 1: h ^= (unsigned long long)p[0];
+		        h *= m;
+	};
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+bool hashFile(const char * path, unsigned long long & hash){
+	MappedFile file;
+	if ( !mapFile(path, file) )
+		return false;
+	hash = hashBytes(file.data, file.size);
+	unmapFile(file);
+	return true;
+}
@@ -0,0 +1,11 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+// 64-bit non-cryptographic hash of a block of memory (MurmurHash64A).
+// Fast enough to fingerprint whole files. Don't use it for security.
+unsigned long long hashBytes(const void * data, size_t size, unsigned long long seed = 0);
+
+// Hashes a whole file. Returns false if the file can't be opened.
+bool hashFile(const char * path, unsigned long long & hash);
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utility>
+
+#include "threadpool.hpp"
+#include "image.hpp"
+#include "ddsfile.hpp"
+
+Image::Image(Image && other) : format(IMAGE_BGR8), srgb(false), width(0), height(0), faceCount(1), layerCount(1), faceSize(0), pixels(NULL) {
+	swap(other);
+}
+
+Image & Image::operator=(Image && other){
+	// What this image had is released when other is destroyed
+	swap(other);
+	return *this;
+}
+
+Image::~Image(){
+	unmapFile(mapping);
+}
+
+void Image::swap(Image & other){
+	std::swap(format, other.format);
+	std::swap(srgb, other.srgb);
+	std::swap(width, other.width);
+	std::swap(height, other.height);
+	std::swap(faceCount, other.faceCount);
+	std::swap(layerCount, other.layerCount);
+	mips.swap(other.mips);
+	std::swap(faceSize, other.faceSize);
+	std::swap(pixels, other.pixels); // Still valid : swapping vectors doesn't move their content
+	storage.swap(other.storage);
+	std::swap(mapping, other.mapping);
+}
+
+size_t imageMipSize(ImageFormat format, unsigned int width, unsigned int height){
+	switch(format){
+	case IMAGE_BGR8:
+		return (size_t)((width*3 + 3) & ~3u) * height; // Rows are padded to 4 bytes
+	case IMAGE_BGRA8:
+		return (size_t)width * 4 * height;
+	case IMAGE_DXT1:
+	case IMAGE_BC4:
+	case IMAGE_BC4_SIGNED:
+		return (size_t)((width+3)/4) * ((height+3)/4) * 8;
+	case IMAGE_DXT3:
+	case IMAGE_DXT5:
+	case IMAGE_BC5:
+	case IMAGE_BC5_SIGNED:
+	case IMAGE_BC7:
+		return (size_t)((width+3)/4) * ((height+3)/4) * 16;
+	}
+	return 0;
+}
+
+bool decodeBMP(const char * imagepath, Image & image){
+
+	printf("Reading image %s\n", imagepath);
+
+	image = Image();
+
+	// Data read from the header of the BMP file
+	unsigned char header[54];
+	unsigned int dataPos;
+	unsigned int width, height;
+
+	// Open the file
+	FILE * file = fopen(imagepath,"rb");
+	if (!file)							    {printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); return false;}
+
+	// Read the header, i.e. the 54 first bytes
+
+	// If less than 54 bytes are read, problem
+	// A BMP files always begins with "BM"
+	// Make sure this is a 24bpp uncompressed file
+	if ( fread(header, 1, 54, file)!=54 ||
+	     header[0]!='B' || header[1]!='M' ||
+	     *(int*)&(header[0x1E])!=0 ||
+	     *(short*)&(header[0x1C])!=24 ){
+		printf("Not a correct BMP file\n");
+		fclose(file);
+		return false;
+	}
+
+	// Read the information about the image
+	dataPos    = *(int*)&(header[0x0A]);
+	width      = *(int*)&(header[0x12]);
+	height     = *(int*)&(header[0x16]);
+
+	// Some BMP files are misformatted, guess missing information.
+	// The size in the header is ignored : it's often 0, and never needed.
+	if (dataPos==0)      dataPos=54; // The BMP header is done that way
+
+	ImageMip mip;
+	mip.width  = width;
+	mip.height = height;
+	mip.offset = 0;
+	mip.size   = imageMipSize(IMAGE_BGR8, width, height);
+
+	// Read the actual data from the file
+	if ( width == 0 || height == 0 || (int)width < 0 || (int)height < 0 ||
+	     fseek(file, dataPos, SEEK_SET) != 0 ){
+		printf("Not a correct BMP file\n");
+		fclose(file);
+		return false;
+	}
+	image.storage.resize(mip.size);
+	if ( fread(&image.storage[0], 1, mip.size, file) != mip.size ){
+		printf("Not a correct BMP file\n");
+		fclose(file);
+		image = Image();
+		return false;
+	}
+
+	// Everything is in memory now, the file can be closed
+	fclose (file);
+
+	image.format = IMAGE_BGR8;
+	image.width  = width;
+	image.height = height;
+	image.mips.push_back(mip);
+	image.faceSize = mip.size;
+	image.pixels = &image.storage[0];
+	return true;
+}
+
+
+bool decodeDDS(const char * imagepath, Image & image){
+
+	image = Image();
+
+	/* try to open the file */
+	MappedFile file;
+	if ( !mapFile(imagepath, file) ){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return false;
+	}
+
+	// The pixels stay in the file : the image keeps the mapping
+	if ( !parseDDS(file.data, file.size, image, imagepath) ){
+		unmapFile(file);
+		return false;
+	}
+	image.mapping = file;
+	return true;
+}
+
+bool decodeImage(const char * imagepath, Image & image){
+	char magic[4] = {0};
+	FILE * file = fopen(imagepath, "rb");
+	if ( file ){
+		if ( fread(magic, 1, 4, file) != 4 )
+			magic[0] = 0;
+		fclose(file);
+	}
+	if ( strncmp(magic, "DDS ", 4) == 0 )
+		return decodeDDS(imagepath, image);
+	return decodeBMP(imagepath, image); // Which prints the errors
+}
+
+
+
+ImageLoader::ImageLoader(ThreadPool & pool) : pool(pool), nextId(0), decodingCount(0) {
+}
+
+ImageLoader::~ImageLoader(){
+	wait();
+}
+
+unsigned int ImageLoader::load(const char * imagepath){
+	unsigned int id;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		id = nextId++;
+		decodingCount++;
+	}
+	std::string path(imagepath);
+	pool.submit([this, id, path](){
+		LoadedImage result;
+		result.id = id;
+		result.path = path;
+		result.ok = decodeImage(path.c_str(), result.image);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.push_back(std::move(result));
+		decodingCount--;
+		decodedCondition.notify_all();
+	});
+	return id;
+}
+
+void ImageLoader::takeFinished(std::vector<LoadedImage> & out){
+	std::unique_lock<std::mutex> lock(mutex);
+	for ( size_t i=0; i<finished.size(); i++ )
+		out.push_back(std::move(finished[i]));
+	finished.clear();
+}
+
+void ImageLoader::wait(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while ( decodingCount > 0 )
+		decodedCondition.wait(lock);
+}
+
+void ImageLoader::waitAny(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while ( finished.empty() && decodingCount > 0 )
+		decodedCondition.wait(lock);
+}
+
+size_t ImageLoader::pendingCount(){
+	std::unique_lock<std::mutex> lock(mutex);
+	return decodingCount + finished.size();
+}
@@ -0,0 +1,145 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+
+// Decoding of image files on the CPU, without OpenGL.
+//
+// loadBMP_custom and loadDDS (see texture.hpp) are decodeBMP/decodeDDS
+// followed by uploadTexture. The decoding part doesn't need a GL context, so
+// it can run on any thread (see ImageLoader), and only the upload has to be
+// done on the thread that renders.
+
+#include "mappedfile.hpp"
+
+class ThreadPool;
+
+enum ImageFormat{
+	IMAGE_BGR8,       // 3 bytes per pixel, rows padded to 4 bytes, bottom row first (like in a .BMP)
+	IMAGE_BGRA8,      // 4 bytes per pixel, bottom row first
+	IMAGE_DXT1,       // BC1. Blocks of 4x4 pixels, 8 bytes per block
+	IMAGE_DXT3,       // BC2. Blocks of 4x4 pixels, 16 bytes per block
+	IMAGE_DXT5,       // BC3. Blocks of 4x4 pixels, 16 bytes per block
+	IMAGE_BC4,        // One channel (red). Blocks of 4x4 pixels, 8 bytes per block
+	IMAGE_BC4_SIGNED,
+	IMAGE_BC5,        // Two channels (red, green), for normal maps. Blocks of 4x4 pixels, 16 bytes per block
+	IMAGE_BC5_SIGNED,
+	IMAGE_BC7         // Blocks of 4x4 pixels, 16 bytes per block
+};
+
+// Where one mipmap level is, in each face of the image
+struct ImageMip{
+	unsigned int width;
+	unsigned int height;
+	size_t offset; // In bytes, from the beginning of the face
+	size_t size;   // In bytes
+};
+
+// A decoded image, and all its mipmaps. Cubemaps and texture arrays
+// (from .DDS files) have several faces, all with the same mips, one after
+// the other : layer 0 face 0, layer 0 face 1... layer 1 face 0...
+//
+// The pixels are either in storage, or directly in the file, mapped in
+// memory (see decodeDDS) : then nothing is copied at all. Either way, an
+// Image can be moved (C++11) but not copied.
+struct Image{
+	ImageFormat format;
+	bool srgb;           // The colors are in sRGB space (only from .DDS files with a DX10 header)
+	unsigned int width;  // Of the first mip
+	unsigned int height; // Of the first mip
+	unsigned int faceCount;  // 6 for a cubemap (+X, -X, +Y, -Y, +Z, -Z), 1 otherwise
+	unsigned int layerCount; // More than 1 for a texture array
+	std::vector<ImageMip> mips; // mips[0] is the full image. Only one mip if the file has none.
+	size_t faceSize;            // In bytes, all mips included
+	const unsigned char * pixels; // All the faces
+
+	// Where pixels are. Don't touch.
+	std::vector<unsigned char> storage;
+	MappedFile mapping;
+
+	Image() : format(IMAGE_BGR8), srgb(false), width(0), height(0), faceCount(1), layerCount(1), faceSize(0), pixels(NULL) {}
+	Image(Image && other);
+	Image & operator=(Image && other);
+	~Image();
+
+	bool isCompressed() const { return format != IMAGE_BGR8 && format != IMAGE_BGRA8; }
+	bool isCubemap() const { return faceCount == 6; }
+	size_t dataSize() const { return faceSize * faceCount * layerCount; }
+	const unsigned char * mipData(size_t level, unsigned int face = 0, unsigned int layer = 0) const {
+		return pixels + faceSize * ((size_t)layer * faceCount + face) + mips[level].offset;
+	}
+
+	void swap(Image & other);
+
+private:
+	Image(const Image &);            // Not copyable
+	Image & operator=(const Image &);
+};
+
+// Size in bytes of one mip of width x height pixels
+size_t imageMipSize(ImageFormat format, unsigned int width, unsigned int height);
+
+// Reads a 24bpp uncompressed .BMP file. Prints why and returns false if it can't.
+bool decodeBMP(const char * imagepath, Image & image);
+
+// Maps a .DDS file in memory, and reads its header (see ddsfile.hpp) : the
+// pixels are not copied, they stay in the mapping until the image is destroyed.
+// Prints why and returns false if it can't.
+bool decodeDDS(const char * imagepath, Image & image);
+
+// decodeBMP or decodeDDS, depending on the first bytes of the file
+bool decodeImage(const char * imagepath, Image & image);
+
+// The result of ImageLoader::load()
+struct LoadedImage{
+	unsigned int id; // What load() returned
+	std::string path;
+	bool ok;         // False if the file couldn't be decoded. image is empty, then.
+	Image image;
+};
+
+// Decodes many images at the same time, on a ThreadPool.
+// Typical use, on the render thread :
+//   ImageLoader loader(pool);
+//   for each texture : id = loader.load(path);
+//   each frame (or in a loop) : loader.takeFinished(images); upload them.
+// See TextureLoader in texture.hpp, which does exactly this.
+class ImageLoader{
+public:
+	explicit ImageLoader(ThreadPool & pool);
+
+	// Waits for the images being decoded. The ones not taken are lost.
+	~ImageLoader();
+
+	// Starts decoding the file. Returns its id : 0 for the first call, then 1, 2...
+	unsigned int load(const char * imagepath);
+
+	// Moves all the images decoded since the last call at the end of out, in
+	// the order they were finished. Never blocks.
+	void takeFinished(std::vector<LoadedImage> & out);
+
+	// Blocks until all the requested images are decoded (they still have to be taken)
+	void wait();
+
+	// Blocks until there is at least one image to take, or nothing left to decode
+	void waitAny();
+
+	// Requested, but not taken yet
+	size_t pendingCount();
+
+private:
+	ImageLoader(const ImageLoader &);            // Not copyable
+	ImageLoader & operator=(const ImageLoader &);
+
+	ThreadPool & pool;
+	std::mutex mutex;
+	std::condition_variable decodedCondition;
+	std::vector<LoadedImage> finished;
+	unsigned int nextId;
+	size_t decodingCount; // Requested, but not decoded yet
+};
+
+#endif
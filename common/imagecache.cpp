@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hash.hpp"
+#include "imagecache.hpp"
+
+ImageCache::ImageCache(size_t budgetBytes) : budget(budgetBytes) {
+	memset(&counters, 0, sizeof(counters));
+}
+
+const Image * ImageCache::acquire(const char * imagepath){
+
+	std::string path(imagepath);
+
+	// Fast path : this file was loaded before, and its image is still there.
+	// The file isn't read at all (so if it changed since, the old image is used).
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		std::map<std::string, unsigned long long>::iterator p = pathHashes.find(path);
+		if ( p != pathHashes.end() ){
+			std::map<unsigned long long, Entry>::iterator e = entries.find(p->second);
+			if ( e != entries.end() ){
+				counters.hits++;
+				if ( e->second.refCount++ == 0 )
+					unused.erase(e->second.lruPosition);
+				return &e->second.image;
+			}
+		}
+	}
+
+	// Hashing is much faster than decoding, so look for the same content first
+	unsigned long long hash;
+	if ( !hashFile(imagepath, hash) ){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return NULL;
+	}
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		pathHashes[path] = hash;
+		std::map<unsigned long long, Entry>::iterator e = entries.find(hash);
+		if ( e != entries.end() ){
+			counters.hits++;
+			counters.contentHits++;
+			if ( e->second.refCount++ == 0 )
+				unused.erase(e->second.lruPosition);
+			return &e->second.image;
+		}
+	}
+
+	// Decode without the lock : other threads can use the cache meanwhile
+	Image image;
+	bool ok = decodeImage(imagepath, image);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	counters.misses++;
+	if ( !ok )
+		return NULL;
+
+	// Another thread may have decoded the same content at the same time
+	std::map<unsigned long long, Entry>::iterator e = entries.find(hash);
+	if ( e != entries.end() ){
+		if ( e->second.refCount++ == 0 )
+			unused.erase(e->second.lruPosition);
+		return &e->second.image;
+	}
+
+	Entry & entry = entries[hash];
+	entry.image = std::move(image);
+	entry.bytes = entry.image.dataSize();
+	entry.refCount = 1;
+	imageHashes[&entry.image] = hash;
+	counters.residentBytes += entry.bytes;
+	counters.residentCount++;
+
+	// Make room for the new image, if possible
+	evict(budget);
+
+	return &entry.image;
+}
+
+void ImageCache::release(const Image * image){
+	if ( image == NULL )
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	std::map<const Image *, unsigned long long>::iterator h = imageHashes.find(image);
+	if ( h == imageHashes.end() ){
+		printf("ImageCache::release : this image doesn't come from this cache\n");
+		return;
+	}
+	Entry & entry = entries[h->second];
+	if ( --entry.refCount == 0 ){
+		entry.lruPosition = unused.insert(unused.end(), h->second);
+		evict(budget);
+	}
+}
+
+void ImageCache::setBudget(size_t budgetBytes){
+	std::unique_lock<std::mutex> lock(mutex);
+	budget = budgetBytes;
+	evict(budget);
+}
+
+void ImageCache::clear(){
+	std::unique_lock<std::mutex> lock(mutex);
+	evict(0);
+}
+
+ImageCacheStats ImageCache::stats(){
+	std::unique_lock<std::mutex> lock(mutex);
+	return counters;
+}
+
+void ImageCache::evict(size_t budget){
+	while ( counters.residentBytes > budget && !unused.empty() ){
+		unsigned long long hash = unused.front();
+		unused.pop_front();
+
+		std::map<unsigned long long, Entry>::iterator e = entries.find(hash);
+		counters.residentBytes -= e->second.bytes;
+		counters.residentCount--;
+		counters.evictions++;
+		imageHashes.erase(&e->second.image);
+		entries.erase(e);
+	}
+}
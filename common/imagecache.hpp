@@ -0,0 +1,76 @@
+#ifndef IMAGECACHE_HPP
+#define IMAGECACHE_HPP
+
+#include <map>
+#include <list>
+#include <string>
+#include <mutex>
+
+#include "image.hpp"
+
+// Keeps decoded images in memory, so that loading the same file again (for
+// instance, when switching back to a previous scene) doesn't decode it again.
+//
+// - Images are found by path, and by content : two files with the same
+//   content (like the uvmap.DDS of every tutorial) share one image.
+// - Images are reference counted : acquire() gives one, release() gives it back.
+// - Images that nobody uses stay in memory, until the total size of the
+//   images goes over the budget : then the least recently released ones are
+//   destroyed first (LRU). Images in use are never destroyed, so the budget
+//   can be exceeded if they don't fit.
+//
+// Everything is thread-safe, and decoding happens outside of the lock, so
+// several threads can load different images at the same time.
+
+struct ImageCacheStats{
+	unsigned long long hits;         // acquire() found the image in memory...
+	unsigned long long contentHits;  // ... (among hits) under another path, with the same content
+	unsigned long long misses;       // acquire() had to decode the file
+	unsigned long long evictions;    // Unused images destroyed to stay in the budget
+	size_t residentBytes;            // Total size of the images in memory, used or not
+	size_t residentCount;
+};
+
+class ImageCache{
+public:
+	explicit ImageCache(size_t budgetBytes = 256*1024*1024);
+
+	// Returns the image of this file, and increments its reference count.
+	// NULL if the file can't be decoded (see decodeImage).
+	const Image * acquire(const char * imagepath);
+
+	// Decrements the reference count of an image returned by acquire(). When
+	// it reaches 0, the image may be destroyed at any time.
+	void release(const Image * image);
+
+	// Destroys unused images until the others fit in budgetBytes
+	void setBudget(size_t budgetBytes);
+
+	// Destroys all the unused images
+	void clear();
+
+	ImageCacheStats stats();
+
+private:
+	ImageCache(const ImageCache &);            // Not copyable
+	ImageCache & operator=(const ImageCache &);
+
+	struct Entry{
+		Image image;
+		size_t bytes;
+		unsigned int refCount;
+		std::list<unsigned long long>::iterator lruPosition; // In unused, if refCount == 0
+	};
+
+	void evict(size_t budget); // The mutex must be locked
+
+	std::mutex mutex;
+	std::map<unsigned long long, Entry> entries;            // By content hash
+	std::map<std::string, unsigned long long> pathHashes;   // Last content hash of each path
+	std::map<const Image *, unsigned long long> imageHashes;
+	std::list<unsigned long long> unused;                   // Unused entries, least recently released first
+	size_t budget;
+	ImageCacheStats counters;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include <stdio.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+#ifdef _WIN32
+
+bool mapFile(const char * path, MappedFile & file){
+
+	file = MappedFile();
+
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if ( handle == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if ( !GetFileSizeEx(handle, &size) ){
+		CloseHandle(handle);
+		return false;
+	}
+	if ( size.QuadPart == 0 ){
+		// Can't map an empty file, but this isn't an error
+		CloseHandle(handle);
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if ( mapping == NULL ){
+		CloseHandle(handle);
+		return false;
+	}
+
+	void * data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if ( data == NULL ){
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file.data = (const unsigned char *)data;
+	file.size = (size_t)size.QuadPart;
+	file.fileHandle = handle;
+	file.mappingHandle = mapping;
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if ( file.data )
+		UnmapViewOfFile(file.data);
+	if ( file.mappingHandle )
+		CloseHandle(file.mappingHandle);
+	if ( file.fileHandle )
+		CloseHandle(file.fileHandle);
+	file = MappedFile();
+}
+
+#else
+
+bool mapFile(const char * path, MappedFile & file){
+
+	file = MappedFile();
+
+	int fd = open(path, O_RDONLY);
+	if ( fd < 0 )
+		return false;
+
+	struct stat info;
+	if ( fstat(fd, &info) != 0 ){
+		close(fd);
+		return false;
+	}
+	if ( info.st_size == 0 ){
+		// Can't map an empty file, but this isn't an error
+		close(fd);
+		return true;
+	}
+
+	void * data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file
+	close(fd);
+	if ( data == MAP_FAILED )
+		return false;
+
+	// We will read the whole file, from the beginning to the end
+	madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	file.data = (const unsigned char *)data;
+	file.size = (size_t)info.st_size;
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if ( file.data )
+		munmap((void*)file.data, file.size);
+	file = MappedFile();
+}
+
+#endif
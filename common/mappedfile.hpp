@@ -0,0 +1,23 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+// A whole file, mapped read-only in memory.
+// Nothing is copied : pages are read from the disk (or the OS cache)
+// when they are accessed for the first time.
+struct MappedFile{
+	const unsigned char * data;
+	size_t size;
+
+	// OS handles. Don't touch.
+	void * fileHandle;
+	void * mappingHandle;
+
+	MappedFile() : data(NULL), size(0), fileHandle(NULL), mappingHandle(NULL) {}
+};
+
+// Returns false if the file can't be opened. An empty file is mapped with data == NULL.
+bool mapFile(const char * path, MappedFile & file);
+
+void unmapFile(MappedFile & file);
+
+#endif
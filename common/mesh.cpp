@@ -0,0 +1,44 @@
+#include <vector>
+#include <string.h> // for memcpy
+
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+
+// Copies count vectors of size components, every stride floats
+static void scatter(const float * in, size_t count, int size, float * out, unsigned int stride){
+	for ( size_t i=0; i<count; i++ )
+		memcpy(out + i*stride, in + i*size, size*sizeof(float));
+}
+
+void interleaveMesh(
+	const Mesh & mesh,
+	std::vector<float> & out_data,
+	InterleavedLayout & out_layout
+){
+	bool hasTBN = mesh.hasTangents();
+
+	// position (3) + uv (2) + normal (3) [+ tangent (3) + bitangent (3)]
+	unsigned int floats = hasTBN ? 14 : 8;
+	out_layout.stride          = floats * sizeof(float);
+	out_layout.vertexOffset    = 0;
+	out_layout.uvOffset        = 3 * sizeof(float);
+	out_layout.normalOffset    = 5 * sizeof(float);
+	out_layout.tangentOffset   = hasTBN ?  8 * (int)sizeof(float) : -1;
+	out_layout.bitangentOffset = hasTBN ? 11 * (int)sizeof(float) : -1;
+
+	size_t count = mesh.vertexCount();
+	out_data.resize(count * floats);
+	if ( count == 0 )
+		return;
+
+	// One attribute at a time : each input array is read sequentially
+	float * out = &out_data[0];
+	scatter(&mesh.vertices[0].x, count, 3, out + 0, floats);
+	scatter(&mesh.uvs     [0].x, count, 2, out + 3, floats);
+	scatter(&mesh.normals [0].x, count, 3, out + 5, floats);
+	if ( hasTBN ){
+		scatter(&mesh.tangents  [0].x, count, 3, out +  8, floats);
+		scatter(&mesh.bitangents[0].x, count, 3, out + 11, floats);
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include "vboindexer.hpp"
+
+// A simplified version of a mesh (see simplify.hpp) : it uses the same
+// vertices, but fewer triangles.
+struct MeshLOD{
+	std::vector<unsigned int> indices;
+	float ratio; // Requested triangle count, relative to the full mesh
+	float error; // Largest distance to the full mesh, relative to its size
+};
+
+// All the data of a mesh, one array per attribute ("structure of arrays").
+// This is what loadOBJ, indexVBO and computeTangentBasis work on in place :
+// loading, indexing and computing the tangents of a model doesn't need any
+// other full-size copy, and a Mesh can be moved around for free (C++11).
+// Each array is exactly what glBufferData wants for one attribute.
+//
+// The arrays are std::vectors, so they can be swapped with the ones used by
+// the older functions, and their data is aligned like any heap block
+// (16 bytes on all the platforms we support).
+struct Mesh{
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec3> tangents;   // Empty until computeTangentBasis()
+	std::vector<glm::vec3> bitangents; // Empty until computeTangentBasis()
+	std::vector<unsigned int> indices; // Empty until indexVBO() : a triangle soup, then.
+	std::vector<MeshLOD> lods;         // Empty until buildLODChain(). lods[0] is the first simplified version.
+
+	size_t vertexCount() const { return vertices.size(); }
+	size_t triangleCount() const { return (indices.empty() ? vertices.size() : indices.size()) / 3; }
+	bool isIndexed() const { return !indices.empty(); }
+	bool hasTangents() const { return !tangents.empty(); }
+
+	void clear(){
+		vertices.clear(); uvs.clear(); normals.clear();
+		tangents.clear(); bitangents.clear(); indices.clear();
+		lods.clear();
+	}
+};
+
+// Where each attribute is in an interleaved vertex, in bytes.
+// An offset is -1 if the attribute isn't there.
+struct InterleavedLayout{
+	unsigned int stride;
+	int vertexOffset;
+	int uvOffset;
+	int normalOffset;
+	int tangentOffset;
+	int bitangentOffset;
+};
+
+// Packs all the attributes of each vertex together ("array of structures"),
+// for a single VBO with glVertexAttribPointer(..., layout.stride, (void*)offset).
+// Tangents and bitangents are only exported if the mesh has them.
+void interleaveMesh(
+	const Mesh & mesh,
+	std::vector<float> & out_data,
+	InterleavedLayout & out_layout
+);
+
+// Moves the indices of the mesh in an IndexBuffer, with 16-bit indices if possible.
+void moveIndices(Mesh & mesh, IndexBuffer & out_indices);
+
+// See objloader.hpp. The previous content of mesh is replaced by a triangle soup.
+bool loadOBJ(const char * path, Mesh & mesh);
+bool loadOBJ_parallel(const char * path, Mesh & mesh, unsigned int threadCount = 0);
+
+// See objloader.hpp. The previous content of mesh is replaced by an indexed mesh.
+bool loadAssImp(const char * path, Mesh & mesh);
+
+// Welds the vertices of the mesh in place (see indexVBO in vboindexer.hpp).
+// If the mesh has tangents, the tangents of merged vertices are summed, like indexVBO_TBN.
+// If the mesh is already indexed, its indices (and the ones of its LODs) are updated.
+void indexVBO(Mesh & mesh, bool weldNearVertices = false);
+
+// Fills mesh.tangents and mesh.bitangents, for a triangle soup or an indexed
+// mesh (with computeTangentBasis_indexed, see tangentspace.hpp).
+// Either way, bitangent = cross(normal, tangent) * handedness.
+void computeTangentBasis(Mesh & mesh);
+
+#endif
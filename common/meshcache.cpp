@@ -0,0 +1,442 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+#include "tangentspace.hpp"
+#include "mesh.hpp"
+#include "vertexcache.hpp"
+#include "simplify.hpp"
+#include "hash.hpp"
+#include "meshcache.hpp"
+
+#define MESHCACHE_MAGIC   0x4D4C474F // "OGLM" in ASCII
+#define MESHCACHE_VERSION 5 // 2 : triangles and vertices are reordered by optimizeMesh. 3 : LODs. 4 : dates in nanoseconds. 5 : bitangents from the handedness
+
+enum MeshCacheStream{
+	STREAM_VERTICES,
+	STREAM_UVS,
+	STREAM_NORMALS,
+	STREAM_TANGENTS,
+	STREAM_BITANGENTS,
+	STREAM_INDICES,
+	STREAM_COUNT
+};
+
+struct MeshCacheHeader{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize;
+	unsigned int hasTangents;
+	unsigned long long sourceSize;
+	long long          sourceTime; // In nanoseconds
+	unsigned long long sourceHash;
+	unsigned long long streamOffset[STREAM_COUNT]; // From the beginning of the file. 0 if there is no such stream.
+	unsigned int lodCount;
+	LODRange lods[MESHCACHE_MAX_LODS];
+};
+
+// Size and date of a file, as seen by stat(). The date is in nanoseconds,
+// but it is only as precise as the system and the file system allow.
+static bool getFileInfo(const char * path, unsigned long long & size, long long & time){
+	struct stat info;
+	if ( stat(path, &info) != 0 )
+		return false;
+	size = (unsigned long long)info.st_size;
+#if defined(__APPLE__)
+	time = (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+	time = (long long)info.st_mtime * 1000000000LL;
+#else
+	time = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+static unsigned long long alignOffset(unsigned long long offset){
+	return (offset + 15) & ~15ULL;
+}
+
+static bool writeStream(FILE * file, unsigned long long & offset, const void * data, size_t size){
+	static const char padding[16] = {0};
+	unsigned long long aligned = alignOffset(offset);
+	if ( aligned != offset && fwrite(padding, 1, aligned - offset, file) != aligned - offset )
+		return false;
+	if ( size && fwrite(data, 1, size, file) != size )
+		return false;
+	offset = aligned + size;
+	return true;
+}
+
+bool saveMeshCache(
+	const char * path,
+	const char * sourcePath,
+	const IndexBuffer & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<glm::vec3> * tangents,
+	const std::vector<glm::vec3> * bitangents,
+	const std::vector<LODRange> * lods
+){
+	bool hasTangents = tangents && bitangents;
+	if ( lods && lods->size() > MESHCACHE_MAX_LODS ){
+		printf("Too many LODs for a compiled mesh\n");
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic       = MESHCACHE_MAGIC;
+	header.version     = MESHCACHE_VERSION;
+	header.vertexCount = vertices.size();
+	header.indexCount  = indices.size();
+	header.indexSize   = indices.use32bits ? 4 : 2;
+	header.hasTangents = hasTangents ? 1 : 0;
+	header.lodCount    = lods ? lods->size() : 0;
+	for ( unsigned int i=0; i<header.lodCount; i++ )
+		header.lods[i] = (*lods)[i];
+	if ( sourcePath ){
+		if ( !getFileInfo(sourcePath, header.sourceSize, header.sourceTime) || !hashFile(sourcePath, header.sourceHash) ){
+			printf("Can't read %s\n", sourcePath);
+			return false;
+		}
+	}
+
+	// Where each array will be
+	const void * streams[STREAM_COUNT] = {
+		header.vertexCount ? &vertices[0] : NULL,
+		header.vertexCount ? &uvs[0] : NULL,
+		header.vertexCount ? &normals[0] : NULL,
+		hasTangents && header.vertexCount ? &(*tangents)[0] : NULL,
+		hasTangents && header.vertexCount ? &(*bitangents)[0] : NULL,
+		indices.data()
+	};
+	size_t sizes[STREAM_COUNT] = {
+		header.vertexCount * sizeof(glm::vec3),
+		header.vertexCount * sizeof(glm::vec2),
+		header.vertexCount * sizeof(glm::vec3),
+		hasTangents ? header.vertexCount * sizeof(glm::vec3) : 0,
+		hasTangents ? header.vertexCount * sizeof(glm::vec3) : 0,
+		indices.sizeInBytes()
+	};
+	unsigned long long offset = sizeof(header);
+	for ( int i=0; i<STREAM_COUNT; i++ ){
+		if ( !hasTangents && (i == STREAM_TANGENTS || i == STREAM_BITANGENTS) )
+			continue;
+		header.streamOffset[i] = alignOffset(offset);
+		offset = header.streamOffset[i] + sizes[i];
+	}
+
+	// Write in a temporary file first, so that a crash never leaves a half-written cache behind
+	std::string tempPath = std::string(path) + ".tmp";
+	FILE * file = fopen(tempPath.c_str(), "wb");
+	if ( file == NULL ){
+		printf("Can't write %s\n", tempPath.c_str());
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	offset = sizeof(header);
+	for ( int i=0; i<STREAM_COUNT && ok; i++ ){
+		if ( header.streamOffset[i] )
+			ok = writeStream(file, offset, streams[i], sizes[i]);
+	}
+	ok = (fclose(file) == 0) && ok;
+
+	if ( ok ){
+		remove(path); // rename() doesn't overwrite on Windows
+		ok = rename(tempPath.c_str(), path) == 0;
+	}
+	if ( !ok ){
+		printf("Can't write %s\n", path);
+		remove(tempPath.c_str());
+	}
+	return ok;
+}
+
+// True if all the indices are smaller than vertexCount
+template <typename T>
+static bool indicesInRange(const T * indices, unsigned int indexCount, unsigned int vertexCount){
+	T largest = 0;
+	for ( unsigned int i=0; i<indexCount; i++ )
+		largest = indices[i] > largest ? indices[i] : largest;
+	return indexCount == 0 || largest < vertexCount;
+}
+
+bool openMeshCache(const char * path, MeshCacheView & view){
+
+	view = MeshCacheView();
+	if ( !mapFile(path, view.file) )
+		return false;
+
+	const unsigned char * data = view.file.data;
+	unsigned long long size = view.file.size;
+
+	MeshCacheHeader header;
+	if ( size < sizeof(header) ){
+		closeMeshCache(view);
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if ( header.magic != MESHCACHE_MAGIC || header.version != MESHCACHE_VERSION || (header.indexSize != 2 && header.indexSize != 4) ){
+		closeMeshCache(view);
+		return false;
+	}
+
+	// Never trust a file : check that every array is inside it
+	unsigned long long sizes[STREAM_COUNT] = {
+		header.vertexCount * (unsigned long long)sizeof(glm::vec3),
+		header.vertexCount * (unsigned long long)sizeof(glm::vec2),
+		header.vertexCount * (unsigned long long)sizeof(glm::vec3),
+		header.vertexCount * (unsigned long long)sizeof(glm::vec3),
+		header.vertexCount * (unsigned long long)sizeof(glm::vec3),
+		header.indexCount  * (unsigned long long)header.indexSize
+	};
+	for ( int i=0; i<STREAM_COUNT; i++ ){
+		bool optional = (i == STREAM_TANGENTS || i == STREAM_BITANGENTS) && !header.hasTangents;
+		unsigned long long offset = header.streamOffset[i];
+		if ( optional )
+			continue;
+		if ( offset < sizeof(header) || offset % 16 != 0 || offset > size || sizes[i] > size - offset ){
+			printf("%s is corrupted\n", path);
+			closeMeshCache(view);
+			return false;
+		}
+	}
+
+	if ( header.lodCount > MESHCACHE_MAX_LODS ){
+		printf("%s is corrupted\n", path);
+		closeMeshCache(view);
+		return false;
+	}
+	for ( unsigned int i=0; i<header.lodCount; i++ ){
+		const LODRange & lod = header.lods[i];
+		if ( lod.firstIndex > header.indexCount || lod.indexCount > header.indexCount - lod.firstIndex ){
+			printf("%s is corrupted\n", path);
+			closeMeshCache(view);
+			return false;
+		}
+	}
+
+	// An index past the last vertex would make the draws read outside of the buffers
+	const void * indices = data + header.streamOffset[STREAM_INDICES];
+	bool inRange = header.indexSize == 4
+		? indicesInRange((const unsigned int *)indices, header.indexCount, header.vertexCount)
+		: indicesInRange((const unsigned short *)indices, header.indexCount, header.vertexCount);
+	if ( !inRange ){
+		printf("%s is corrupted\n", path);
+		closeMeshCache(view);
+		return false;
+	}
+
+	view.vertexCount = header.vertexCount;
+	view.indexCount  = header.indexCount;
+	view.indexSize   = header.indexSize;
+	view.vertices    = (const glm::vec3 *)(data + header.streamOffset[STREAM_VERTICES]);
+	view.uvs         = (const glm::vec2 *)(data + header.streamOffset[STREAM_UVS]);
+	view.normals     = (const glm::vec3 *)(data + header.streamOffset[STREAM_NORMALS]);
+	view.tangents    = header.hasTangents ? (const glm::vec3 *)(data + header.streamOffset[STREAM_TANGENTS])   : NULL;
+	view.bitangents  = header.hasTangents ? (const glm::vec3 *)(data + header.streamOffset[STREAM_BITANGENTS]) : NULL;
+	view.indices     = indices;
+	view.lodCount    = header.lodCount;
+	for ( unsigned int i=0; i<header.lodCount; i++ )
+		view.lods[i] = header.lods[i];
+	return true;
+}
+
+void closeMeshCache(MeshCacheView & view){
+	unmapFile(view.file);
+	view = MeshCacheView();
+}
+
+// isMeshCacheUpToDate. needsRefresh : the source had to be hashed, so saving
+// the cache again would make the next checks faster.
+static bool checkMeshCache(const char * path, const char * sourcePath, bool & needsRefresh){
+
+	needsRefresh = false;
+	unsigned long long sourceSize, cacheSize;
+	long long sourceTime, cacheTime;
+	if ( !getFileInfo(sourcePath, sourceSize, sourceTime) || !getFileInfo(path, cacheSize, cacheTime) )
+		return false;
+
+	// Read only : the cache may be in a directory we can't write to
+	FILE * file = fopen(path, "rb");
+	if ( file == NULL )
+		return false;
+	MeshCacheHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1
+		&& header.magic == MESHCACHE_MAGIC
+		&& header.version == MESHCACHE_VERSION
+		&& header.sourceSize == sourceSize;
+	fclose(file);
+
+	// The same date is enough only if the cache was written well after the
+	// source : otherwise the source may have been modified just after the
+	// cache was written, in the same tick of a coarse clock (1 or 2 seconds on
+	// some file systems), and still have the same date.
+	bool sameDate = header.sourceTime == sourceTime && cacheTime - sourceTime >= 2000000000LL;
+	if ( ok && !sameDate ){
+		// Touched, but maybe not modified
+		unsigned long long sourceHash;
+		ok = hashFile(sourcePath, sourceHash) && sourceHash == header.sourceHash;
+		needsRefresh = ok;
+	}
+	return ok;
+}
+
+bool isMeshCacheUpToDate(const char * path, const char * sourcePath){
+	bool needsRefresh;
+	return checkMeshCache(path, sourcePath, needsRefresh);
+}
+
+static void copyIndices(const MeshCacheView & view, IndexBuffer & out_indices){
+	out_indices.use32bits = view.indexSize == 4;
+	out_indices.indices16.clear();
+	out_indices.indices32.clear();
+	if ( out_indices.use32bits ){
+		const unsigned int * indices = (const unsigned int *)view.indices;
+		out_indices.indices32.assign(indices, indices + view.indexCount);
+	}else{
+		const unsigned short * indices = (const unsigned short *)view.indices;
+		out_indices.indices16.assign(indices, indices + view.indexCount);
+	}
+}
+
+// True if the cache has the LODs we want (or no LODs, if we want none)
+static bool sameLODs(const MeshCacheView & view, const std::vector<float> * lodRatios){
+	if ( lodRatios == NULL )
+		return view.lodCount == 0;
+	if ( view.lodCount != lodRatios->size() + 1 )
+		return false;
+	for ( size_t i=0; i<lodRatios->size(); i++ ){
+		if ( view.lods[i+1].ratio != (*lodRatios)[i] )
+			return false;
+	}
+	return true;
+}
+
+// One file per variant of the mesh : path.meshcache, path.tbn.meshcache, or
+// path.lods-<hash of the ratios>.meshcache. Loading the same .obj with other
+// options then doesn't overwrite the cache of the first one.
+static std::string getCachePath(const char * path, bool withTangents, const std::vector<float> * lodRatios){
+	std::string cachePath = path;
+	if ( withTangents )
+		cachePath += ".tbn";
+	if ( lodRatios ){
+		char name[32];
+		unsigned long long hash = hashBytes(lodRatios->empty() ? NULL : &(*lodRatios)[0], lodRatios->size() * sizeof(float));
+		sprintf(name, ".lods-%08x", (unsigned int)hash);
+		cachePath += name;
+	}
+	return cachePath + ".meshcache";
+}
+
+static bool loadIndexedOBJ_cached_impl(
+	const char * path,
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> * out_tangents,
+	std::vector<glm::vec3> * out_bitangents,
+	const std::vector<float> * lodRatios,
+	std::vector<LODRange> * out_lods
+){
+	bool withTangents = out_tangents != NULL;
+	std::string cachePath = getCachePath(path, withTangents, lodRatios);
+
+	// Fast path : one mmap and a memcpy per array
+	MeshCacheView view;
+	bool needsRefresh;
+	if ( checkMeshCache(cachePath.c_str(), path, needsRefresh) && openMeshCache(cachePath.c_str(), view) ){
+		if ( (view.tangents != NULL) == withTangents && sameLODs(view, lodRatios) ){
+			printf("Loading compiled mesh %s...\n", cachePath.c_str());
+			copyIndices(view, out_indices);
+			out_vertices.assign(view.vertices, view.vertices + view.vertexCount);
+			out_uvs     .assign(view.uvs,      view.uvs      + view.vertexCount);
+			out_normals .assign(view.normals,  view.normals  + view.vertexCount);
+			if ( withTangents ){
+				out_tangents  ->assign(view.tangents,   view.tangents   + view.vertexCount);
+				out_bitangents->assign(view.bitangents, view.bitangents + view.vertexCount);
+			}
+			if ( out_lods )
+				out_lods->assign(view.lods, view.lods + view.lodCount);
+			closeMeshCache(view);
+
+			// New dates, so that the next loads don't hash the source. Not
+			// being able to write is fine.
+			if ( needsRefresh )
+				saveMeshCache(cachePath.c_str(), path, out_indices, out_vertices, out_uvs, out_normals, out_tangents, out_bitangents, out_lods);
+			return true;
+		}
+		closeMeshCache(view);
+	}
+
+	// Slow path : parse the .obj, index it and optimize it, then save the result for next time
+	Mesh mesh;
+	if ( !loadOBJ(path, mesh) )
+		return false;
+	if ( withTangents )
+		computeTangentBasis(mesh);
+	indexVBO(mesh, withTangents); // indexVBO_TBN always welded near vertices
+	if ( lodRatios )
+		buildLODChain(mesh, *lodRatios);
+	optimizeMesh(mesh);
+
+	if ( lodRatios )
+		concatenateLODs(mesh, out_indices, *out_lods);
+	else
+		moveIndices(mesh, out_indices);
+	out_vertices.swap(mesh.vertices);
+	out_uvs     .swap(mesh.uvs);
+	out_normals .swap(mesh.normals);
+	if ( withTangents ){
+		out_tangents  ->swap(mesh.tangents);
+		out_bitangents->swap(mesh.bitangents);
+	}
+
+	// Not being able to write the cache isn't a reason to fail
+	saveMeshCache(cachePath.c_str(), path, out_indices, out_vertices, out_uvs, out_normals, out_tangents, out_bitangents, out_lods);
+	return true;
+}
+
+bool loadIndexedOBJ_cached(
+	const char * path,
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	return loadIndexedOBJ_cached_impl(path, out_indices, out_vertices, out_uvs, out_normals, NULL, NULL, NULL, NULL);
+}
+
+bool loadIndexedOBJ_TBN_cached(
+	const char * path,
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+){
+	return loadIndexedOBJ_cached_impl(path, out_indices, out_vertices, out_uvs, out_normals, &out_tangents, &out_bitangents, NULL, NULL);
+}
+
+bool loadIndexedOBJ_LOD_cached(
+	const char * path,
+	const std::vector<float> & lodRatios,
+	IndexBuffer & out_indices,
+	std::vector<LODRange> & out_lods,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	return loadIndexedOBJ_cached_impl(path, out_indices, out_vertices, out_uvs, out_normals, NULL, NULL, &lodRatios, &out_lods);
+}
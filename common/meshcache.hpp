@@ -0,0 +1,101 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include "mappedfile.hpp"
+#include "vboindexer.hpp"
+#include "simplify.hpp"
+
+// Compiled meshes : the output of indexVBO / indexVBO_TBN, saved as is.
+// Reading a model is then just a few memcpy's away : the file is mapped in
+// memory, and every attribute is a plain array in it.
+//
+// File layout (native endianness) :
+// - a header : magic, version, counts, the size/date/hash of the source file,
+//   and where each LOD is in the indices
+// - positions, UVs, normals, [tangents, bitangents], indices. Each array starts
+//   on a 16-byte boundary.
+
+#define MESHCACHE_MAX_LODS 8 // Including the full mesh
+
+// A compiled mesh, mapped in memory. The pointers point directly into the file.
+struct MeshCacheView{
+	MappedFile file;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize; // 2 (unsigned short) or 4 (unsigned int)
+	const glm::vec3 * vertices;
+	const glm::vec2 * uvs;
+	const glm::vec3 * normals;
+	const glm::vec3 * tangents;   // NULL if the mesh was saved without tangents
+	const glm::vec3 * bitangents; // NULL if the mesh was saved without tangents
+	const void * indices;
+	unsigned int lodCount; // 0 if the mesh was saved without LODs
+	LODRange lods[MESHCACHE_MAX_LODS];
+};
+
+// Writes a compiled mesh. sourcePath is the file the mesh comes from (usually
+// a .obj), used to know later if the cache is outdated. It can be NULL.
+// tangents and bitangents can be NULL.
+// lods can be NULL too. Otherwise, indices contains all of them (see concatenateLODs).
+bool saveMeshCache(
+	const char * path,
+	const char * sourcePath,
+	const IndexBuffer & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<glm::vec3> * tangents,
+	const std::vector<glm::vec3> * bitangents,
+	const std::vector<LODRange> * lods = NULL
+);
+
+// Maps a compiled mesh. Returns false if the file is missing, from another
+// version, or corrupted (including indices that are not valid vertices).
+bool openMeshCache(const char * path, MeshCacheView & view);
+void closeMeshCache(MeshCacheView & view);
+
+// True if the cache was built from the current version of sourcePath.
+// The size and date of the source are checked first. If only the date changed,
+// or if the cache was written less than 2 seconds after the source (dates
+// aren't precise enough to tell), the content of the source is hashed : if it
+// is the same, the cache is still valid. Only reads the cache : the
+// loadIndexedOBJ_*_cached functions save it again to update the dates.
+bool isMeshCacheUpToDate(const char * path, const char * sourcePath);
+
+// loadOBJ + indexVBO + optimizeMesh, through a cache : path.meshcache is rebuilt only when
+// the .obj changes. The other variants below have their own file next to it.
+bool loadIndexedOBJ_cached(
+	const char * path,
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+// loadOBJ + computeTangentBasis + indexVBO_TBN + optimizeMesh, through a cache :
+// path.tbn.meshcache.
+bool loadIndexedOBJ_TBN_cached(
+	const char * path,
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+);
+
+// loadOBJ + indexVBO + buildLODChain + optimizeMesh, through a cache.
+// out_indices contains the full mesh and all its LODs : out_lods[0] is the
+// full mesh, out_lods[i] is simplified to lodRatios[i-1] of its triangles.
+// The cache is path.lods-<hash of lodRatios>.meshcache : other ratios get their own file.
+bool loadIndexedOBJ_LOD_cached(
+	const char * path,
+	const std::vector<float> & lodRatios,
+	IndexBuffer & out_indices,
+	std::vector<LODRange> & out_lods,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+#endif
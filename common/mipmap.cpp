@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "sse2.hpp"
+
+#include "threadpool.hpp"
+#include "image.hpp"
+#include "mipmap.hpp"
+
+// A mip while it's being filtered : 4 floats per pixel (B, G, R, A), linear, bottom row first
+struct FloatImage{
+	unsigned int width;
+	unsigned int height;
+	std::vector<float> pixels;
+};
+
+// For each output pixel of a row (or column), which input pixels it uses, and how much
+struct FilterTaps{
+	unsigned int tapCount; // Per output pixel. Unused taps have a weight of 0.
+	std::vector<unsigned int> indices; // tapCount per output pixel
+	std::vector<float> weights;        // tapCount per output pixel, normalized
+};
+
+#define ROWS_PER_JOB 16
+
+// The filters, and how far they go (in output pixels) :
+
+static float boxFilter(float t){
+	return fabsf(t) <= 0.5f ? 1.0f : 0.0f;
+}
+
+static float triangleFilter(float t){
+	return std::max(0.0f, 1.0f - fabsf(t));
+}
+
+// Modified Bessel function of the first kind, order 0
+static float besselI0(float x){
+	float sum = 1.0f;
+	float term = 1.0f;
+	for ( int k=1; k<20; k++ ){
+		term *= (x*0.5f/k) * (x*0.5f/k);
+		sum += term;
+	}
+	return sum;
+}
+
+#define KAISER_WIDTH 3.0f
+#define KAISER_ALPHA 4.0f
+
+static float kaiserFilter(float t){
+	if ( fabsf(t) >= KAISER_WIDTH )
+		return 0.0f;
+	float sinc = t == 0.0f ? 1.0f : sinf(3.14159265f*t) / (3.14159265f*t);
+	float r = t / KAISER_WIDTH;
+	return sinc * besselI0(KAISER_ALPHA * sqrtf(1.0f - r*r)) / besselI0(KAISER_ALPHA);
+}
+
+// Resampling of inputSize pixels to outputSize pixels (outputSize <= inputSize, any ratio)
+static void computeTaps(unsigned int inputSize, unsigned int outputSize, MipmapFilter filter, bool wrap, FilterTaps & taps){
+
+	float (*function)(float);
+	float support;
+	switch(filter){
+	case MIPMAP_BOX:      function = boxFilter;      support = 0.5f; break;
+	case MIPMAP_TRIANGLE: function = triangleFilter; support = 1.0f; break;
+	default:              function = kaiserFilter;   support = KAISER_WIDTH; break;
+	}
+
+	float scale = (float)inputSize / outputSize; // Input pixels per output pixel
+	float radius = support * scale;
+	taps.tapCount = (unsigned int)ceilf(2.0f * radius) + 1;
+	taps.indices.assign(outputSize * taps.tapCount, 0);
+	taps.weights.assign(outputSize * taps.tapCount, 0.0f);
+
+	for ( unsigned int i=0; i<outputSize; i++ ){
+		float center = (i + 0.5f) * scale; // In input pixels
+		int first = (int)ceilf(center - radius - 0.5f);
+
+		float sum = 0.0f;
+		for ( unsigned int k=0; k<taps.tapCount; k++ ){
+			int j = first + (int)k;
+			float w = function((j + 0.5f - center) / scale);
+
+			// Outside of the image : wrap around, or repeat the edge
+			if ( wrap )
+				j = ((j % (int)inputSize) + (int)inputSize) % (int)inputSize;
+			else
+				j = std::min(std::max(j, 0), (int)inputSize - 1);
+
+			taps.indices[i*taps.tapCount + k] = (unsigned int)j;
+			taps.weights[i*taps.tapCount + k] = w;
+			sum += w;
+		}
+		for ( unsigned int k=0; k<taps.tapCount; k++ )
+			taps.weights[i*taps.tapCount + k] /= sum;
+	}
+}
+
+// Calls function(0) ... function(count-1), on the pool if there is one
+static void forEach(ThreadPool * pool, size_t count, const std::function<void(size_t)> & function){
+	if ( pool )
+		pool->parallelFor(count, function);
+	else
+		for ( size_t i=0; i<count; i++ )
+			function(i);
+}
+
+// One output pixel (4 floats) = sum of weights[k] * input pixel indices[k]
+static inline void filterPixel(const float * input, const unsigned int * indices, const float * weights, unsigned int tapCount, float * output){
+#ifdef COMMON_SSE2
+	__m128 sum = _mm_setzero_ps();
+	for ( unsigned int k=0; k<tapCount; k++ )
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(input + 4*indices[k])));
+	_mm_storeu_ps(output, sum);
+#else
+	float sum[4] = {0, 0, 0, 0};
+	for ( unsigned int k=0; k<tapCount; k++ )
+		for ( int c=0; c<4; c++ )
+			sum[c] += weights[k] * input[4*indices[k] + c];
+	memcpy(output, sum, sizeof(sum));
+#endif
+}
+
+// output += weight * input, for count floats
+static inline void addScaledRow(const float * input, float weight, unsigned int count, float * output){
+	unsigned int i = 0;
+#ifdef COMMON_SSE2
+	__m128 w = _mm_set1_ps(weight);
+	for ( ; i+4<=count; i+=4 )
+		_mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(output + i), _mm_mul_ps(w, _mm_loadu_ps(input + i))));
+#endif
+	for ( ; i<count; i++ )
+		output[i] += weight * input[i];
+}
+
+// Separable filter : rows first, then columns
+static void downsample(const FloatImage & input, FloatImage & output, const MipmapOptions & options){
+
+	output.width  = std::max(1u, input.width / 2);
+	output.height = std::max(1u, input.height / 2);
+	output.pixels.assign((size_t)output.width * output.height * 4, 0.0f);
+
+	FilterTaps horizontal, vertical;
+	computeTaps(input.width,  output.width,  options.filter, options.wrap, horizontal);
+	computeTaps(input.height, output.height, options.filter, options.wrap, vertical);
+
+	// Rows : input.width x input.height -> output.width x input.height
+	std::vector<float> rows((size_t)output.width * input.height * 4);
+	forEach(options.pool, (input.height + ROWS_PER_JOB-1) / ROWS_PER_JOB, [&](size_t job){
+		unsigned int end = std::min(input.height, (unsigned int)(job+1)*ROWS_PER_JOB);
+		for ( unsigned int y=(unsigned int)job*ROWS_PER_JOB; y<end; y++ ){
+			const float * in = &input.pixels[(size_t)y * input.width * 4];
+			float * out = &rows[(size_t)y * output.width * 4];
+			for ( unsigned int x=0; x<output.width; x++ )
+				filterPixel(in, &horizontal.indices[x*horizontal.tapCount], &horizontal.weights[x*horizontal.tapCount], horizontal.tapCount, out + 4*x);
+		}
+	});
+
+	// Columns : output.width x input.height -> output.width x output.height.
+	// A whole row of output pixels at a time.
+	forEach(options.pool, (output.height + ROWS_PER_JOB-1) / ROWS_PER_JOB, [&](size_t job){
+		unsigned int end = std::min(output.height, (unsigned int)(job+1)*ROWS_PER_JOB);
+		for ( unsigned int y=(unsigned int)job*ROWS_PER_JOB; y<end; y++ ){
+			float * out = &output.pixels[(size_t)y * output.width * 4];
+			for ( unsigned int k=0; k<vertical.tapCount; k++ ){
+				float w = vertical.weights[y*vertical.tapCount + k];
+				if ( w != 0.0f )
+					addScaledRow(&rows[(size_t)vertical.indices[y*vertical.tapCount + k] * output.width * 4], w, output.width * 4, out);
+			}
+		}
+	});
+}
+
+// sRGB <-> linear, as in the sRGB standard
+
+static float srgbToLinear(float c){
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float c){
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f/2.4f) - 0.055f;
+}
+
+#define LINEAR_TABLE_SIZE 16384 // Enough for an error below 0.25 in the darkest colors
+
+struct SrgbTables{
+	float toLinear[256];
+	unsigned char fromLinear[LINEAR_TABLE_SIZE];
+
+	SrgbTables(){
+		for ( int i=0; i<256; i++ )
+			toLinear[i] = srgbToLinear(i / 255.0f);
+		for ( int i=0; i<LINEAR_TABLE_SIZE; i++ )
+			fromLinear[i] = (unsigned char)(linearToSrgb(i / (float)(LINEAR_TABLE_SIZE-1)) * 255.0f + 0.5f);
+	}
+};
+
+static const SrgbTables & srgbTables(){
+	static SrgbTables tables;
+	return tables;
+}
+
+static inline unsigned char toByte(float c){
+	return (unsigned char)(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static inline unsigned char linearToSrgbByte(const SrgbTables & tables, float c){
+	return tables.fromLinear[(int)(std::min(std::max(c, 0.0f), 1.0f) * (LINEAR_TABLE_SIZE-1) + 0.5f)];
+}
+
+// Size of a row in bytes (BGR rows are padded to 4 bytes)
+static size_t rowPitch(ImageFormat format, unsigned int width){
+	return imageMipSize(format, width, 1);
+}
+
+static void toFloat(const unsigned char * data, ImageFormat format, unsigned int width, unsigned int height, bool srgb, FloatImage & image, ThreadPool * pool){
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height * 4);
+
+	unsigned int channels = format == IMAGE_BGRA8 ? 4 : 3;
+	size_t pitch = rowPitch(format, width);
+	const SrgbTables & tables = srgbTables();
+
+	forEach(pool, (height + ROWS_PER_JOB-1) / ROWS_PER_JOB, [&](size_t job){
+		unsigned int end = std::min(height, (unsigned int)(job+1)*ROWS_PER_JOB);
+		for ( unsigned int y=(unsigned int)job*ROWS_PER_JOB; y<end; y++ ){
+			const unsigned char * in = data + y * pitch;
+			float * out = &image.pixels[(size_t)y * width * 4];
+			for ( unsigned int x=0; x<width; x++ ){
+				for ( int c=0; c<3; c++ )
+					out[4*x + c] = srgb ? tables.toLinear[in[channels*x + c]] : in[channels*x + c] / 255.0f;
+				out[4*x + 3] = channels == 4 ? in[4*x + 3] / 255.0f : 1.0f; // Alpha is always linear
+			}
+		}
+	});
+}
+
+static void fromFloat(const FloatImage & image, bool srgb, float alphaScale, ImageFormat format, unsigned char * data, ThreadPool * pool){
+	unsigned int channels = format == IMAGE_BGRA8 ? 4 : 3;
+	size_t pitch = rowPitch(format, image.width);
+	const SrgbTables & tables = srgbTables();
+
+	forEach(pool, (image.height + ROWS_PER_JOB-1) / ROWS_PER_JOB, [&](size_t job){
+		unsigned int end = std::min(image.height, (unsigned int)(job+1)*ROWS_PER_JOB);
+		for ( unsigned int y=(unsigned int)job*ROWS_PER_JOB; y<end; y++ ){
+			const float * in = &image.pixels[(size_t)y * image.width * 4];
+			unsigned char * out = data + y * pitch;
+			memset(out, 0, pitch); // The padding too
+			for ( unsigned int x=0; x<image.width; x++ ){
+				for ( int c=0; c<3; c++ )
+					out[channels*x + c] = srgb ? linearToSrgbByte(tables, in[4*x + c]) : toByte(in[4*x + c]);
+				if ( channels == 4 )
+					out[4*x + 3] = toByte(in[4*x + 3] * alphaScale);
+			}
+		}
+	});
+}
+
+// Fraction of the pixels that pass the alpha test
+static float alphaCoverage(const FloatImage & image, float cutoff, float alphaScale){
+	size_t count = (size_t)image.width * image.height;
+	size_t passed = 0;
+	for ( size_t i=0; i<count; i++ )
+		if ( image.pixels[4*i + 3] * alphaScale > cutoff )
+			passed++;
+	return (float)passed / count;
+}
+
+// The scale of the alpha of a mip, so that its coverage is the one of the
+// full image. Coverage grows with the scale, so a binary search finds it.
+static float alphaScaleForCoverage(const FloatImage & image, float cutoff, float coverage){
+	float low = 0.0f, high = 4.0f;
+	for ( int i=0; i<12; i++ ){
+		float middle = (low + high) * 0.5f;
+		if ( alphaCoverage(image, cutoff, middle) < coverage )
+			low = middle;
+		else
+			high = middle;
+	}
+	// Coverage isn't continuous : keep the closest of the two
+	float lowError  = fabsf(alphaCoverage(image, cutoff, low)  - coverage);
+	float highError = fabsf(alphaCoverage(image, cutoff, high) - coverage);
+	return lowError < highError ? low : high;
+}
+
+bool generateMipmaps(Image & image, const MipmapOptions & options){
+
+	if ( image.isCompressed() || image.faceCount != 1 || image.layerCount != 1 || image.mips.empty() ){
+		printf("generateMipmaps : only for uncompressed 2D images\n");
+		return false;
+	}
+
+	Image result;
+	result.format = image.format;
+	result.srgb = image.srgb;
+	result.width = image.width;
+	result.height = image.height;
+
+	// Where each mip goes
+	unsigned int width = image.width, height = image.height;
+	size_t offset = 0;
+	for(;;){
+		ImageMip mip;
+		mip.width = width;
+		mip.height = height;
+		mip.offset = offset;
+		mip.size = imageMipSize(image.format, width, height);
+		result.mips.push_back(mip);
+		offset += mip.size;
+		if ( width == 1 && height == 1 )
+			break;
+		width  = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+	result.faceSize = offset;
+	result.storage.resize(offset);
+	result.pixels = &result.storage[0];
+
+	// The first mip is copied as is
+	memcpy(&result.storage[0], image.mipData(0), result.mips[0].size);
+
+	FloatImage previous, current;
+	toFloat(image.mipData(0), image.format, image.width, image.height, options.srgb, previous, options.pool);
+
+	bool keepCoverage = options.alphaCutoff > 0.0f && image.format == IMAGE_BGRA8;
+	float coverage = keepCoverage ? alphaCoverage(previous, options.alphaCutoff, 1.0f) : 0.0f;
+
+	for ( size_t level=1; level<result.mips.size(); level++ ){
+		// From the previous mip, not alpha-scaled : the scales don't add up
+		downsample(previous, current, options);
+
+		float alphaScale = keepCoverage ? alphaScaleForCoverage(current, options.alphaCutoff, coverage) : 1.0f;
+		fromFloat(current, options.srgb, alphaScale, image.format, &result.storage[result.mips[level].offset], options.pool);
+
+		previous.pixels.swap(current.pixels);
+		previous.width = current.width;
+		previous.height = current.height;
+	}
+
+	image = std::move(result);
+	return true;
+}
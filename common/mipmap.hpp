@@ -0,0 +1,42 @@
+#ifndef MIPMAP_HPP
+#define MIPMAP_HPP
+
+// Mipmaps made on the CPU, for uncompressed images (.BMP), to bake them
+// offline or when glGenerateMipmap isn't good enough.
+//
+// glGenerateMipmap usually averages 2x2 pixels, in sRGB space : the small
+// mips get too dark and too blurry, and alpha-tested textures (foliage,
+// fences) slowly disappear in the distance. Here :
+// - colors are filtered in linear space, then converted back to sRGB
+// - the filter can be a box (like glGenerateMipmap), a triangle (tent), or a
+//   Kaiser-windowed sinc, which keeps the small mips sharp
+// - any size works : an odd size is not a problem (Non-Power-Of-Two textures)
+// - the alpha of each mip can be scaled so that as many pixels pass the alpha
+//   test as in the full image
+// - each mip is computed from the previous one, with several threads.
+
+struct Image;
+class ThreadPool;
+
+enum MipmapFilter{
+	MIPMAP_BOX,      // Average of 2x2 pixels. Fast, but blurry and a bit aliased.
+	MIPMAP_TRIANGLE, // 4x4 pixels, smoother
+	MIPMAP_KAISER    // 12x12 pixels, sharp and without aliasing. The best for most textures.
+};
+
+struct MipmapOptions{
+	MipmapFilter filter;
+	bool srgb;         // The colors are in sRGB space, so they are filtered in linear space. False for normal maps, etc.
+	bool wrap;         // The texture repeats (GL_REPEAT) : the filter wraps around the edges instead of clamping.
+	float alphaCutoff; // The alpha test of the shader (for instance 0.5), to keep the same coverage in all mips. 0 : don't.
+	ThreadPool * pool; // NULL : everything on this thread
+
+	MipmapOptions() : filter(MIPMAP_KAISER), srgb(true), wrap(true), alphaCutoff(0.0f), pool(NULL) {}
+};
+
+// Replaces the mips of an uncompressed image (IMAGE_BGR8 or IMAGE_BGRA8) by a
+// full chain, from the first mip down to 1x1. The first mip is unchanged.
+// Returns false if the image is compressed, a cubemap or an array.
+bool generateMipmaps(Image & image, const MipmapOptions & options = MipmapOptions());
+
+#endif
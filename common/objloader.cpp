@@ -1,114 +1,629 @@
 #include <vector>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include <thread>
+
+#include "sse2.hpp"
+#ifdef __AVX2__
+	#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
 
 #include <glm/glm.hpp>
 
+#include "mappedfile.hpp"
 #include "objloader.hpp"
+#include "mesh.hpp"
 
 // Very, VERY simple OBJ loader.
 // Here is a short list of features a real function would provide : 
 // - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime. In short : OBJ is not very great.
 // - Animations & bones (includes bones weights)
 // - Multiple UVs
-// - All attributes should be optional, not "forced"
 // - More stable. Change a line in the OBJ file and it crashes.
 // - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
+//
+// It is still simple, but not slow anymore : the file is memory-mapped and
+// parsed in place (no fscanf, no copy of the text), and a first pass counts
+// the lines of each kind so that all arrays are allocated once, at their final size.
+// It is not that limited either : faces can be v, v/vt, v//vn or v/vt/vn,
+// with negative indices, and have any number of vertices. Missing UVs are
+// (0,0), missing normals are replaced by the normal of the triangle.
 
-bool loadOBJ(
+static inline unsigned int countTrailingZeros(unsigned int mask){
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// Returns a pointer to the next '\n' in [p, end), or end if there is none.
+// Lines are scanned 32 (AVX2) or 16 (SSE2) bytes at a time.
+static const char * findEndOfLine(const char * p, const char * end){
+#ifdef __AVX2__
+	const __m256i newline32 = _mm256_set1_epi8('\n');
+	while ( end - p >= 32 ){
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline32));
+		if ( mask )
+			return p + countTrailingZeros(mask);
+		p += 32;
+	}
+#endif
+#ifdef COMMON_SSE2
+	const __m128i newline = _mm_set1_epi8('\n');
+	while ( end - p >= 16 ){
+		__m128i chunk = _mm_loadu_si128((const __m128i *)p);
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+		if ( mask )
+			return p + countTrailingZeros(mask);
+		p += 16;
+	}
+#endif
+	while ( p < end && *p != '\n' )
+		p++;
+	return p;
+}
+
+static inline bool isBlank(char c){
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char * skipBlanks(const char * p, const char * end){
+	while ( p < end && isBlank(*p) )
+		p++;
+	return p;
+}
+
+static inline bool isDigit(char c){
+	return (unsigned char)(c - '0') < 10;
+}
+
+// Parses a float, with the same result as strtof.
+// [+-]digits[.digits][(e|E)[+-]digits] is handled here : the mantissa is read
+// in an integer, and when it fits in a float (24 bits) and the power of 10 does
+// too (at most 10), the result is one float multiplication or division of exact
+// values, so it is rounded once, like strtof does. That covers the usual
+// "-0.123456" of OBJ files.
+// Anything else (long mantissas, big exponents, inf, nan...) goes through strtof.
+// Returns the end of the number, or NULL if there is no number.
+static const char * parseFloat(const char * p, const char * end, float & result){
+	static const float powersOf10[] = {
+		1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+	};
+
+	const char * start = p;
+	bool negative = false;
+	if ( p < end && (*p == '-' || *p == '+') ){
+		negative = (*p == '-');
+		p++;
+	}
+
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool fastPath = true;
+
+	while ( p < end && isDigit(*p) ){
+		if ( digits < 19 ) mantissa = mantissa*10 + (*p - '0');
+		else               fastPath = false;
+		if ( mantissa != 0 ) digits++; // Leading zeros don't count
+		p++;
+	}
+	bool hasDigits = p != start && isDigit(p[-1]);
+	if ( p < end && *p == '.' ){
+		p++;
+		while ( p < end && isDigit(*p) ){
+			if ( digits < 19 ){ mantissa = mantissa*10 + (*p - '0'); exponent--; }
+			else                fastPath = false;
+			if ( mantissa != 0 ) digits++;
+			hasDigits = true;
+			p++;
+		}
+	}
+	if ( !hasDigits )
+		fastPath = false;
+	if ( fastPath && p < end && (*p == 'e' || *p == 'E') ){
+		const char * q = p + 1;
+		bool negativeExponent = false;
+		if ( q < end && (*q == '-' || *q == '+') ){
+			negativeExponent = (*q == '-');
+			q++;
+		}
+		if ( q < end && isDigit(*q) ){
+			int e = 0;
+			while ( q < end && isDigit(*q) ){
+				if ( e < 10000 ) e = e*10 + (*q - '0');
+				q++;
+			}
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+
+	if ( fastPath && mantissa <= (1ULL << 24) && exponent >= -10 && exponent <= 10 ){
+		float value = (float)mantissa;
+		value = exponent < 0 ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+		result = negative ? -value : value;
+		return p;
+	}
+
+	// Slow path. The mapped file isn't 0-terminated : copy the token first.
+	char buffer[64];
+	const char * tokenEnd = start;
+	while ( tokenEnd < end && !isBlank(*tokenEnd) && *tokenEnd != '\n' && *tokenEnd != '/' )
+		tokenEnd++;
+	size_t length = tokenEnd - start;
+	if ( length == 0 || length >= sizeof(buffer) )
+		return NULL;
+	memcpy(buffer, start, length);
+	buffer[length] = 0;
+	char * parsedEnd;
+	result = strtof(buffer, &parsedEnd);
+	if ( parsedEnd == buffer )
+		return NULL;
+	return start + (parsedEnd - buffer);
+}
+
+// Parses an OBJ index : a non-zero integer, negative if relative to the end of the list.
+// Returns the end of the number, or NULL if there is none.
+static const char * parseIndex(const char * p, const char * end, long long & result){
+	bool negative = false;
+	if ( p < end && *p == '-' ){
+		negative = true;
+		p++;
+	}
+	if ( p >= end || !isDigit(*p) )
+		return NULL;
+	long long value = 0;
+	while ( p < end && isDigit(*p) ){
+		if ( value < 0x100000000LL ) value = value*10 + (*p - '0');
+		p++;
+	}
+	result = negative ? -value : value;
+	return p;
+}
+
+enum OBJLineType{ OBJ_OTHER, OBJ_VERTEX, OBJ_UV, OBJ_NORMAL, OBJ_FACE, OBJ_OBJECT, OBJ_GROUP, OBJ_MATERIAL };
+
+static inline bool isKeyword(const char * p, const char * end, const char * keyword, size_t length){
+	return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 && isBlank(p[length]);
+}
+
+// Looks at the first word of the line, and returns a pointer after it.
+static OBJLineType getLineType(const char * & p, const char * end){
+	p = skipBlanks(p, end);
+	if ( isKeyword(p, end, "v", 1) )      { p += 2; return OBJ_VERTEX;   }
+	if ( isKeyword(p, end, "vt", 2) )     { p += 3; return OBJ_UV;       }
+	if ( isKeyword(p, end, "vn", 2) )     { p += 3; return OBJ_NORMAL;   }
+	if ( isKeyword(p, end, "f", 1) )      { p += 2; return OBJ_FACE;     }
+	if ( isKeyword(p, end, "o", 1) )      { p += 2; return OBJ_OBJECT;   }
+	if ( isKeyword(p, end, "g", 1) )      { p += 2; return OBJ_GROUP;    }
+	if ( isKeyword(p, end, "usemtl", 6) ) { p += 7; return OBJ_MATERIAL; }
+	return OBJ_OTHER; // Probably a comment, or something we don't use (s, mtllib, l...)
+}
+
+// Number of elements of each kind
+struct OBJCounts{
+	unsigned int vertices, uvs, normals, triangles;
+	OBJCounts() : vertices(0), uvs(0), normals(0), triangles(0) {}
+};
+
+// "No such attribute" in a face, as in "f 1//1 2//2 3//3"
+static const unsigned int OBJ_MISSING = 0xFFFFFFFF;
+
+// An "o", "g" or "usemtl" line, seen just before triangle number "triangle"
+struct OBJGroupEvent{
+	unsigned int triangle;
+	OBJLineType type;
+	std::string name;
+};
+
+// Where parseOBJ writes. Arrays must be big enough for the counts.
+struct OBJArrays{
+	glm::vec3 * vertices;
+	glm::vec2 * uvs;
+	glm::vec3 * normals;
+	unsigned int * faces; // v/vt/vn, 3 times per triangle. 0-based, or OBJ_MISSING.
+	std::vector<OBJGroupEvent> * groupEvents;
+};
+
+// Number of blank-separated words in [p, end)
+static unsigned int countWords(const char * p, const char * end){
+	unsigned int words = 0;
+	while ( true ){
+		p = skipBlanks(p, end);
+		if ( p == end )
+			return words;
+		words++;
+		while ( p < end && !isBlank(*p) )
+			p++;
+	}
+}
+
+// First pass : only looks at the beginning of each line (and counts the corners of the faces)
+static void countOBJ(const char * p, const char * end, OBJCounts & counts){
+	while ( p < end ){
+		const char * lineEnd = findEndOfLine(p, end);
+		switch ( getLineType(p, lineEnd) ){
+			case OBJ_VERTEX : counts.vertices++; break;
+			case OBJ_UV     : counts.uvs++;      break;
+			case OBJ_NORMAL : counts.normals++;  break;
+			case OBJ_FACE   : {
+				// A polygon with n corners becomes n-2 triangles
+				unsigned int corners = countWords(p, lineEnd);
+				if ( corners >= 3 )
+					counts.triangles += corners - 2;
+				break;
+			}
+			default : break;
+		}
+		p = lineEnd + 1;
+	}
+}
+
+// Parses n blank-separated floats. Returns the end of the last one, or NULL.
+static const char * parseFloats(const char * p, const char * end, float * values, int n){
+	for ( int i=0; i<n; i++ ){
+		p = skipBlanks(p, end);
+		p = parseFloat(p, end, values[i]);
+		if ( p == NULL )
+			return NULL;
+	}
+	return p;
+}
+
+// Turns a 1-based or negative index into a 0-based one.
+// seen is the number of elements defined so far in the file.
+static inline bool resolveIndex(long long index, unsigned int seen, unsigned int & result){
+	if ( index > 0 )
+		result = (unsigned int)(index - 1);
+	else if ( index < 0 && -index <= (long long)seen )
+		result = (unsigned int)(seen + index);
+	else
+		return false;
+	return true;
+}
+
+// Parses one corner of a face : v, v/vt, v//vn or v/vt/vn
+static const char * parseCorner(const char * p, const char * end, const OBJCounts & seen, unsigned int corner[3]){
+	long long index;
+	corner[1] = OBJ_MISSING;
+	corner[2] = OBJ_MISSING;
+
+	p = parseIndex(p, end, index);
+	if ( p == NULL || !resolveIndex(index, seen.vertices, corner[0]) )
+		return NULL;
+	if ( p < end && *p == '/' ){
+		p++;
+		if ( p < end && *p != '/' ){
+			p = parseIndex(p, end, index);
+			if ( p == NULL || !resolveIndex(index, seen.uvs, corner[1]) )
+				return NULL;
+		}
+		if ( p < end && *p == '/' ){
+			p = parseIndex(p+1, end, index);
+			if ( p == NULL || !resolveIndex(index, seen.normals, corner[2]) )
+				return NULL;
+		}
+	}
+	if ( p < end && !isBlank(*p) )
+		return NULL;
+	return p;
+}
+
+// Second pass : fills arrays.
+// seen is the number of elements defined in the file before p,
+// and is needed to resolve negative indices.
+static bool parseOBJ(const char * p, const char * end, OBJArrays arrays, OBJCounts seen){
+	unsigned int triangles = 0;
+	while ( p < end ){
+		const char * lineEnd = findEndOfLine(p, end);
+		OBJLineType type = getLineType(p, lineEnd);
+
+		if ( type == OBJ_VERTEX ){
+			float values[3];
+			if ( !parseFloats(p, lineEnd, values, 3) ){
+				printf("Invalid vertex in OBJ file\n");
+				return false;
+			}
+			*arrays.vertices++ = glm::vec3(values[0], values[1], values[2]);
+			seen.vertices++;
+		}else if ( type == OBJ_UV ){
+			float values[2];
+			if ( !parseFloats(p, lineEnd, values, 2) ){
+				printf("Invalid texture coordinate in OBJ file\n");
+				return false;
+			}
+			// Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+			*arrays.uvs++ = glm::vec2(values[0], -values[1]);
+			seen.uvs++;
+		}else if ( type == OBJ_NORMAL ){
+			float values[3];
+			if ( !parseFloats(p, lineEnd, values, 3) ){
+				printf("Invalid normal in OBJ file\n");
+				return false;
+			}
+			*arrays.normals++ = glm::vec3(values[0], values[1], values[2]);
+			seen.normals++;
+		}else if ( type == OBJ_FACE ){
+			// Triangles, quads and n-gons are triangulated as a fan around the first corner.
+			// This is fine for convex polygons, which is what exporters give in practice.
+			unsigned int first[3], previous[3], current[3];
+			int corners = 0;
+			while ( true ){
+				p = skipBlanks(p, lineEnd);
+				if ( p == lineEnd )
+					break;
+				p = parseCorner(p, lineEnd, seen, current);
+				if ( p == NULL ){
+					printf("Invalid face in OBJ file\n");
+					return false;
+				}
+				if ( corners == 0 ){
+					memcpy(first, current, sizeof(first));
+				}else if ( corners >= 2 ){
+					memcpy(arrays.faces + 0, first,    sizeof(first));
+					memcpy(arrays.faces + 3, previous, sizeof(previous));
+					memcpy(arrays.faces + 6, current,  sizeof(current));
+					arrays.faces += 9;
+					triangles++;
+				}
+				memcpy(previous, current, sizeof(previous));
+				corners++;
+			}
+			if ( corners < 3 ){
+				printf("Face with less than 3 vertices in OBJ file\n");
+				return false;
+			}
+		}else if ( type == OBJ_OBJECT || type == OBJ_GROUP || type == OBJ_MATERIAL ){
+			// The name is the rest of the line
+			p = skipBlanks(p, lineEnd);
+			const char * nameEnd = lineEnd;
+			while ( nameEnd > p && isBlank(nameEnd[-1]) )
+				nameEnd--;
+			OBJGroupEvent event;
+			event.triangle = triangles;
+			event.type = type;
+			event.name.assign(p, nameEnd);
+			arrays.groupEvents->push_back(event);
+		}
+		p = lineEnd + 1;
+	}
+	return true;
+}
+
+// Runs function(0) ... function(count-1), each on its own thread
+template <typename Function>
+static void runInParallel(unsigned int count, Function function){
+	std::vector<std::thread> threads;
+	for ( unsigned int i=1; i<count; i++ )
+		threads.push_back( std::thread(function, i) );
+	function(0); // The current thread works too
+	for ( size_t i=0; i<threads.size(); i++ )
+		threads[i].join();
+}
+
+// Used by all versions of loadOBJ, so that they always give the same result.
+// The file is split in chunks at line boundaries. Each chunk is counted, then
+// parsed, by its own thread. Since the arrays are allocated after the counting
+// pass, each chunk knows exactly where to write : at the sum of the counts of
+// the previous chunks. This sum is also what negative indices are relative to.
+static bool loadOBJ_impl(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
 	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
+	std::vector<glm::vec3> & out_normals,
+	std::vector<OBJGroup> * out_groups,
+	unsigned int threadCount
 ){
 	printf("Loading OBJ file %s...\n", path);
 
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices; 
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
-
-
-	FILE * file = fopen(path, "r");
-	if( file == NULL ){
+	MappedFile file;
+	if( !mapFile(path, file) ){
 		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
 		getchar();
 		return false;
 	}
+	const char * begin = (const char *)file.data;
+	const char * end   = begin + file.size;
 
-	while( 1 ){
-
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
-
-		// else : parse lineHeader
-		
-		if ( strcmp( lineHeader, "v" ) == 0 ){
-			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-			temp_vertices.push_back(vertex);
-		}else if ( strcmp( lineHeader, "vt" ) == 0 ){
-			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y );
-			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-			temp_uvs.push_back(uv);
-		}else if ( strcmp( lineHeader, "vn" ) == 0 ){
-			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-			temp_normals.push_back(normal);
-		}else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-			if (matches != 9){
-				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				return false;
+	// Don't bother with threads for small files
+	const size_t minChunkSize = 1 << 20;
+	if ( threadCount == 0 )
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	if ( threadCount > file.size / minChunkSize )
+		threadCount = std::max((size_t)1, file.size / minChunkSize);
+
+	// Split the file : each chunk ends just after a '\n'
+	std::vector<const char *> chunkStart(threadCount + 1);
+	chunkStart[0] = begin;
+	for ( unsigned int i=1; i<threadCount; i++ ){
+		const char * p = std::max(chunkStart[i-1], begin + file.size / threadCount * i);
+		p = findEndOfLine(p, end);
+		chunkStart[i] = p < end ? p + 1 : end;
+	}
+	chunkStart[threadCount] = end;
+
+	// First pass : count everything, so that we never need to push_back()
+	std::vector<OBJCounts> chunkCounts(threadCount);
+	runInParallel(threadCount, [&](unsigned int i){
+		countOBJ(chunkStart[i], chunkStart[i+1], chunkCounts[i]);
+	});
+
+	// Where each chunk starts writing
+	std::vector<OBJCounts> chunkOffsets(threadCount);
+	OBJCounts counts;
+	for ( unsigned int i=0; i<threadCount; i++ ){
+		chunkOffsets[i] = counts;
+		counts.vertices  += chunkCounts[i].vertices;
+		counts.uvs       += chunkCounts[i].uvs;
+		counts.normals   += chunkCounts[i].normals;
+		counts.triangles += chunkCounts[i].triangles;
+	}
+
+	std::vector<glm::vec3> temp_vertices(counts.vertices);
+	std::vector<glm::vec2> temp_uvs(counts.uvs);
+	std::vector<glm::vec3> temp_normals(counts.normals);
+	std::vector<unsigned int> faceIndices(9 * (size_t)counts.triangles);
+	std::vector< std::vector<OBJGroupEvent> > chunkGroupEvents(threadCount);
+
+	// Second pass : parse
+	std::vector<char> chunkOk(threadCount);
+	runInParallel(threadCount, [&](unsigned int i){
+		OBJArrays arrays;
+		arrays.vertices    = temp_vertices.data() + chunkOffsets[i].vertices;
+		arrays.uvs         = temp_uvs     .data() + chunkOffsets[i].uvs;
+		arrays.normals     = temp_normals .data() + chunkOffsets[i].normals;
+		arrays.faces       = faceIndices  .data() + 9 * (size_t)chunkOffsets[i].triangles;
+		arrays.groupEvents = &chunkGroupEvents[i];
+		chunkOk[i] = parseOBJ(chunkStart[i], chunkStart[i+1], arrays, chunkOffsets[i]);
+	});
+	unmapFile(file);
+	for ( unsigned int i=0; i<threadCount; i++ ){
+		if ( !chunkOk[i] )
+			return false;
+	}
+
+	// For each triangle
+	size_t first = out_vertices.size();
+	size_t triangleCount = counts.triangles;
+	out_vertices.resize(first + 3*triangleCount);
+	out_uvs     .resize(first + 3*triangleCount);
+	out_normals .resize(first + 3*triangleCount);
+	runInParallel(threadCount, [&](unsigned int chunk){
+		bool ok = true;
+		for( size_t t=triangleCount*chunk/threadCount; t<triangleCount*(chunk+1)/threadCount && ok; t++ ){
+
+			const unsigned int * corners = &faceIndices[9*t];
+			size_t out = first + 3*t;
+
+			// Get the attributes thanks to the index, and put them in buffers
+			bool missingNormal = false;
+			for ( int k=0; k<3; k++ ){
+				unsigned int vertexIndex = corners[3*k+0];
+				unsigned int uvIndex     = corners[3*k+1];
+				unsigned int normalIndex = corners[3*k+2];
+				if ( vertexIndex >= counts.vertices
+				  || (uvIndex     != OBJ_MISSING && uvIndex     >= counts.uvs)
+				  || (normalIndex != OBJ_MISSING && normalIndex >= counts.normals) ){
+					ok = false;
+					break;
+				}
+				out_vertices[out+k] = temp_vertices[ vertexIndex ];
+				out_uvs     [out+k] = uvIndex     != OBJ_MISSING ? temp_uvs    [ uvIndex ]     : glm::vec2(0.0f);
+				out_normals [out+k] = normalIndex != OBJ_MISSING ? temp_normals[ normalIndex ] : glm::vec3(0.0f);
+				missingNormal = missingNormal || normalIndex == OBJ_MISSING;
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices    .push_back(uvIndex[0]);
-			uvIndices    .push_back(uvIndex[1]);
-			uvIndices    .push_back(uvIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		}else{
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
-		}
 
+			// No normal in the file : use the normal of the triangle (flat shading)
+			if ( ok && missingNormal ){
+				glm::vec3 faceNormal = glm::cross(out_vertices[out+1] - out_vertices[out], out_vertices[out+2] - out_vertices[out]);
+				float length = glm::length(faceNormal);
+				faceNormal = length > 0.0f ? faceNormal / length : glm::vec3(0.0f);
+				for ( int k=0; k<3; k++ ){
+					if ( corners[3*k+2] == OBJ_MISSING )
+						out_normals[out+k] = faceNormal;
+				}
+			}
+		}
+		chunkOk[chunk] = ok;
+	});
+	for ( unsigned int i=0; i<threadCount; i++ ){
+		if ( !chunkOk[i] ){
+			printf("Invalid index in OBJ file\n");
+			out_vertices.resize(first);
+			out_uvs     .resize(first);
+			out_normals .resize(first);
+			return false;
+		}
 	}
 
-	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
-
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normalIndices[i];
-		
-		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-		glm::vec2 uv = temp_uvs[ uvIndex-1 ];
-		glm::vec3 normal = temp_normals[ normalIndex-1 ];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs     .push_back(uv);
-		out_normals .push_back(normal);
-	
+	// Groups : replay the "o", "g" and "usemtl" lines of all chunks, in order.
+	// A new group starts each time one of them changes.
+	if ( out_groups ){
+		OBJGroup current;
+		current.firstVertex = first;
+		for ( unsigned int i=0; i<threadCount; i++ ){
+			for ( size_t e=0; e<chunkGroupEvents[i].size(); e++ ){
+				const OBJGroupEvent & event = chunkGroupEvents[i][e];
+				unsigned int vertex = first + 3 * (chunkOffsets[i].triangles + event.triangle);
+				current.vertexCount = vertex - current.firstVertex;
+				if ( current.vertexCount > 0 )
+					out_groups->push_back(current);
+				if ( event.type == OBJ_OBJECT )   current.object   = event.name;
+				if ( event.type == OBJ_GROUP )    current.group    = event.name;
+				if ( event.type == OBJ_MATERIAL ) current.material = event.name;
+				current.firstVertex = vertex;
+			}
+		}
+		current.vertexCount = out_vertices.size() - current.firstVertex;
+		if ( current.vertexCount > 0 )
+			out_groups->push_back(current);
 	}
 
 	return true;
 }
 
+bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	return loadOBJ_impl(path, out_vertices, out_uvs, out_normals, NULL, 1);
+}
+
+bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<OBJGroup> & out_groups
+){
+	return loadOBJ_impl(path, out_vertices, out_uvs, out_normals, &out_groups, 1);
+}
+
+bool loadOBJ_parallel(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	return loadOBJ_impl(path, out_vertices, out_uvs, out_normals, NULL, threadCount);
+}
+
+bool loadOBJ_parallel(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<OBJGroup> & out_groups,
+	unsigned int threadCount
+){
+	return loadOBJ_impl(path, out_vertices, out_uvs, out_normals, &out_groups, threadCount);
+}
+
+bool loadOBJ(const char * path, Mesh & mesh){
+	mesh.clear();
+	return loadOBJ_impl(path, mesh.vertices, mesh.uvs, mesh.normals, NULL, 1);
+}
+
+bool loadOBJ_parallel(const char * path, Mesh & mesh, unsigned int threadCount){
+	mesh.clear();
+	return loadOBJ_impl(path, mesh.vertices, mesh.uvs, mesh.normals, NULL, threadCount);
+}
+
 
 #ifdef USE_ASSIMP // don't use this #define, it's only for me (it AssImp fails to compile on your machine, at least all the other tutorials still work)
 
@@ -117,9 +632,10 @@ bool loadOBJ(
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
 
-bool loadAssImp(
+template <typename IndexType>
+static bool loadAssImp_impl(
 	const char * path, 
-	std::vector<unsigned short> & indices,
+	std::vector<IndexType> & indices,
 	std::vector<glm::vec3> & vertices,
 	std::vector<glm::vec2> & uvs,
 	std::vector<glm::vec3> & normals
@@ -129,28 +645,35 @@ bool loadAssImp(
 
 	const aiScene* scene = importer.ReadFile(path, 0/*aiProcess_JoinIdenticalVertices | aiProcess_SortByPType*/);
 	if( !scene) {
-		fprintf( stderr, importer.GetErrorString());
+		fprintf( stderr, "%s\n", importer.GetErrorString());
 		getchar();
 		return false;
 	}
 	const aiMesh* mesh = scene->mMeshes[0]; // In this simple example code we always use the 1rst mesh (in OBJ files there is often only one anyway)
 
+	// Don't let the indices wrap around silently
+	if ( (unsigned long long)vertices.size() + mesh->mNumVertices > (unsigned long long)(IndexType)~(IndexType)0 + 1 ){
+		fprintf( stderr, "%s has too many vertices for %d-bit indices\n", path, (int)(8*sizeof(IndexType)) );
+		return false;
+	}
+	IndexType firstVertex = (IndexType)vertices.size();
+
 	// Fill vertices positions
-	vertices.reserve(mesh->mNumVertices);
+	vertices.reserve(vertices.size() + mesh->mNumVertices);
 	for(unsigned int i=0; i<mesh->mNumVertices; i++){
 		aiVector3D pos = mesh->mVertices[i];
 		vertices.push_back(glm::vec3(pos.x, pos.y, pos.z));
 	}
 
 	// Fill vertices texture coordinates
-	uvs.reserve(mesh->mNumVertices);
+	uvs.reserve(uvs.size() + mesh->mNumVertices);
 	for(unsigned int i=0; i<mesh->mNumVertices; i++){
 		aiVector3D UVW = mesh->mTextureCoords[0][i]; // Assume only 1 set of UV coords; AssImp supports 8 UV sets.
 		uvs.push_back(glm::vec2(UVW.x, UVW.y));
 	}
 
 	// Fill vertices normals
-	normals.reserve(mesh->mNumVertices);
+	normals.reserve(normals.size() + mesh->mNumVertices);
 	for(unsigned int i=0; i<mesh->mNumVertices; i++){
 		aiVector3D n = mesh->mNormals[i];
 		normals.push_back(glm::vec3(n.x, n.y, n.z));
@@ -158,16 +681,41 @@ bool loadAssImp(
 
 
 	// Fill face indices
-	indices.reserve(3*mesh->mNumFaces);
+	indices.reserve(indices.size() + 3*mesh->mNumFaces);
 	for (unsigned int i=0; i<mesh->mNumFaces; i++){
 		// Assume the model has only triangles.
-		indices.push_back(mesh->mFaces[i].mIndices[0]);
-		indices.push_back(mesh->mFaces[i].mIndices[1]);
-		indices.push_back(mesh->mFaces[i].mIndices[2]);
+		indices.push_back(firstVertex + mesh->mFaces[i].mIndices[0]);
+		indices.push_back(firstVertex + mesh->mFaces[i].mIndices[1]);
+		indices.push_back(firstVertex + mesh->mFaces[i].mIndices[2]);
 	}
 	
 	// The "scene" pointer will be deleted automatically by "importer"
+	return true;
+}
+
+bool loadAssImp(
+	const char * path, 
+	std::vector<unsigned short> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	return loadAssImp_impl(path, indices, vertices, uvs, normals);
+}
+
+bool loadAssImp(
+	const char * path, 
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	return loadAssImp_impl(path, indices, vertices, uvs, normals);
+}
 
+bool loadAssImp(const char * path, Mesh & mesh){
+	mesh.clear();
+	return loadAssImp_impl(path, mesh.indices, mesh.vertices, mesh.uvs, mesh.normals);
 }
 
 #endif
\ No newline at end of file
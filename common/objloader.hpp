@@ -1,6 +1,20 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+#include <string>
+
+// A range of triangles of an OBJ file with the same "o", "g" and "usemtl".
+// These can be drawn separately, for instance with a different material.
+struct OBJGroup{
+	std::string object;
+	std::string group;
+	std::string material;
+	unsigned int firstVertex; // In out_vertices, out_uvs and out_normals
+	unsigned int vertexCount; // 3 per triangle
+};
+
+// Loads all the faces of an OBJ file, as a triangle soup.
+// Polygons are triangulated. Missing UVs are (0,0), missing normals are flat.
 bool loadOBJ(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
@@ -8,8 +22,37 @@ bool loadOBJ(
 	std::vector<glm::vec3> & out_normals
 );
 
+// Same thing, but also tells which triangles belong to which object/group/material
+bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals,
+	std::vector<OBJGroup> & out_groups
+);
 
+// Same result as loadOBJ, but big files are split in chunks that are parsed
+// by threadCount threads. threadCount = 0 means one thread per core.
+bool loadOBJ_parallel(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 0
+);
 
+bool loadOBJ_parallel(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals,
+	std::vector<OBJGroup> & out_groups,
+	unsigned int threadCount = 0
+);
+
+
+
+// Returns false if the mesh doesn't fit in 16-bit indices : use the unsigned int version then.
 bool loadAssImp(
 	const char * path, 
 	std::vector<unsigned short> & indices,
@@ -18,4 +61,12 @@ bool loadAssImp(
 	std::vector<glm::vec3> & normals
 );
 
+bool loadAssImp(
+	const char * path, 
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,615 @@
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "sse2.hpp"
+
+#include "threadpool.hpp"
+#include "particles.hpp"
+
+// rank of the particles that were not there at the last sort
+static const unsigned int NoRank = ~0u;
+
+// stealSlot of the particles that are not in stealList, and entries of
+// stealList whose particle died
+static const unsigned int NoSlot = ~0u;
+
+// Particles per job, when there is a ThreadPool : a multiple of 4
+static const unsigned int BlockSize = 16384;
+
+// Room for count particles, rounded up to a multiple of 4
+static unsigned int paddedSize(unsigned int count){
+	return (count + 3) & ~3u;
+}
+
+static unsigned int blockCount(unsigned int count){
+	return (count + BlockSize - 1) / BlockSize;
+}
+
+// On the threads of pool, or on this thread if there is no pool
+static void forEachBlock(size_t count, ThreadPool * pool, const std::function<void(size_t)> & function){
+	if ( pool && count > 1 ){
+		pool->parallelFor(count, function);
+	}else{
+		for ( size_t i=0; i<count; i++ )
+			function(i);
+	}
+}
+
+ParticleSystem::ParticleSystem(unsigned int capacity, ParticleOverflow overflow)
+	: liveCount(0), maxCount(0), overflow(overflow), acceleration(0.0f, -9.81f, 0.0f), sorted(false),
+	  sorting(PARTICLES_SORT_RADIX), rankedCount(0), radixFrames(0), radixBackoff(0)
+{
+	reserve(capacity);
+}
+
+void ParticleSystem::reserve(unsigned int capacity){
+	if ( capacity <= maxCount )
+		return;
+	maxCount = capacity;
+
+	unsigned int padded = paddedSize(capacity);
+	x.resize(padded, 0.0f);
+	y.resize(padded, 0.0f);
+	z.resize(padded, 0.0f);
+	vx.resize(padded, 0.0f);
+	vy.resize(padded, 0.0f);
+	vz.resize(padded, 0.0f);
+	life.resize(padded, 0.0f);
+	size.resize(padded, 0.0f);
+	color.resize(padded, 0);
+	distance.resize(padded, 0.0f);
+	order.resize(padded, 0);
+	rank.resize(padded, NoRank);
+	stealSlot.resize(padded, NoSlot);
+	keys.resize(padded, 0);
+	keysTemp.resize(padded, 0);
+	orderTemp.resize(padded, 0);
+}
+
+void ParticleSystem::resetStats(){
+	counters = ParticleStats();
+	counters.peak = liveCount;
+}
+
+bool ParticleSystem::spawn(const ParticleSpawn & particle){
+
+	if ( liveCount == maxCount ){
+		if ( overflow == PARTICLES_STEAL_OLDEST && liveCount > 0 ){
+			set(takeOldest(), particle);
+			counters.stolen++;
+			counters.spawned++;
+			sorted = false;
+			return true;
+		}else if ( overflow == PARTICLES_GROW ){
+			reserve(maxCount > 0 ? 2*maxCount : 64);
+			counters.grown++;
+		}else{
+			counters.dropped++;
+			return false;
+		}
+	}
+
+	set(liveCount++, particle);
+	counters.spawned++;
+	if ( liveCount > counters.peak )
+		counters.peak = liveCount;
+	sorted = false;
+	return true;
+}
+
+// Particles with the least life left : most of the time, the oldest
+struct LessLife{
+	const float * life;
+	bool operator()(unsigned int a, unsigned int b) const { return life[a] < life[b]; }
+};
+
+unsigned int ParticleSystem::takeOldest(){
+	// Particles that died since the list was made
+	while ( !stealList.empty() && stealList.back() == NoSlot )
+		stealList.pop_back();
+
+	if ( stealList.empty() ){
+		// The 1/64 oldest particles (64 at least) : a steal costs O(1) on average
+		unsigned int batch = std::min(liveCount, std::max(64u, liveCount / 64));
+		stealList.resize(liveCount);
+		for ( unsigned int i=0; i<liveCount; i++ )
+			stealList[i] = i;
+		LessLife lessLife = { &life[0] };
+		std::nth_element(stealList.begin(), stealList.begin() + (batch - 1), stealList.end(), lessLife);
+		stealList.resize(batch);
+		std::sort(stealList.begin(), stealList.end(), lessLife);
+		std::reverse(stealList.begin(), stealList.end()); // The oldest last
+		for ( unsigned int k=0; k<batch; k++ )
+			stealSlot[stealList[k]] = k;
+	}
+	unsigned int i = stealList.back();
+	stealList.pop_back();
+	stealSlot[i] = NoSlot;
+	return i;
+}
+
+void ParticleSystem::set(unsigned int i, const ParticleSpawn & particle){
+	x[i] = particle.position.x;
+	y[i] = particle.position.y;
+	z[i] = particle.position.z;
+	vx[i] = particle.velocity.x;
+	vy[i] = particle.velocity.y;
+	vz[i] = particle.velocity.z;
+	life[i] = particle.life;
+	size[i] = particle.size;
+	unsigned char rgba[4] = { particle.r, particle.g, particle.b, particle.a };
+	memcpy(&color[i], rgba, 4);
+	distance[i] = 0.0f;
+	rank[i] = NoRank;
+}
+
+void ParticleSystem::clear(){
+	liveCount = 0;
+	sorted = false;
+	rankedCount = 0;
+	for ( size_t k=0; k<stealList.size(); k++ )
+		if ( stealList[k] != NoSlot )
+			stealSlot[stealList[k]] = NoSlot;
+	stealList.clear();
+}
+
+// The last particle takes the place of particle i. stealList follows.
+void ParticleSystem::remove(unsigned int i){
+	unsigned int last = --liveCount;
+	if ( stealSlot[i] != NoSlot ){
+		stealList[stealSlot[i]] = NoSlot;
+		stealSlot[i] = NoSlot;
+	}
+	if ( i == last )
+		return;
+	x[i] = x[last];
+	y[i] = y[last];
+	z[i] = z[last];
+	vx[i] = vx[last];
+	vy[i] = vy[last];
+	vz[i] = vz[last];
+	life[i] = life[last];
+	size[i] = size[last];
+	color[i] = color[last];
+	distance[i] = distance[last];
+	rank[i] = rank[last];
+	stealSlot[i] = stealSlot[last];
+	stealSlot[last] = NoSlot;
+	if ( stealSlot[i] != NoSlot )
+		stealList[stealSlot[i]] = i;
+}
+
+void ParticleSystem::update(float deltaTime, ThreadPool * pool){
+	sorted = false;
+	if ( liveCount == 0 )
+		return;
+
+	// Each block moves its particles and lists its dead ones
+	unsigned int blocks = blockCount(liveCount);
+	if ( deadLists.size() < blocks )
+		deadLists.resize(blocks);
+	forEachBlock(blocks, pool, [&](size_t block){
+		unsigned int begin = (unsigned int)block * BlockSize;
+		unsigned int end = std::min(liveCount, begin + BlockSize);
+		integrate(begin, end, deltaTime);
+
+		// Most groups of 4 have no dead particle : one comparison for the 4
+		std::vector<unsigned int> & dead = deadLists[block];
+		dead.clear();
+		unsigned int i = begin;
+#ifdef COMMON_SSE2
+		for ( ; i+4 <= end; i+=4 ){
+			int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(&life[i]), _mm_setzero_ps()));
+			for ( int lane=0; mask != 0; lane++, mask >>= 1 )
+				if ( mask & 1 )
+					dead.push_back(i + lane);
+		}
+#endif
+		for ( ; i<end; i++ )
+			if ( life[i] <= 0.0f )
+				dead.push_back(i);
+	});
+
+	// Then they are removed, the last one first : the particle that takes
+	// the place of a dead one (the last one) is always alive. Same order
+	// with or without threads, so the result is the same too.
+	for ( unsigned int block=blocks; block-- > 0; ){
+		const std::vector<unsigned int> & dead = deadLists[block];
+		for ( size_t k=dead.size(); k-- > 0; )
+			remove(dead[k]);
+		counters.died += dead.size();
+	}
+}
+
+// Simulate simple physics : gravity only, no collisions.
+// The particles that die during this step move too, it doesn't matter :
+// they are removed just after.
+void ParticleSystem::integrate(unsigned int begin, unsigned int end, float deltaTime){
+	glm::vec3 deltaVelocity = acceleration * deltaTime;
+	end = paddedSize(end); // The padding gets garbage, nobody reads it
+
+#ifdef COMMON_SSE2
+	__m128 dt  = _mm_set1_ps(deltaTime);
+	__m128 dvx = _mm_set1_ps(deltaVelocity.x);
+	__m128 dvy = _mm_set1_ps(deltaVelocity.y);
+	__m128 dvz = _mm_set1_ps(deltaVelocity.z);
+	for ( unsigned int i=begin; i<end; i+=4 ){
+		_mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), dt));
+
+		__m128 velocityX = _mm_add_ps(_mm_loadu_ps(&vx[i]), dvx);
+		__m128 velocityY = _mm_add_ps(_mm_loadu_ps(&vy[i]), dvy);
+		__m128 velocityZ = _mm_add_ps(_mm_loadu_ps(&vz[i]), dvz);
+		_mm_storeu_ps(&vx[i], velocityX);
+		_mm_storeu_ps(&vy[i], velocityY);
+		_mm_storeu_ps(&vz[i], velocityZ);
+
+		_mm_storeu_ps(&x[i], _mm_add_ps(_mm_loadu_ps(&x[i]), _mm_mul_ps(velocityX, dt)));
+		_mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), _mm_mul_ps(velocityY, dt)));
+		_mm_storeu_ps(&z[i], _mm_add_ps(_mm_loadu_ps(&z[i]), _mm_mul_ps(velocityZ, dt)));
+	}
+#else
+	for ( unsigned int i=begin; i<end; i++ ){
+		life[i] -= deltaTime;
+		vx[i] += deltaVelocity.x;
+		vy[i] += deltaVelocity.y;
+		vz[i] += deltaVelocity.z;
+		x[i] += vx[i] * deltaTime;
+		y[i] += vy[i] * deltaTime;
+		z[i] += vz[i] * deltaTime;
+	}
+#endif
+}
+
+// Far particles first. Equal distances : any order.
+struct FartherFirst{
+	const float * distance;
+	bool operator()(unsigned int a, unsigned int b) const { return distance[a] > distance[b]; }
+};
+
+// The distances are positive floats : their bits, as unsigned ints, are in
+// the same order as the floats. Inverted, so that far particles come first.
+static inline unsigned int backToFrontKey(float distance){
+	unsigned int bits;
+	memcpy(&bits, &distance, 4);
+	return ~bits;
+}
+
+// LSD radix sort of the pairs (keys[i], order[i]), 11 bits at a time : 3
+// passes at most, and the passes where all the keys have the same digit
+// are skipped (the high bits, when all the particles are at about the same
+// distance). Stable. The temporary arrays have room for count pairs.
+static void radixSortPairs(unsigned int * keys, unsigned int * order, unsigned int * keysTemp, unsigned int * orderTemp, unsigned int count){
+	const unsigned int radixBits = 11;
+	const unsigned int bucketCount = 1 << radixBits;
+	const unsigned int passCount = 3;
+
+	unsigned int histograms[passCount * bucketCount] = { 0 }; // 24 KB
+	for ( unsigned int i=0; i<count; i++ ){
+		unsigned int key = keys[i];
+		for ( unsigned int pass=0; pass<passCount; pass++ )
+			histograms[pass*bucketCount + ((key >> (pass*radixBits)) & (bucketCount-1))]++;
+	}
+
+	unsigned int * sourceKeys = keys;
+	unsigned int * sourceOrder = order;
+	unsigned int * destinationKeys = keysTemp;
+	unsigned int * destinationOrder = orderTemp;
+	for ( unsigned int pass=0; pass<passCount; pass++ ){
+		unsigned int * histogram = &histograms[pass*bucketCount];
+		unsigned int shift = pass*radixBits;
+		if ( histogram[(sourceKeys[0] >> shift) & (bucketCount-1)] == count )
+			continue; // Nothing would move
+
+		// Where each bucket starts
+		unsigned int sum = 0;
+		for ( unsigned int b=0; b<bucketCount; b++ ){
+			unsigned int bucketSize = histogram[b];
+			histogram[b] = sum;
+			sum += bucketSize;
+		}
+		for ( unsigned int i=0; i<count; i++ ){
+			unsigned int key = sourceKeys[i];
+			unsigned int destination = histogram[(key >> shift) & (bucketCount-1)]++;
+			destinationKeys[destination] = key;
+			destinationOrder[destination] = sourceOrder[i];
+		}
+		std::swap(sourceKeys, destinationKeys);
+		std::swap(sourceOrder, destinationOrder);
+	}
+
+	if ( sourceKeys != keys ){
+		memcpy(keys, sourceKeys, count * sizeof(unsigned int));
+		memcpy(order, sourceOrder, count * sizeof(unsigned int));
+	}
+}
+
+// Part of the merge of two sorted runs a and b : the pairs out[begin, end)
+struct MergePiece{
+	const unsigned int * keysA;
+	const unsigned int * orderA;
+	unsigned int countA;
+	const unsigned int * keysB;
+	const unsigned int * orderB;
+	unsigned int countB;
+	unsigned int * keysOut;
+	unsigned int * orderOut;
+	unsigned int begin, end;
+};
+
+// How many of the first position pairs of the merge come from a. On equal
+// keys, a comes first, like std::merge : the merge is stable.
+static unsigned int mergeSplit(const unsigned int * a, unsigned int countA, const unsigned int * b, unsigned int countB, unsigned int position){
+	unsigned int low = position > countB ? position - countB : 0;
+	unsigned int high = std::min(position, countA);
+	while ( low < high ){
+		unsigned int middle = (low + high) / 2;
+		if ( a[middle] <= b[position - middle - 1] )
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+static void mergePiece(const MergePiece & piece){
+	unsigned int i = mergeSplit(piece.keysA, piece.countA, piece.keysB, piece.countB, piece.begin);
+	unsigned int j = piece.begin - i;
+	for ( unsigned int k=piece.begin; k<piece.end; k++ ){
+		if ( j >= piece.countB || (i < piece.countA && piece.keysA[i] <= piece.keysB[j]) ){
+			piece.keysOut[k] = piece.keysA[i];
+			piece.orderOut[k] = piece.orderA[i++];
+		}else{
+			piece.keysOut[k] = piece.keysB[j];
+			piece.orderOut[k] = piece.orderB[j++];
+		}
+	}
+}
+
+// Without a pool : one radix sort. With a pool : a radix sort per block,
+// then the sorted blocks are merged two by two, each merge cut in pieces
+// of BlockSize for the threads. Both are stable sorts of the same keys :
+// the order is the same.
+void ParticleSystem::radixSort(ThreadPool * pool){
+	unsigned int n = liveCount;
+	unsigned int blocks = pool ? blockCount(n) : 1;
+	unsigned int runSize = pool ? BlockSize : n;
+
+	forEachBlock(blocks, pool, [&](size_t block){
+		unsigned int begin = (unsigned int)block * runSize;
+		unsigned int end = std::min(n, begin + runSize);
+		for ( unsigned int i=begin; i<end; i++ ){
+			keys[i] = backToFrontKey(distance[i]);
+			order[i] = i;
+		}
+		radixSortPairs(&keys[begin], &order[begin], &keysTemp[begin], &orderTemp[begin], end - begin);
+	});
+
+	bool inTemp = false;
+	for ( unsigned int width=runSize; width<n; width*=2 ){
+		const unsigned int * sourceKeys  = inTemp ? &keysTemp[0]  : &keys[0];
+		const unsigned int * sourceOrder = inTemp ? &orderTemp[0] : &order[0];
+		unsigned int * destinationKeys   = inTemp ? &keys[0]  : &keysTemp[0];
+		unsigned int * destinationOrder  = inTemp ? &order[0] : &orderTemp[0];
+
+		std::vector<MergePiece> pieces;
+		for ( unsigned int begin=0; begin<n; begin+=2*width ){
+			unsigned int middle = std::min(n, begin + width);
+			unsigned int end = std::min(n, begin + 2*width);
+			MergePiece piece = {
+				sourceKeys + begin,  sourceOrder + begin,  middle - begin,
+				sourceKeys + middle, sourceOrder + middle, end - middle,
+				destinationKeys + begin, destinationOrder + begin, 0, 0
+			};
+			for ( unsigned int k=0; k<end-begin; k+=BlockSize ){
+				piece.begin = k;
+				piece.end = std::min(end - begin, k + BlockSize);
+				pieces.push_back(piece);
+			}
+		}
+		forEachBlock(pieces.size(), pool, [&](size_t i){
+			mergePiece(pieces[i]);
+		});
+		inTemp = !inTemp;
+	}
+	if ( inTemp ){
+		keys.swap(keysTemp);
+		order.swap(orderTemp);
+	}
+}
+
+// Insertion sort of the previous order : few moves if it's almost right.
+// The new particles are sorted apart, then merged. Returns false, without a
+// valid order, if there was too much to do : a radix sort will be faster.
+bool ParticleSystem::incrementalSort(){
+	unsigned int n = liveCount;
+	if ( rankedCount == 0 )
+		return false;
+
+	// The previous order, without the dead particles : the particles moved
+	// since (swap-remove), but their rank moved with them
+	unsigned int * previous = &orderTemp[0];
+	for ( unsigned int r=0; r<rankedCount; r++ )
+		previous[r] = NoRank;
+	unsigned int * newParticles = &keysTemp[0];
+	unsigned int newCount = 0;
+	for ( unsigned int i=0; i<n; i++ ){
+		if ( rank[i] < rankedCount )
+			previous[rank[i]] = i;
+		else
+			newParticles[newCount++] = i;
+	}
+	if ( newCount > n / 8 )
+		return false;
+	unsigned int oldCount = 0;
+	for ( unsigned int r=0; r<rankedCount; r++ )
+		if ( previous[r] != NoRank )
+			order[oldCount++] = previous[r];
+
+	// Each particle goes back until the one before it is farther. With
+	// coherent motion, a particle passes only a few others. The keys are
+	// copied next to the order, so that this loop only reads memory in order.
+	unsigned int * sortedKeys = &keys[0];
+	for ( unsigned int k=0; k<oldCount; k++ )
+		sortedKeys[k] = backToFrontKey(distance[order[k]]);
+	size_t moves = 0;
+	size_t maxMoves = 4 * (size_t)oldCount + 1024; // More than that, and a radix sort is faster
+	for ( unsigned int k=1; k<oldCount; k++ ){
+		unsigned int key = sortedKeys[k];
+		if ( sortedKeys[k-1] <= key )
+			continue;
+		unsigned int particle = order[k];
+		unsigned int j = k;
+		do{
+			sortedKeys[j] = sortedKeys[j-1];
+			order[j] = order[j-1];
+			j--;
+		}while ( j > 0 && sortedKeys[j-1] > key );
+		sortedKeys[j] = key;
+		order[j] = particle;
+		moves += k - j;
+		if ( moves > maxMoves )
+			return false;
+	}
+
+	// The new particles : usually a handful, all near the emitter
+	FartherFirst farther = { &distance[0] };
+	std::sort(newParticles, newParticles + newCount, farther);
+	std::merge(order.begin(), order.begin() + oldCount, newParticles, newParticles + newCount, orderTemp.begin(), farther);
+	order.swap(orderTemp);
+	return true;
+}
+
+void ParticleSystem::sortBackToFront(const glm::vec3 & cameraPosition, ThreadPool * pool){
+	forEachBlock(blockCount(liveCount), pool, [&](size_t block){
+		unsigned int begin = (unsigned int)block * BlockSize;
+		unsigned int end = std::min(liveCount, begin + BlockSize);
+		computeDistances(begin, end, cameraPosition);
+	});
+
+	sorted = true;
+	if ( liveCount == 0 ){
+		rankedCount = 0;
+		return;
+	}
+
+	if ( sorting == PARTICLES_SORT_INCREMENTAL ){
+		// When the order changes too much from one frame to the next, the
+		// failed attempts cost as much as a radix sort : try again later,
+		// later and later (64 frames at most)
+		if ( radixFrames > 0 ){
+			radixFrames--;
+			radixSort(pool);
+		}else if ( incrementalSort() ){
+			radixBackoff = 0;
+		}else{
+			radixSort(pool);
+			radixBackoff = std::min(64u, std::max(1u, 2*radixBackoff));
+			radixFrames = radixBackoff;
+		}
+		// For the next frame
+		for ( unsigned int k=0; k<liveCount; k++ )
+			rank[order[k]] = k;
+		rankedCount = liveCount;
+	}else{
+		radixSort(pool);
+		rankedCount = 0;
+	}
+}
+
+// Squared distances to the camera
+void ParticleSystem::computeDistances(unsigned int begin, unsigned int end, const glm::vec3 & cameraPosition){
+	end = paddedSize(end);
+
+#ifdef COMMON_SSE2
+	__m128 cx = _mm_set1_ps(cameraPosition.x);
+	__m128 cy = _mm_set1_ps(cameraPosition.y);
+	__m128 cz = _mm_set1_ps(cameraPosition.z);
+	for ( unsigned int i=begin; i<end; i+=4 ){
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(&x[i]), cx);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(&y[i]), cy);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(&z[i]), cz);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		_mm_storeu_ps(&distance[i], d2);
+	}
+#else
+	for ( unsigned int i=begin; i<end; i++ ){
+		float dx = x[i] - cameraPosition.x;
+		float dy = y[i] - cameraPosition.y;
+		float dz = z[i] - cameraPosition.z;
+		distance[i] = dx*dx + dy*dy + dz*dz;
+	}
+#endif
+}
+
+void ParticleSystem::fillBuffers(float * positionSize, unsigned char * colors, ThreadPool * pool) const {
+	// Each block writes its own part of the buffers
+	forEachBlock(blockCount(liveCount), pool, [&](size_t block){
+		unsigned int begin = (unsigned int)block * BlockSize;
+		unsigned int end = std::min(liveCount, begin + BlockSize);
+		fill(begin, end, positionSize, colors);
+	});
+}
+
+// Particles begin ... end-1 of the draw order
+void ParticleSystem::fill(unsigned int begin, unsigned int end, float * positionSize, unsigned char * colors) const {
+
+	if ( sorted ){
+		for ( unsigned int k=begin; k<end; k++ ){
+			unsigned int i = order[k];
+			float * out = positionSize + 4*k;
+			out[0] = x[i];
+			out[1] = y[i];
+			out[2] = z[i];
+			out[3] = size[i];
+			memcpy(colors + 4*k, &color[i], 4);
+		}
+		return;
+	}
+
+	// Storage order : the colors are already in the right layout, and the
+	// positions only need a transposition, 4 particles at a time
+	unsigned int i = begin;
+#ifdef COMMON_SSE2
+	for ( ; i+4 <= end; i+=4 ){
+		__m128 row0 = _mm_loadu_ps(&x[i]);
+		__m128 row1 = _mm_loadu_ps(&y[i]);
+		__m128 row2 = _mm_loadu_ps(&z[i]);
+		__m128 row3 = _mm_loadu_ps(&size[i]);
+		_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+		_mm_storeu_ps(positionSize + 4*i +  0, row0);
+		_mm_storeu_ps(positionSize + 4*i +  4, row1);
+		_mm_storeu_ps(positionSize + 4*i +  8, row2);
+		_mm_storeu_ps(positionSize + 4*i + 12, row3);
+	}
+#endif
+	for ( ; i<end; i++ ){
+		positionSize[4*i+0] = x[i];
+		positionSize[4*i+1] = y[i];
+		positionSize[4*i+2] = z[i];
+		positionSize[4*i+3] = size[i];
+	}
+	if ( end > begin )
+		memcpy(colors + 4*begin, &color[begin], 4 * (end - begin));
+}
+
+void updateParticleSystems(ParticleSystem * const * systems, unsigned int count, float deltaTime, const glm::vec3 & cameraPosition, ThreadPool * pool){
+	// One job per emitter, which gives jobs to the pool for its blocks : the
+	// big emitters are split, and the small ones run side by side
+	forEachBlock(count, pool, [&](size_t i){
+		systems[i]->update(deltaTime, pool);
+		systems[i]->sortBackToFront(cameraPosition, pool);
+	});
+}
+
+unsigned int fillParticleBuffers(ParticleSystem * const * systems, unsigned int count, float * positionSize, unsigned char * colors, ThreadPool * pool){
+	std::vector<unsigned int> first(count + 1, 0);
+	for ( unsigned int i=0; i<count; i++ )
+		first[i+1] = first[i] + systems[i]->count();
+
+	forEachBlock(count, pool, [&](size_t i){
+		systems[i]->fillBuffers(positionSize + 4*first[i], colors + 4*first[i], pool);
+	});
+	return first[count];
+}
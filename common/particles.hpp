@@ -0,0 +1,185 @@
+#ifndef PARTICLES_HPP
+#define PARTICLES_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// The CPU side of the particles of tutorial 18, without OpenGL.
+//
+// Instead of an array of Particle structs where the dead ones stay in place
+// (and are visited every frame anyway), each attribute has its own array
+// (x of all particles, then y of all particles, etc.), and the live
+// particles are always the first count() ones : when a particle dies, the
+// last one takes its place. So :
+// - the simulation only looks at live particles, 4 at a time with SSE
+// - the arrays are read in order, with nothing in between that isn't needed
+// - the buffers for OpenGL are written directly (they can be mapped), in the
+//   order in which they must be drawn.
+//
+// There is no search for a free slot either : the free slots are always
+// count() ... capacity()-1, so spawning is just writing at count(). When
+// there is no room left, the overflow policy decides (see ParticleOverflow).
+//
+// A frame : spawn() the new particles, update(), sortBackToFront() (for
+// blended particles), then fillBuffers().
+//
+// With a ThreadPool, update, sortBackToFront and fillBuffers cut the
+// particles in blocks of 16384, one job each : the blocks write to their own
+// part of the arrays and of the buffers, and the sort is a radix sort per
+// block, then a parallel merge. The result is exactly the same as without
+// threads. Several emitters : see updateParticleSystems.
+
+class ThreadPool;
+
+// A new particle
+struct ParticleSpawn{
+	glm::vec3 position;
+	glm::vec3 velocity;
+	unsigned char r, g, b, a;
+	float size;
+	float life;  // In seconds
+};
+
+// What spawn() does when there are already capacity() particles
+enum ParticleOverflow{
+	PARTICLES_DROP,         // The new particle is lost
+	PARTICLES_STEAL_OLDEST, // It takes the place of one of the particles closest to the end of their life
+	PARTICLES_GROW          // The capacity doubles (the arrays are reallocated)
+};
+
+// Counters, since the creation of the system or the last resetStats()
+struct ParticleStats{
+	unsigned long long spawned; // Including the ones that took the place of another one
+	unsigned long long dropped; // PARTICLES_DROP
+	unsigned long long stolen;  // PARTICLES_STEAL_OLDEST : particles that died early
+	unsigned long long died;    // At the end of their life
+	unsigned int grown;         // PARTICLES_GROW : times the capacity doubled
+	unsigned int peak;          // Most live particles at once
+
+	ParticleStats() : spawned(0), dropped(0), stolen(0), died(0), grown(0), peak(0) {}
+};
+
+// How sortBackToFront() sorts
+enum ParticleSortMode{
+	PARTICLES_SORT_RADIX,      // Radix sort of the distances : always the same cost, O(count)
+	PARTICLES_SORT_INCREMENTAL // Starts from the order of the previous frame, which is almost right
+	                           // when the camera and the particles move a bit : insertion sort, for
+	                           // a few moves per particle. Too many moves : radix sort instead.
+};
+
+class ParticleSystem{
+public:
+	explicit ParticleSystem(unsigned int capacity, ParticleOverflow overflow = PARTICLES_DROP);
+
+	// O(1), whatever the number of particles (amortized, for
+	// PARTICLES_STEAL_OLDEST). Returns false if the particle was dropped (see
+	// ParticleOverflow).
+	bool spawn(const ParticleSpawn & particle);
+
+	// Ages the particles by deltaTime seconds, removes the ones that are now
+	// dead, and moves the others : velocity += gravity*deltaTime, then
+	// position += velocity*deltaTime.
+	void update(float deltaTime, ThreadPool * pool = NULL);
+
+	// Squared distances to the camera, then the draw order : far particles
+	// first. Only the order is sorted (see drawOrder), the particles don't move.
+	// The incremental sort runs on this thread only.
+	void sortBackToFront(const glm::vec3 & cameraPosition, ThreadPool * pool = NULL);
+
+	ParticleSortMode sortMode() const { return sorting; }
+	void setSortMode(ParticleSortMode mode) { sorting = mode; }
+
+	// Writes count() particles : x, y, z, size in positionSize (4 floats
+	// each), and r, g, b, a in colors (4 bytes each). In the order of the
+	// last sortBackToFront, or in storage order if there wasn't one since
+	// the last update (for additive particles, which don't need sorting).
+	void fillBuffers(float * positionSize, unsigned char * colors, ThreadPool * pool = NULL) const;
+
+	unsigned int count() const { return liveCount; }
+	unsigned int capacity() const { return maxCount; }
+	void clear();
+
+	// Never shrinks
+	void reserve(unsigned int capacity);
+
+	ParticleOverflow overflowPolicy() const { return overflow; }
+	void setOverflowPolicy(ParticleOverflow policy) { overflow = policy; }
+
+	const ParticleStats & stats() const { return counters; }
+	void resetStats();
+
+	const glm::vec3 & gravity() const { return acceleration; }
+	void setGravity(const glm::vec3 & gravity) { acceleration = gravity; }
+
+	// The attributes, for count() particles
+	const float * positionX() const { return &x[0]; }
+	const float * positionY() const { return &y[0]; }
+	const float * positionZ() const { return &z[0]; }
+	const float * lifes() const     { return &life[0]; }
+	const float * sizes() const     { return &size[0]; }
+	const float * cameraDistances() const { return &distance[0]; } // As of the last sortBackToFront
+	const unsigned int * drawOrder() const { return sorted ? &order[0] : NULL; } // NULL : storage order
+
+private:
+	ParticleSystem(const ParticleSystem &);            // Not copyable
+	ParticleSystem & operator=(const ParticleSystem &);
+
+	void set(unsigned int i, const ParticleSpawn & particle);
+	void remove(unsigned int i);
+	unsigned int takeOldest();
+	void integrate(unsigned int begin, unsigned int end, float deltaTime);
+	void computeDistances(unsigned int begin, unsigned int end, const glm::vec3 & cameraPosition);
+	void fill(unsigned int begin, unsigned int end, float * positionSize, unsigned char * colors) const;
+	void radixSort(ThreadPool * pool);
+	bool incrementalSort();
+
+	unsigned int liveCount;
+	unsigned int maxCount;
+	ParticleOverflow overflow;
+	ParticleStats counters;
+	glm::vec3 acceleration;
+	bool sorted;
+	ParticleSortMode sorting;
+	unsigned int rankedCount; // Number of particles at the last incremental sort. 0 : ranks are not valid.
+	unsigned int radixFrames; // PARTICLES_SORT_INCREMENTAL didn't work : radix sorts only, for this many frames
+	unsigned int radixBackoff;
+
+	// One entry per particle, plus padding up to a multiple of 4 so that
+	// the SSE loops don't need a scalar tail
+	std::vector<float> x, y, z;
+	std::vector<float> vx, vy, vz;
+	std::vector<float> life;
+	std::vector<float> size;
+	std::vector<unsigned int> color; // r, g, b, a bytes, in this order in memory
+	std::vector<float> distance;     // Squared distance to the camera
+	std::vector<unsigned int> order; // Draw order : indices of particles
+	std::vector<unsigned int> rank;  // PARTICLES_SORT_INCREMENTAL : where the particle was in the last order. ~0u : new.
+
+	// For the sorts
+	std::vector<unsigned int> keys, keysTemp;
+	std::vector<unsigned int> orderTemp;
+
+	// update : the particles that died, for each block
+	std::vector< std::vector<unsigned int> > deadLists;
+
+	// PARTICLES_STEAL_OLDEST : the next particles to steal, the oldest at
+	// the end. Found all at once, 1/64 of the particles, so that stealing is
+	// O(1) on average. All the particles age at the same speed, so the list
+	// stays in order across updates : remove() only fixes the indices, with
+	// stealSlot (where each particle is in stealList, or ~0u).
+	std::vector<unsigned int> stealList;
+	std::vector<unsigned int> stealSlot;
+};
+
+// Several emitters at once : each one gets a job, which cuts its particles
+// in blocks (see above). Updates, then sorts back to front each one (they
+// are not sorted with each other : draw them one after the other).
+void updateParticleSystems(ParticleSystem * const * systems, unsigned int count, float deltaTime, const glm::vec3 & cameraPosition, ThreadPool * pool);
+
+// Fills the buffers with the particles of all the systems : the first ones
+// of systems[i] come just after the last ones of systems[i-1]. Returns the
+// number of particles written.
+unsigned int fillParticleBuffers(ParticleSystem * const * systems, unsigned int count, float * positionSize, unsigned char * colors, ThreadPool * pool);
+
+#endif
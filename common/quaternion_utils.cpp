@@ -1,3 +1,11 @@
+#include <stdio.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "sse2.hpp"
+
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/euler_angles.hpp>
@@ -98,7 +106,7 @@ quat RotateTowards(quat q1, quat q2, float maxAngle){
 		cosTheta *= -1.0f;
 	}
 	
-	float angle = acos(cosTheta);
+	float angle = acos(std::min(cosTheta, 1.0f)); // Rounding can give 1.0000001 for opposite quaternions
 	
 	// If there is only a 2 difference, and we are allowed 5,
 	// then we arrived.
@@ -106,9 +114,8 @@ quat RotateTowards(quat q1, quat q2, float maxAngle){
 		return q2;
 	}
 
-	// This is just like slerp(), but with a custom t
+	// This is just like slerp(), but with a custom t : the rotation is maxAngle
 	float t = maxAngle / angle;
-	angle = maxAngle;
 	
 	quat res = (sin((1.0f - t) * angle) * q1 + sin(t * angle) * q2) / sin(angle);
 	res = normalize(res);
@@ -118,24 +125,465 @@ quat RotateTowards(quat q1, quat q2, float maxAngle){
 
 
 
+// Batch versions. The kernels are written once, on Float4 (4 floats), which
+// is an SSE register when SSE2 is there, and a plain array otherwise.
+
+#ifdef COMMON_SSE2
+
+typedef __m128 Float4;
+typedef __m128 Mask4;
+
+static inline Float4 load4(const float * p){ return _mm_loadu_ps(p); }
+static inline void store4(float * p, Float4 a){ _mm_storeu_ps(p, a); }
+static inline Float4 set4(float a){ return _mm_set1_ps(a); }
+static inline Float4 add(Float4 a, Float4 b){ return _mm_add_ps(a, b); }
+static inline Float4 sub(Float4 a, Float4 b){ return _mm_sub_ps(a, b); }
+static inline Float4 mul(Float4 a, Float4 b){ return _mm_mul_ps(a, b); }
+static inline Float4 div(Float4 a, Float4 b){ return _mm_div_ps(a, b); }
+static inline Float4 sqrt4(Float4 a){ return _mm_sqrt_ps(a); }
+static inline Float4 min4(Float4 a, Float4 b){ return _mm_min_ps(a, b); }
+static inline Mask4 less(Float4 a, Float4 b){ return _mm_cmplt_ps(a, b); }
+static inline Mask4 either(Mask4 a, Mask4 b){ return _mm_or_ps(a, b); }
+static inline Mask4 both(Mask4 a, Mask4 b){ return _mm_and_ps(a, b); }
+static inline Mask4 notMask(Mask4 a){ return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+static inline Float4 select(Mask4 m, Float4 a, Float4 b){ return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); } // m ? a : b
+static inline int maskBits(Mask4 m){ return _mm_movemask_ps(m); } // Bit i : lane i
+
+#else
+
+struct Float4{ float v[4]; };
+struct Mask4{ bool v[4]; };
+
+static inline Float4 load4(const float * p){ Float4 r; for (int i=0; i<4; i++) r.v[i] = p[i]; return r; }
+static inline void store4(float * p, Float4 a){ for (int i=0; i<4; i++) p[i] = a.v[i]; }
+static inline Float4 set4(float a){ Float4 r; for (int i=0; i<4; i++) r.v[i] = a; return r; }
+static inline Float4 add(Float4 a, Float4 b){ for (int i=0; i<4; i++) a.v[i] += b.v[i]; return a; }
+static inline Float4 sub(Float4 a, Float4 b){ for (int i=0; i<4; i++) a.v[i] -= b.v[i]; return a; }
+static inline Float4 mul(Float4 a, Float4 b){ for (int i=0; i<4; i++) a.v[i] *= b.v[i]; return a; }
+static inline Float4 div(Float4 a, Float4 b){ for (int i=0; i<4; i++) a.v[i] /= b.v[i]; return a; }
+static inline Float4 sqrt4(Float4 a){ for (int i=0; i<4; i++) a.v[i] = sqrt(a.v[i]); return a; }
+static inline Float4 min4(Float4 a, Float4 b){ for (int i=0; i<4; i++) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+static inline Mask4 less(Float4 a, Float4 b){ Mask4 r; for (int i=0; i<4; i++) r.v[i] = a.v[i] < b.v[i]; return r; }
+static inline Mask4 either(Mask4 a, Mask4 b){ for (int i=0; i<4; i++) a.v[i] = a.v[i] || b.v[i]; return a; }
+static inline Mask4 both(Mask4 a, Mask4 b){ for (int i=0; i<4; i++) a.v[i] = a.v[i] && b.v[i]; return a; }
+static inline Mask4 notMask(Mask4 a){ for (int i=0; i<4; i++) a.v[i] = !a.v[i]; return a; }
+static inline Float4 select(Mask4 m, Float4 a, Float4 b){ for (int i=0; i<4; i++) a.v[i] = m.v[i] ? a.v[i] : b.v[i]; return a; }
+static inline int maskBits(Mask4 m){ int r = 0; for (int i=0; i<4; i++) r |= m.v[i] << i; return r; }
+
+#endif
+
+static inline Float4 dot3(Float4 ax, Float4 ay, Float4 az, Float4 bx, Float4 by, Float4 bz){
+	return add(add(mul(ax, bx), mul(ay, by)), mul(az, bz));
+}
+
+static inline void cross3(Float4 ax, Float4 ay, Float4 az, Float4 bx, Float4 by, Float4 bz, Float4 & x, Float4 & y, Float4 & z){
+	x = sub(mul(ay, bz), mul(az, by));
+	y = sub(mul(az, bx), mul(ax, bz));
+	z = sub(mul(ax, by), mul(ay, bx));
+}
+
+static inline void normalize3(Float4 & x, Float4 & y, Float4 & z){
+	Float4 invLength = div(set4(1.0f), sqrt4(dot3(x, y, z, x, y, z)));
+	x = mul(x, invLength);
+	y = mul(y, invLength);
+	z = mul(z, invLength);
+}
+
+// 4 quaternions, or 4 vectors (w unused)
+struct Quat4{ Float4 w, x, y, z; };
+
+static inline Quat4 loadQuat(const QuatArrays & q, size_t i){
+	Quat4 r = { load4(q.w + i), load4(q.x + i), load4(q.y + i), load4(q.z + i) };
+	return r;
+}
+
+static inline void storeQuat(const QuatArrays & q, size_t i, const Quat4 & r){
+	store4(q.w + i, r.w); store4(q.x + i, r.x); store4(q.y + i, r.y); store4(q.z + i, r.z);
+}
+
+static inline Quat4 selectQuat(Mask4 m, const Quat4 & a, const Quat4 & b){
+	Quat4 r = { select(m, a.w, b.w), select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z) };
+	return r;
+}
+
+static inline Float4 dot4(const Quat4 & a, const Quat4 & b){
+	return add(add(mul(a.w, b.w), mul(a.x, b.x)), add(mul(a.y, b.y), mul(a.z, b.z)));
+}
+
+static inline Quat4 normalize4(const Quat4 & q){
+	Float4 invLength = div(set4(1.0f), sqrt4(dot4(q, q)));
+	Quat4 r = { mul(q.w, invLength), mul(q.x, invLength), mul(q.y, invLength), mul(q.z, invLength) };
+	return r;
+}
+
+// a*b, like glm
+static inline Quat4 multiply4(const Quat4 & a, const Quat4 & b){
+	Quat4 r;
+	r.w = sub(sub(mul(a.w, b.w), mul(a.x, b.x)), add(mul(a.y, b.y), mul(a.z, b.z)));
+	r.x = add(add(mul(a.w, b.x), mul(a.x, b.w)), sub(mul(a.y, b.z), mul(a.z, b.y)));
+	r.y = add(add(mul(a.w, b.y), mul(a.y, b.w)), sub(mul(a.z, b.x), mul(a.x, b.z)));
+	r.z = add(add(mul(a.w, b.z), mul(a.z, b.w)), sub(mul(a.x, b.y), mul(a.y, b.x)));
+	return r;
+}
+
+// RotationBetweenVectors, without the special case : the lanes where start
+// and dest are opposite are in opposite, and must be done with the scalar version.
+static inline Quat4 rotationBetween4(Float4 sx, Float4 sy, Float4 sz, Float4 dx, Float4 dy, Float4 dz, Mask4 & opposite){
+	normalize3(sx, sy, sz);
+	normalize3(dx, dy, dz);
+
+	Float4 cosTheta = dot3(sx, sy, sz, dx, dy, dz);
+	opposite = less(cosTheta, set4(-1 + 0.001f));
+
+	Quat4 r;
+	cross3(sx, sy, sz, dx, dy, dz, r.x, r.y, r.z);
+	Float4 s = sqrt4(mul(add(set4(1.0f), cosTheta), set4(2.0f)));
+	Float4 invs = div(set4(1.0f), s);
+	r.w = mul(s, set4(0.5f));
+	r.x = mul(r.x, invs);
+	r.y = mul(r.y, invs);
+	r.z = mul(r.z, invs);
+	return r;
+}
+
+// acos(x) for 0 <= x <= 1, within 2e-8 (Abramowitz and Stegun, 4.4.46)
+static inline Float4 acos4(Float4 x){
+	Float4 p = set4(-0.0012624911f);
+	p = add(mul(p, x), set4( 0.0066700901f));
+	p = add(mul(p, x), set4(-0.0170881256f));
+	p = add(mul(p, x), set4( 0.0308918810f));
+	p = add(mul(p, x), set4(-0.0501743046f));
+	p = add(mul(p, x), set4( 0.0889789874f));
+	p = add(mul(p, x), set4(-0.2145988016f));
+	p = add(mul(p, x), set4( 1.5707963050f));
+	return mul(p, sqrt4(sub(set4(1.0f), x)));
+}
+
+// Eberly's polynomial : sin(t*angle)/sin(angle) = t * (1 + b1*(1 + b2*(1 + ...)))
+// with bi = (t*t/(i*(2i+1)) - i/(2i+1)) * (cos(angle) - 1). 12 terms, and a
+// correction of the last one, give an error below 1e-6 for all angles.
+struct SlerpCoefficients{
+	enum { Count = 12 };
+	float u[Count], v[Count];
+
+	SlerpCoefficients(){
+		const double onePlusMu = 1.894; // Minimizes the maximum error with 12 terms
+		for ( int i=1; i<=Count; i++ ){
+			double correction = i == Count ? onePlusMu : 1.0;
+			u[i-1] = float(correction / (i * (2.0*i + 1.0)));
+			v[i-1] = float(correction * i / (2.0*i + 1.0));
+		}
+	}
+};
+
+static const SlerpCoefficients & slerpCoefficients(){
+	static SlerpCoefficients coefficients;
+	return coefficients;
+}
+
+// The weights of q1 and q2 in slerp, for cosTheta = x >= 0
+static inline void slerpWeights4(Float4 x, Float4 t, Float4 & w1, Float4 & w2){
+	const SlerpCoefficients & c = slerpCoefficients();
+
+	Float4 xm1 = sub(x, set4(1.0f));
+	Float4 d = sub(set4(1.0f), t);
+	Float4 sqrT = mul(t, t);
+	Float4 sqrD = mul(d, d);
+
+	Float4 one = set4(1.0f);
+	Float4 f1 = one, f2 = one;
+	for ( int i=SlerpCoefficients::Count-1; i>=0; i-- ){
+		Float4 u = set4(c.u[i]), v = set4(c.v[i]);
+		Float4 bT = mul(sub(mul(u, sqrT), v), xm1);
+		Float4 bD = mul(sub(mul(u, sqrD), v), xm1);
+		f2 = add(one, mul(bT, f2));
+		f1 = add(one, mul(bD, f1));
+	}
+	w1 = mul(d, f1);
+	w2 = mul(t, f2);
+}
+
+// The last count % 4 elements go through the same kernels : they are copied
+// in arrays of 4 (the missing ones are copies of the last one), and back.
+struct Tail4{
+	float data[8][4];
+
+	// Arrays of 4 in data, with elements first...first+count-1 of arrays
+	void load(float * const * arrays, int arrayCount, size_t first, size_t count, float ** out){
+		for ( int a=0; a<arrayCount; a++ ){
+			for ( int i=0; i<4; i++ )
+				data[a][i] = arrays[a][first + (i < (int)count ? i : count - 1)];
+			out[a] = data[a];
+		}
+	}
+	static void store(float * const * tails, float * const * arrays, int arrayCount, size_t first, size_t count){
+		for ( int a=0; a<arrayCount; a++ )
+			for ( size_t i=0; i<count; i++ )
+				arrays[a][first + i] = tails[a][i];
+	}
+};
+
+static void RotationBetweenVectors4(Vec3Arrays start, Vec3Arrays dest, QuatArrays out, size_t i){
+	Mask4 opposite;
+	Quat4 r = rotationBetween4(
+		load4(start.x + i), load4(start.y + i), load4(start.z + i),
+		load4(dest.x + i), load4(dest.y + i), load4(dest.z + i),
+		opposite);
+
+	// Rare : do them one by one
+	int special = maskBits(opposite);
+	vec3 starts[4], dests[4];
+	for ( int lane=0; lane<4; lane++ ){
+		if ( special & (1 << lane) ){
+			starts[lane] = vec3(start.x[i+lane], start.y[i+lane], start.z[i+lane]);
+			dests[lane] = vec3(dest.x[i+lane], dest.y[i+lane], dest.z[i+lane]);
+		}
+	}
+	storeQuat(out, i, r);
+	for ( int lane=0; lane<4; lane++ ){
+		if ( special & (1 << lane) ){
+			quat q = RotationBetweenVectors(starts[lane], dests[lane]);
+			out.w[i+lane] = q.w; out.x[i+lane] = q.x; out.y[i+lane] = q.y; out.z[i+lane] = q.z;
+		}
+	}
+}
+
+void RotationBetweenVectors(Vec3Arrays start, Vec3Arrays dest, QuatArrays out, size_t count){
+	size_t i = 0;
+	for ( ; i+4 <= count; i += 4 )
+		RotationBetweenVectors4(start, dest, out, i);
+	if ( i < count ){
+		float * arrays[10] = { start.x, start.y, start.z, dest.x, dest.y, dest.z, out.w, out.x, out.y, out.z };
+		float * tails[10];
+		Tail4 inputs, outputs;
+		inputs.load(arrays, 6, i, count - i, tails);
+		outputs.load(arrays + 6, 4, i, count - i, tails + 6);
+		Vec3Arrays s = { tails[0], tails[1], tails[2] };
+		Vec3Arrays d = { tails[3], tails[4], tails[5] };
+		QuatArrays o = { tails[6], tails[7], tails[8], tails[9] };
+		RotationBetweenVectors4(s, d, o, 0);
+		Tail4::store(tails + 6, arrays + 6, 4, i, count - i);
+	}
+}
+
+static void LookAt4(Vec3Arrays direction, Vec3Arrays desiredUp, QuatArrays out, size_t i){
+	Float4 dx = load4(direction.x + i), dy = load4(direction.y + i), dz = load4(direction.z + i);
+	Float4 ux = load4(desiredUp.x + i), uy = load4(desiredUp.y + i), uz = load4(desiredUp.z + i);
+
+	Mask4 tooSmall = less(dot3(dx, dy, dz, dx, dy, dz), set4(0.0001f));
 
+	// Recompute desiredUp so that it's perpendicular to the direction
+	Float4 rx, ry, rz;
+	cross3(dx, dy, dz, ux, uy, uz, rx, ry, rz);
+	cross3(rx, ry, rz, dx, dy, dz, ux, uy, uz);
+
+	// From +Z to the direction
+	Mask4 opposite1;
+	Float4 zero = set4(0.0f), one = set4(1.0f);
+	Quat4 rot1 = rotationBetween4(zero, zero, one, dx, dy, dz, opposite1);
+
+	// newUp = rot1 * (0, 1, 0)
+	Float4 uvx, uvy, uvz, uuvx, uuvy, uuvz;
+	cross3(rot1.x, rot1.y, rot1.z, zero, one, zero, uvx, uvy, uvz);
+	cross3(rot1.x, rot1.y, rot1.z, uvx, uvy, uvz, uuvx, uuvy, uuvz);
+	Float4 twoW = mul(rot1.w, set4(2.0f)), two = set4(2.0f);
+	Float4 nx = add(mul(uvx, twoW), mul(uuvx, two));
+	Float4 ny = add(add(one, mul(uvy, twoW)), mul(uuvy, two));
+	Float4 nz = add(mul(uvz, twoW), mul(uuvz, two));
+
+	// From newUp to the desired up
+	Mask4 opposite2;
+	Quat4 rot2 = rotationBetween4(nx, ny, nz, ux, uy, uz, opposite2);
+
+	Quat4 identity = { one, zero, zero, zero };
+	Quat4 r = selectQuat(tooSmall, identity, multiply4(rot2, rot1));
+
+	// When one of the rotations is a half turn : one by one
+	int special = maskBits(both(either(opposite1, opposite2), notMask(tooSmall)));
+	vec3 directions[4], ups[4];
+	for ( int lane=0; lane<4; lane++ ){
+		if ( special & (1 << lane) ){
+			directions[lane] = vec3(direction.x[i+lane], direction.y[i+lane], direction.z[i+lane]);
+			ups[lane] = vec3(desiredUp.x[i+lane], desiredUp.y[i+lane], desiredUp.z[i+lane]);
+		}
+	}
+	storeQuat(out, i, r);
+	for ( int lane=0; lane<4; lane++ ){
+		if ( special & (1 << lane) ){
+			quat q = LookAt(directions[lane], ups[lane]);
+			out.w[i+lane] = q.w; out.x[i+lane] = q.x; out.y[i+lane] = q.y; out.z[i+lane] = q.z;
+		}
+	}
+}
 
+void LookAt(Vec3Arrays direction, Vec3Arrays desiredUp, QuatArrays out, size_t count){
+	size_t i = 0;
+	for ( ; i+4 <= count; i += 4 )
+		LookAt4(direction, desiredUp, out, i);
+	if ( i < count ){
+		float * arrays[10] = { direction.x, direction.y, direction.z, desiredUp.x, desiredUp.y, desiredUp.z, out.w, out.x, out.y, out.z };
+		float * tails[10];
+		Tail4 inputs, outputs;
+		inputs.load(arrays, 6, i, count - i, tails);
+		outputs.load(arrays + 6, 4, i, count - i, tails + 6);
+		Vec3Arrays d = { tails[0], tails[1], tails[2] };
+		Vec3Arrays u = { tails[3], tails[4], tails[5] };
+		QuatArrays o = { tails[6], tails[7], tails[8], tails[9] };
+		LookAt4(d, u, o, 0);
+		Tail4::store(tails + 6, arrays + 6, 4, i, count - i);
+	}
+}
 
+// The kernels of the functions that take two arrays of quaternions
+enum QuatKernel{ KERNEL_ROTATE_TOWARDS, KERNEL_NLERP, KERNEL_SLERP };
 
+static inline void quatKernel4(QuatKernel kernel, QuatArrays q1s, QuatArrays q2s, float parameter, QuatArrays out, size_t i){
+	Quat4 q1 = loadQuat(q1s, i);
+	Quat4 q2 = loadQuat(q2s, i);
+	Float4 zero = set4(0.0f), one = set4(1.0f);
 
+	// Avoid taking the long path around the sphere
+	Float4 cosTheta = dot4(q1, q2);
+	Float4 signedCosTheta = cosTheta;
+	Mask4 negative = less(cosTheta, zero);
+	Float4 sign = select(negative, set4(-1.0f), one);
+	cosTheta = mul(cosTheta, sign);
+	Quat4 flipped = { mul(q1.w, sign), mul(q1.x, sign), mul(q1.y, sign), mul(q1.z, sign) };
+
+	Quat4 r;
+	if ( kernel == KERNEL_NLERP ){
+		Float4 t = set4(parameter), d = set4(1.0f - parameter);
+		Quat4 mixed = {
+			add(mul(flipped.w, d), mul(q2.w, t)), add(mul(flipped.x, d), mul(q2.x, t)),
+			add(mul(flipped.y, d), mul(q2.y, t)), add(mul(flipped.z, d), mul(q2.z, t))
+		};
+		r = normalize4(mixed);
+
+	}else if ( kernel == KERNEL_SLERP ){
+		Float4 w1, w2;
+		slerpWeights4(min4(cosTheta, one), set4(parameter), w1, w2);
+		Quat4 mixed = {
+			add(mul(flipped.w, w1), mul(q2.w, w2)), add(mul(flipped.x, w1), mul(q2.x, w2)),
+			add(mul(flipped.y, w1), mul(q2.y, w2)), add(mul(flipped.z, w1), mul(q2.z, w2))
+		};
+		r = mixed;
+
+	}else{
+		// RotateTowards : q2 if they are already equal, or if it's less than maxAngle away
+		Float4 maxAngle = set4(parameter);
+		Float4 angle = acos4(min4(cosTheta, one));
+		Mask4 arrived = either(less(set4(0.9999f), signedCosTheta), less(angle, maxAngle));
+
+		// This is just like slerp(), but with a custom t
+		Float4 w1, w2;
+		slerpWeights4(min4(cosTheta, one), div(maxAngle, angle), w1, w2);
+		Quat4 mixed = {
+			add(mul(flipped.w, w1), mul(q2.w, w2)), add(mul(flipped.x, w1), mul(q2.x, w2)),
+			add(mul(flipped.y, w1), mul(q2.y, w2)), add(mul(flipped.z, w1), mul(q2.z, w2))
+		};
+		r = selectQuat(arrived, q2, normalize4(mixed));
+	}
+	storeQuat(out, i, r);
+}
 
+static void runQuatKernel(QuatKernel kernel, QuatArrays q1, QuatArrays q2, float parameter, QuatArrays out, size_t count){
+	size_t i = 0;
+	for ( ; i+4 <= count; i += 4 )
+		quatKernel4(kernel, q1, q2, parameter, out, i);
+	if ( i < count ){
+		float * arrays[12] = { q1.w, q1.x, q1.y, q1.z, q2.w, q2.x, q2.y, q2.z, out.w, out.x, out.y, out.z };
+		float * tails[12];
+		Tail4 inputs, outputs;
+		inputs.load(arrays, 8, i, count - i, tails);
+		outputs.load(arrays + 8, 4, i, count - i, tails + 8);
+		QuatArrays a = { tails[0], tails[1], tails[2], tails[3] };
+		QuatArrays b = { tails[4], tails[5], tails[6], tails[7] };
+		QuatArrays o = { tails[8], tails[9], tails[10], tails[11] };
+		quatKernel4(kernel, a, b, parameter, o, 0);
+		Tail4::store(tails + 8, arrays + 8, 4, i, count - i);
+	}
+}
 
+void RotateTowards(QuatArrays q1, QuatArrays q2, float maxAngle, QuatArrays out, size_t count){
+	if ( maxAngle < 0.001f ){
+		// No rotation allowed
+		for ( size_t i=0; i<count; i++ ){
+			out.w[i] = q1.w[i]; out.x[i] = q1.x[i]; out.y[i] = q1.y[i]; out.z[i] = q1.z[i];
+		}
+		return;
+	}
+	runQuatKernel(KERNEL_ROTATE_TOWARDS, q1, q2, maxAngle, out, count);
+}
 
+void Nlerp(QuatArrays q1, QuatArrays q2, float t, QuatArrays out, size_t count){
+	runQuatKernel(KERNEL_NLERP, q1, q2, t, out, count);
+}
 
+void Slerp(QuatArrays q1, QuatArrays q2, float t, QuatArrays out, size_t count){
+	runQuatKernel(KERNEL_SLERP, q1, q2, t, out, count);
+}
 
 
 
 
+static bool near(float a, float b, float epsilon = 1e-4f){
+	return fabs(a - b) < epsilon;
+}
 
+static bool near(quat a, quat b, float epsilon = 1e-4f){
+	return near(a.w, b.w, epsilon) && near(a.x, b.x, epsilon) && near(a.y, b.y, epsilon) && near(a.z, b.z, epsilon);
+}
+
+// The same rotation : q and -q are
+static bool sameRotation(quat a, quat b, float epsilon = 1e-4f){
+	return near(a, b, epsilon) || near(a, b * -1.0f, epsilon);
+}
+
+// Deterministic random numbers between -1 and 1
+static float random11(unsigned int & seed){
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
 
+static quat randomQuat(unsigned int & seed){
+	quat q(random11(seed), random11(seed), random11(seed), random11(seed));
+	return normalize(q);
+}
+
+// Room for count quaternions or vectors, in Structures of Arrays
+struct SoAStorage{
+	std::vector<float> data[4];
+	SoAStorage(size_t count){ for (int i=0; i<4; i++) data[i].resize(count); }
+	QuatArrays quats(){ QuatArrays q = { &data[0][0], &data[1][0], &data[2][0], &data[3][0] }; return q; }
+	Vec3Arrays vecs(){ Vec3Arrays v = { &data[0][0], &data[1][0], &data[2][0] }; return v; }
+	quat getQuat(size_t i) const { return quat(data[0][i], data[1][i], data[2][i], data[3][i]); }
+	vec3 getVec(size_t i) const { return vec3(data[0][i], data[1][i], data[2][i]); }
+	void setQuat(size_t i, quat q){ data[0][i] = q.w; data[1][i] = q.x; data[2][i] = q.y; data[3][i] = q.z; }
+	void setVec(size_t i, vec3 v){ data[0][i] = v.x; data[1][i] = v.y; data[2][i] = v.z; }
+};
+
+// Reference slerp, on the short path, in double
+static quat referenceSlerp(quat a, quat b, float t){
+	double c = (double)a.w*b.w + (double)a.x*b.x + (double)a.y*b.y + (double)a.z*b.z;
+	double sign = c < 0 ? -1.0 : 1.0;
+	c = std::min(1.0, c * sign);
+	double angle = acos(c);
+	double w1 = angle < 1e-9 ? 1.0 - t : sin((1.0 - t) * angle) / sin(angle);
+	double w2 = angle < 1e-9 ? t : sin(t * angle) / sin(angle);
+	return quat(
+		float(sign*w1*a.w + w2*b.w), float(sign*w1*a.x + w2*b.x),
+		float(sign*w1*a.y + w2*b.y), float(sign*w1*a.z + w2*b.z)
+	);
+}
 
+// Like assert, but also in release builds : prints the check that failed (the
+// first ones only) and carries on
+#define QUATERNION_CHECK(condition) \
+	do{ if ( !(condition) && failures++ < 10 ) printf("quaternionTests, line %d : %s\n", __LINE__, #condition); }while(0)
 
-void tests(){
+bool quaternionTests(){
+
+	unsigned int failures = 0;
 
 	glm::vec3 Xpos(+1.0f,  0.0f,  0.0f);
 	glm::vec3 Ypos( 0.0f, +1.0f,  0.0f);
@@ -147,18 +595,94 @@ void tests(){
 	// Testing standard, easy case
 	// Must be 90 rotation on X : 0.7 0 0 0.7
 	quat X90rot = RotationBetweenVectors(Ypos, Zpos);
+	QUATERNION_CHECK( near(X90rot, quat(0.70710678f, 0.70710678f, 0.0f, 0.0f)) );
 	
 	// Testing with v1 = v2
 	// Must be identity : 0 0 0 1
 	quat id = RotationBetweenVectors(Xpos, Xpos);
+	QUATERNION_CHECK( near(id, quat(1.0f, 0.0f, 0.0f, 0.0f)) );
 	
 	// Testing with v1 = -v2
 	// Must be 180 on +/-Y axis : 0 +/-1 0 0
 	quat Y180rot = RotationBetweenVectors(Xpos, Xneg);
+	QUATERNION_CHECK( sameRotation(Y180rot, quat(0.0f, 0.0f, 1.0f, 0.0f)) );
 	
 	// Testing with v1 = -v2, but with a "bad first guess"
 	// Must be 180 on +/-Y axis : 0 +/-1 0 0
 	quat X180rot = RotationBetweenVectors(Zpos, Zneg);
-	
+	QUATERNION_CHECK( sameRotation(X180rot, quat(0.0f, 0.0f, 1.0f, 0.0f)) );
+
+	// The object (toward +Z, up +Y) looks toward -X, up stays up
+	quat look = LookAt(Xneg, Ypos);
+	QUATERNION_CHECK( length(look * Zpos - Xneg) < 1e-4f && length(look * Ypos - Ypos) < 1e-4f );
+
+	// Ypos is not perpendicular to the direction : the up is only as close as possible
+	look = LookAt(vec3(1.0f, 1.0f, 0.0f), Ypos);
+	QUATERNION_CHECK( length(look * Zpos - normalize(vec3(1.0f, 1.0f, 0.0f))) < 1e-4f && length(look * Ypos - normalize(vec3(-1.0f, 1.0f, 0.0f))) < 1e-4f );
+
+	// Half way : 45 on X, then the rest
+	quat towards = RotateTowards(id, X90rot, radians(45.0f) / 2.0f);
+	QUATERNION_CHECK( sameRotation(towards, angleAxis(45.0f, Xpos)) );
+	QUATERNION_CHECK( sameRotation(RotateTowards(id, X90rot, 1.0f), X90rot) );
+	QUATERNION_CHECK( sameRotation(RotateTowards(id, X90rot, 0.0f), id) );
+
+	// The batch versions give the same results, including the special cases
+	// and the elements that don't make a multiple of 4
+	const size_t count = 1003;
+	unsigned int seed = 1;
+	SoAStorage starts(count), dests(count), q1s(count), q2s(count), out(count);
+	for ( size_t i=0; i<count; i++ ){
+		vec3 start(random11(seed), random11(seed), random11(seed));
+		vec3 dest(random11(seed), random11(seed), random11(seed));
+		if ( i % 17 == 0 ) dest = -start;             // Opposite
+		if ( i % 19 == 0 ) start = Zneg, dest = Ypos;  // LookAt toward -Z : a half turn
+		if ( i % 23 == 0 ) start = vec3(0.0f);         // LookAt without direction
+		if ( i % 29 == 0 ) dest = start * 2.0f;        // Same direction
+		starts.setVec(i, start);
+		dests.setVec(i, dest);
+		q1s.setQuat(i, randomQuat(seed));
+		q2s.setQuat(i, i % 31 == 0 ? q1s.getQuat(i) * -1.0f : randomQuat(seed));
+	}
+
+	RotationBetweenVectors(starts.vecs(), dests.vecs(), out.quats(), count);
+	for ( size_t i=0; i<count; i++ )
+		if ( length2(starts.getVec(i)) > 0.0f )
+			QUATERNION_CHECK( near(out.getQuat(i), RotationBetweenVectors(starts.getVec(i), dests.getVec(i))) );
+
+	LookAt(starts.vecs(), dests.vecs(), out.quats(), count);
+	for ( size_t i=0; i<count; i++ )
+		if ( i % 17 != 0 && i % 29 != 0 ) // Up parallel to the direction : undefined (NaN)
+			QUATERNION_CHECK( near(out.getQuat(i), LookAt(starts.getVec(i), dests.getVec(i))) );
+
+	float maxAngles[3] = { 0.0f, 0.1f, 1.0f };
+	for ( int m=0; m<3; m++ ){
+		RotateTowards(q1s.quats(), q2s.quats(), maxAngles[m], out.quats(), count);
+		for ( size_t i=0; i<count; i++ )
+			QUATERNION_CHECK( near(out.getQuat(i), RotateTowards(q1s.getQuat(i), q2s.getQuat(i), maxAngles[m])) );
+	}
 
-}
\ No newline at end of file
+	float ts[4] = { 0.0f, 0.3f, 0.5f, 1.0f };
+	for ( int k=0; k<4; k++ ){
+		Slerp(q1s.quats(), q2s.quats(), ts[k], out.quats(), count);
+		for ( size_t i=0; i<count; i++ )
+			QUATERNION_CHECK( near(out.getQuat(i), referenceSlerp(q1s.getQuat(i), q2s.getQuat(i), ts[k]), 2e-6f) );
+
+		Nlerp(q1s.quats(), q2s.quats(), ts[k], out.quats(), count);
+		for ( size_t i=0; i<count; i++ ){
+			quat q = out.getQuat(i);
+			QUATERNION_CHECK( near(length(q), 1.0f) );
+			// Not at the same speed, but on the same arc
+			QUATERNION_CHECK( near(fabs(dot(q, referenceSlerp(q1s.getQuat(i), q2s.getQuat(i), ts[k]))), 1.0f, 0.01f) );
+		}
+	}
+
+	// In place
+	SoAStorage copy = q1s;
+	Slerp(copy.quats(), q2s.quats(), 0.5f, copy.quats(), count);
+	Slerp(q1s.quats(), q2s.quats(), 0.5f, out.quats(), count);
+	QUATERNION_CHECK( copy.data[0] == out.data[0] && copy.data[3] == out.data[3] );
+
+	if ( failures > 0 )
+		printf("quaternionTests : %u checks failed\n", failures);
+	return failures == 0;
+}
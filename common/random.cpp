@@ -0,0 +1,216 @@
+#include <math.h>
+
+#include "sse2.hpp"
+
+#include "random.hpp"
+
+// Philox4x32 constants
+static const unsigned int PhiloxM0 = 0xD2511F53;
+static const unsigned int PhiloxM1 = 0xCD9E8D57;
+static const unsigned int PhiloxW0 = 0x9E3779B9; // Added to the key after each round
+static const unsigned int PhiloxW1 = 0xBB67AE85;
+static const int PhiloxRounds = 10;
+
+static const float TwoPi = 6.28318530718f;
+
+void philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int result[4]){
+	unsigned int c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	unsigned int k0 = key[0], k1 = key[1];
+	for ( int round=0; round<PhiloxRounds; round++ ){
+		unsigned long long p0 = (unsigned long long)PhiloxM0 * c0;
+		unsigned long long p1 = (unsigned long long)PhiloxM1 * c2;
+		unsigned int n0 = (unsigned int)(p1 >> 32) ^ c1 ^ k0;
+		unsigned int n2 = (unsigned int)(p0 >> 32) ^ c3 ^ k1;
+		c1 = (unsigned int)p1;
+		c3 = (unsigned int)p0;
+		c0 = n0;
+		c2 = n2;
+		k0 += PhiloxW0;
+		k1 += PhiloxW1;
+	}
+	result[0] = c0; result[1] = c1; result[2] = c2; result[3] = c3;
+}
+
+#ifdef COMMON_SSE2
+// High and low 32 bits of a*m, for the 4 lanes
+static inline void mulHiLo(__m128i a, __m128i m, __m128i & hi, __m128i & lo){
+	__m128i p02 = _mm_mul_epu32(a, m);                     // Lanes 0 and 2, 64 bits each
+	__m128i p13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), m); // Lanes 1 and 3
+	p02 = _mm_shuffle_epi32(p02, _MM_SHUFFLE(3,1,2,0));    // lo0 lo2 hi0 hi2
+	p13 = _mm_shuffle_epi32(p13, _MM_SHUFFLE(3,1,2,0));    // lo1 lo3 hi1 hi3
+	lo = _mm_unpacklo_epi32(p02, p13);
+	hi = _mm_unpackhi_epi32(p02, p13);
+}
+
+// Blocks block ... block+3, one per lane, written one after the other to result
+static void philox4x32x4(unsigned long long block, unsigned long long stream, unsigned long long seed, unsigned int * result){
+	unsigned long long b1 = block+1, b2 = block+2, b3 = block+3;
+	__m128i c0 = _mm_set_epi32((int)b3, (int)b2, (int)b1, (int)block);
+	__m128i c1 = _mm_set_epi32((int)(b3 >> 32), (int)(b2 >> 32), (int)(b1 >> 32), (int)(block >> 32));
+	__m128i c2 = _mm_set1_epi32((int)stream);
+	__m128i c3 = _mm_set1_epi32((int)(stream >> 32));
+	unsigned int k0 = (unsigned int)seed, k1 = (unsigned int)(seed >> 32);
+	const __m128i m0 = _mm_set1_epi32((int)PhiloxM0);
+	const __m128i m1 = _mm_set1_epi32((int)PhiloxM1);
+	for ( int round=0; round<PhiloxRounds; round++ ){
+		__m128i hi0, lo0, hi1, lo1;
+		mulHiLo(c0, m0, hi0, lo0);
+		mulHiLo(c2, m1, hi1, lo1);
+		c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+		c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+		c1 = lo1;
+		c3 = lo0;
+		k0 += PhiloxW0;
+		k1 += PhiloxW1;
+	}
+	// Lane i of c0..c3 is block i : transpose
+	__m128i t0 = _mm_unpacklo_epi32(c0, c1);
+	__m128i t1 = _mm_unpacklo_epi32(c2, c3);
+	__m128i t2 = _mm_unpackhi_epi32(c0, c1);
+	__m128i t3 = _mm_unpackhi_epi32(c2, c3);
+	_mm_storeu_si128((__m128i*)(result   ), _mm_unpacklo_epi64(t0, t1));
+	_mm_storeu_si128((__m128i*)(result+ 4), _mm_unpackhi_epi64(t0, t1));
+	_mm_storeu_si128((__m128i*)(result+ 8), _mm_unpacklo_epi64(t2, t3));
+	_mm_storeu_si128((__m128i*)(result+12), _mm_unpackhi_epi64(t2, t3));
+}
+#endif
+
+glm::vec3 sphereDirection(float u, float v){
+	float z = 1.0f - 2.0f*u;
+	float r = sqrtf(fmaxf(0.0f, 1.0f - z*z));
+	float phi = TwoPi * v;
+	return glm::vec3(r*cosf(phi), r*sinf(phi), z);
+}
+
+glm::vec3 coneDirection(const glm::vec3 & axis, float angle, float u, float v){
+	// Uniform in cos(theta) is uniform over the area of the cap
+	float cosTheta = 1.0f - u*(1.0f - cosf(angle));
+	float sinTheta = sqrtf(fmaxf(0.0f, 1.0f - cosTheta*cosTheta));
+	float phi = TwoPi * v;
+	float lx = sinTheta*cosf(phi);
+	float ly = sinTheta*sinf(phi);
+
+	// Two vectors perpendicular to axis, without a branch on which component
+	// is the smallest (Duff et al., "Building an orthonormal basis, revisited")
+	float sign = axis.z >= 0.0f ? 1.0f : -1.0f;
+	float a = -1.0f / (sign + axis.z);
+	float b = axis.x * axis.y * a;
+	glm::vec3 tangent(1.0f + sign*axis.x*axis.x*a, sign*b, -sign*axis.x);
+	glm::vec3 bitangent(b, sign + axis.y*axis.y*a, -axis.y);
+
+	return tangent*lx + bitangent*ly + axis*cosTheta;
+}
+
+RandomGenerator::RandomGenerator(unsigned long long seed, unsigned long long stream)
+	: key(seed), streamId(stream), block(0), buffered(0)
+{
+}
+
+void RandomGenerator::refill(){
+	unsigned int counter[4] = { (unsigned int)block, (unsigned int)(block >> 32), (unsigned int)streamId, (unsigned int)(streamId >> 32) };
+	unsigned int k[2] = { (unsigned int)key, (unsigned int)(key >> 32) };
+	philox4x32(counter, k, buffer);
+	block++;
+	buffered = 4;
+}
+
+unsigned int RandomGenerator::next(){
+	if ( buffered == 0 )
+		refill();
+	return buffer[4 - buffered--];
+}
+
+float RandomGenerator::uniform(){
+	return uniformFloat(next());
+}
+
+float RandomGenerator::uniform(float min, float max){
+	return min + (max - min)*uniform();
+}
+
+unsigned int RandomGenerator::below(unsigned int n){
+	// Lemire, "Fast random integer generation in an interval" : the high bits
+	// of next()*n, and the few values of the low bits that would make some
+	// results more frequent than others are drawn again
+	unsigned long long m = (unsigned long long)next() * n;
+	unsigned int low = (unsigned int)m;
+	if ( low < n ){
+		unsigned int threshold = (0u - n) % n;
+		while ( low < threshold ){
+			m = (unsigned long long)next() * n;
+			low = (unsigned int)m;
+		}
+	}
+	return (unsigned int)(m >> 32);
+}
+
+glm::vec3 RandomGenerator::onSphere(){
+	float u = uniform();
+	float v = uniform();
+	return sphereDirection(u, v);
+}
+
+glm::vec3 RandomGenerator::inCone(const glm::vec3 & axis, float angle){
+	float u = uniform();
+	float v = uniform();
+	return coneDirection(axis, angle, u, v);
+}
+
+void RandomGenerator::fill(unsigned int * values, size_t count){
+	// What is left of the current block
+	while ( count > 0 && buffered > 0 ){
+		*values++ = buffer[4 - buffered--];
+		count--;
+	}
+
+	// Whole blocks, directly to values
+#ifdef COMMON_SSE2
+	for ( ; count >= 16; count -= 16, values += 16, block += 4 )
+		philox4x32x4(block, streamId, key, values);
+#endif
+	unsigned int k[2] = { (unsigned int)key, (unsigned int)(key >> 32) };
+	for ( ; count >= 4; count -= 4, values += 4, block++ ){
+		unsigned int counter[4] = { (unsigned int)block, (unsigned int)(block >> 32), (unsigned int)streamId, (unsigned int)(streamId >> 32) };
+		philox4x32(counter, k, values);
+	}
+
+	// The beginning of one more block
+	if ( count > 0 ){
+		refill();
+		while ( count-- > 0 )
+			*values++ = buffer[4 - buffered--];
+	}
+}
+
+void RandomGenerator::fillUniform(float * values, size_t count){
+	// In chunks, through the stack, so that the bits and the floats don't
+	// share memory
+	const size_t ChunkSize = 256;
+	unsigned int bits[ChunkSize];
+	while ( count > 0 ){
+		size_t n = count < ChunkSize ? count : ChunkSize;
+		fill(bits, n);
+		size_t i = 0;
+#ifdef COMMON_SSE2
+		const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+		for ( ; i+4 <= n; i+=4 ){
+			__m128i high = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)&bits[i]), 8);
+			_mm_storeu_ps(&values[i], _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+		}
+#endif
+		for ( ; i<n; i++ )
+			values[i] = uniformFloat(bits[i]);
+		values += n;
+		count -= n;
+	}
+}
+
+void RandomGenerator::seek(unsigned long long position){
+	block = position / 4;
+	buffered = 0;
+	unsigned int skip = (unsigned int)(position % 4);
+	if ( skip != 0 ){
+		refill();
+		buffered = 4 - skip;
+	}
+}
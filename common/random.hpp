@@ -0,0 +1,71 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+// Random numbers for particle emitters, instead of rand().
+//
+// The generator is Philox4x32-10 (Salmon et al., "Parallel random numbers :
+// as easy as 1, 2, 3") : the n-th block of 4 numbers is a hash of n, of the
+// seed and of the stream, so there is no state to share between emitters or
+// threads :
+// - two generators with the same seed and stream give the same numbers, on
+//   every platform, with or without SSE
+// - each emitter (or each job) takes its own stream, and the numbers never
+//   overlap with the ones of another stream
+// - seek() jumps anywhere in the sequence in O(1) : a job can start directly
+//   at the numbers of its first particle.
+//
+// fill() and fillUniform() compute 4 blocks at a time with SSE2 : generate
+// all the numbers of a frame at once, then turn them into directions with
+// sphereDirection and coneDirection.
+
+// The numbers of one block : counter (c0, c1, c2, c3) and key (k0, k1)
+void philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int result[4]);
+
+// [0,1[, from the 24 high bits
+inline float uniformFloat(unsigned int bits){ return (bits >> 8) * (1.0f / 16777216.0f); }
+
+// u and v in [0,1[ : a direction, uniform on the unit sphere
+glm::vec3 sphereDirection(float u, float v);
+
+// u and v in [0,1[ : a direction at most angle radians from axis (which
+// must be normalized), uniform over this part of the sphere
+glm::vec3 coneDirection(const glm::vec3 & axis, float angle, float u, float v);
+
+class RandomGenerator{
+public:
+	explicit RandomGenerator(unsigned long long seed = 0, unsigned long long stream = 0);
+
+	unsigned int next();                  // 32 random bits
+	float uniform();                      // [0,1[
+	float uniform(float min, float max);  // [min,max[
+	unsigned int below(unsigned int n);   // [0,n[, without the bias of rand()%n. n > 0.
+
+	glm::vec3 onSphere();
+	glm::vec3 inCone(const glm::vec3 & axis, float angle); // See coneDirection
+
+	// count numbers, the same ones as count calls to next() (or uniform())
+	void fill(unsigned int * values, size_t count);
+	void fillUniform(float * values, size_t count);
+
+	// Position in the sequence, in numbers since the beginning of the stream
+	unsigned long long position() const { return block*4 - buffered; }
+	void seek(unsigned long long position);
+
+	unsigned long long seed() const { return key; }
+	unsigned long long stream() const { return streamId; }
+
+private:
+	void refill();
+
+	unsigned long long key;
+	unsigned long long streamId;
+	unsigned long long block; // Next block to compute
+	unsigned int buffer[4];   // Numbers of block-1 that were not used yet : the last buffered ones
+	unsigned int buffered;
+};
+
+#endif
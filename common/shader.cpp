@@ -1,8 +1,7 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
-#include <iostream>
-#include <fstream>
+#include <map>
 #include <algorithm>
 using namespace std;
 
@@ -11,84 +10,55 @@ using namespace std;
 
 #include <GL/glew.h>
 
+#include "mappedfile.hpp"
+#include "shadersource.hpp"
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+#define PROGRAMBINARY_MAGIC   0x50474C4F // "OGLP" in ASCII
+#define PROGRAMBINARY_VERSION 1
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
-		return 0;
-	}
-
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
+struct ProgramBinaryHeader{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key; // See shaderProgramKey
+	unsigned int binaryFormat;
+	unsigned int binaryLength;
+};
 
+// Compiles one shader, and prints the errors
+static GLuint CompileShader(GLenum ShaderType, const char * file_path, const std::string & ShaderCode){
 
+	GLuint ShaderID = glCreateShader(ShaderType);
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
+	// Compile Shader
+	printf("Compiling shader : %s\n", file_path);
+	char const * SourcePointer = ShaderCode.c_str();
+	glShaderSource(ShaderID, 1, &SourcePointer , NULL);
+	glCompileShader(ShaderID);
 
-
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	// Check Shader
+	glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+		std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
 	}
 
+	return ShaderID;
+}
 
+// Links a program, and prints the errors. Returns true if it worked.
+static bool LinkProgram(GLuint ProgramID){
 
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
-	}
-
-
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 
 	// Link the program
 	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -99,11 +69,185 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
+	return Result == GL_TRUE;
+}
+
+// Compiles and links the program. If retrievable, the driver is told that
+// we'll ask for its binary.
+static GLuint BuildProgram(
+	const char * vertex_file_path, const std::string & VertexShaderCode,
+	const char * fragment_file_path, const std::string & FragmentShaderCode,
+	bool retrievable, bool & linked
+){
+	// Create the shaders
+	GLuint VertexShaderID = CompileShader(GL_VERTEX_SHADER, vertex_file_path, VertexShaderCode);
+	GLuint FragmentShaderID = CompileShader(GL_FRAGMENT_SHADER, fragment_file_path, FragmentShaderCode);
+
+	GLuint ProgramID = glCreateProgram();
+	glAttachShader(ProgramID, VertexShaderID);
+	glAttachShader(ProgramID, FragmentShaderID);
+	if ( retrievable )
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	linked = LinkProgram(ProgramID);
 
+	glDetachShader(ProgramID, VertexShaderID);
+	glDetachShader(ProgramID, FragmentShaderID);
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
 	return ProgramID;
 }
 
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+	return LoadShaders(vertex_file_path, fragment_file_path, std::vector<std::string>());
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const std::vector<std::string> & defines){
+
+	// Read the code from the files, in one go, and resolve the #includes
+	std::string VertexShaderCode, FragmentShaderCode;
+	if ( !preprocessShader(vertex_file_path, defines, VertexShaderCode) ||
+	     !preprocessShader(fragment_file_path, defines, FragmentShaderCode) ){
+		getchar();
+		return 0;
+	}
+
+	bool linked;
+	return BuildProgram(vertex_file_path, VertexShaderCode, fragment_file_path, FragmentShaderCode, false, linked);
+}
+
+// Creates the program from a binary saved by SaveProgramBinary.
+// Returns 0 if there's no binary, or if the driver doesn't want it anymore.
+static GLuint LoadProgramBinary(const std::string & path, unsigned long long key, bool & refused){
+	refused = false;
+
+	MappedFile file;
+	if ( !mapFile(path.c_str(), file) )
+		return 0;
+
+	ProgramBinaryHeader header;
+	if ( file.size < sizeof(header) ){
+		unmapFile(file);
+		return 0;
+	}
+	memcpy(&header, file.data, sizeof(header));
+	if ( header.magic != PROGRAMBINARY_MAGIC || header.version != PROGRAMBINARY_VERSION || header.key != key ||
+	     header.binaryLength > file.size - sizeof(header) ){
+		unmapFile(file);
+		return 0;
+	}
+
+	// Straight from the mapping
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, header.binaryFormat, file.data + sizeof(header), header.binaryLength);
+	unmapFile(file);
+
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if ( Result != GL_TRUE ){
+		// The driver changed in a way that the key doesn't see
+		glDeleteProgram(ProgramID);
+		refused = true;
+		return 0;
+	}
+	return ProgramID;
+}
+
+static bool SaveProgramBinary(const std::string & path, unsigned long long key, GLuint ProgramID){
+
+	GLint length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if ( length <= 0 )
+		return false;
+
+	ProgramBinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = PROGRAMBINARY_MAGIC;
+	header.version = PROGRAMBINARY_VERSION;
+	header.key = key;
+
+	std::vector<char> binary(length);
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(ProgramID, length, &length, &binaryFormat, &binary[0]);
+	header.binaryFormat = binaryFormat;
+	header.binaryLength = (unsigned int)length;
+
+	// Write a temporary file and rename it, so that a crash never leaves a half-written binary
+	std::string tempPath = path + ".tmp";
+	FILE * file = fopen(tempPath.c_str(), "wb");
+	if ( !file )
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+	          fwrite(&binary[0], 1, length, file) == (size_t)length;
+	ok = (fclose(file) == 0) && ok;
+	if ( ok ){
+		remove(path.c_str()); // rename() doesn't overwrite on Windows
+		ok = rename(tempPath.c_str(), path.c_str()) == 0;
+	}
+	if ( !ok )
+		remove(tempPath.c_str());
+	return ok;
+}
+
+ShaderCache::ShaderCache(const char * binaryDirectory) : useBinaries(binaryDirectory != NULL) {
+	if ( binaryDirectory )
+		directory = binaryDirectory;
+	memset(&counters, 0, sizeof(counters));
+}
+
+ShaderCache::~ShaderCache(){
+	for ( std::map<unsigned long long, GLuint>::iterator p = programs.begin(); p != programs.end(); ++p )
+		glDeleteProgram(p->second);
+}
+
+GLuint ShaderCache::program(
+	const char * vertex_file_path,
+	const char * fragment_file_path,
+	const std::vector<std::string> & defines
+){
+	std::string VertexShaderCode, FragmentShaderCode;
+	if ( !preprocessShader(vertex_file_path, defines, VertexShaderCode) ||
+	     !preprocessShader(fragment_file_path, defines, FragmentShaderCode) )
+		return 0;
+
+	// The context exists now
+	if ( driver.empty() ){
+		driver = std::string((const char *)glGetString(GL_VENDOR)) + "\n" +
+		         (const char *)glGetString(GL_RENDERER) + "\n" +
+		         (const char *)glGetString(GL_VERSION);
+		useBinaries = useBinaries && GLEW_ARB_get_program_binary;
+	}
+
+	unsigned long long key = shaderProgramKey(VertexShaderCode, FragmentShaderCode, driver);
 
+	std::map<unsigned long long, GLuint>::iterator p = programs.find(key);
+	if ( p != programs.end() ){
+		counters.memoryHits++;
+		return p->second;
+	}
+
+	std::string binaryPath;
+	if ( useBinaries ){
+		binaryPath = shaderBinaryPath(directory.c_str(), key);
+		bool refused;
+		GLuint ProgramID = LoadProgramBinary(binaryPath, key, refused);
+		if ( refused )
+			counters.binaryFailures++;
+		if ( ProgramID ){
+			counters.binaryHits++;
+			programs[key] = ProgramID;
+			return ProgramID;
+		}
+	}
+
+	counters.compilations++;
+	bool linked;
+	GLuint ProgramID = BuildProgram(vertex_file_path, VertexShaderCode, fragment_file_path, FragmentShaderCode, useBinaries, linked);
+	// A program that doesn't link is kept too (the cache deletes all the
+	// programs it returns), but it isn't saved
+	if ( linked && useBinaries && !SaveProgramBinary(binaryPath, key, ProgramID) )
+		printf("Could not save the binary of the program in %s\n", binaryPath.c_str());
+
+	programs[key] = ProgramID;
+	return ProgramID;
+}
@@ -1,6 +1,56 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+#include <vector>
+#include <string>
+#include <map>
+
+// The shaders can #include other files (see shadersource.hpp)
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 
+// The same, with #defines added to both shaders, like "USE_SHADOWS" or "LIGHT_COUNT 4"
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const std::vector<std::string> & defines);
+
+struct ShaderCacheStats{
+	unsigned int memoryHits;     // The program was already loaded
+	unsigned int binaryHits;     // The program was loaded from its binary, without compiling
+	unsigned int compilations;   // The program had to be compiled
+	unsigned int binaryFailures; // A binary was found but the driver refused it (then it was compiled)
+};
+
+// Loads many programs, and many variants of the same program, quickly :
+// - a variant is a list of #defines, like "USE_SHADOWS" or "LIGHT_COUNT 4"
+// - each program is identified by a hash of its preprocessed sources, so
+//   asking for the same one twice gives the same program
+// - compiled programs are saved in binaryDirectory (with glGetProgramBinary,
+//   if the driver can), and loaded from there the next time instead of being
+//   compiled again. The binaries depend on the driver : they are compiled again
+//   when it changes.
+// The programs are deleted with the cache.
+class ShaderCache{
+public:
+	// binaryDirectory must exist. NULL : nothing is saved.
+	explicit ShaderCache(const char * binaryDirectory = NULL);
+	~ShaderCache();
+
+	// 0 if a file is missing
+	GLuint program(
+		const char * vertex_file_path,
+		const char * fragment_file_path,
+		const std::vector<std::string> & defines = std::vector<std::string>()
+	);
+
+	ShaderCacheStats stats() const { return counters; }
+
+private:
+	ShaderCache(const ShaderCache &);            // Not copyable
+	ShaderCache & operator=(const ShaderCache &);
+
+	bool useBinaries;
+	std::string directory;
+	std::string driver; // GL_VENDOR, GL_RENDERER and GL_VERSION
+	std::map<unsigned long long, GLuint> programs;
+	ShaderCacheStats counters;
+};
+
 #endif
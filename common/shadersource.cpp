@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "hash.hpp"
+#include "shadersource.hpp"
+
+bool readTextFile(const char * path, std::string & out_text){
+	out_text.clear();
+
+	FILE * file = fopen(path, "rb");
+	if ( !file )
+		return false;
+
+	// One allocation and one read for the whole file
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if ( size > 0 ){
+		out_text.resize((size_t)size);
+		out_text.resize(fread(&out_text[0], 1, (size_t)size, file));
+	}
+	fclose(file);
+	return true;
+}
+
+struct PreprocessContext{
+	const std::vector<std::string> * defines;
+	std::vector<std::string> files; // Index = GLSL source string number
+	bool definesDone;
+};
+
+// "  #include "x"" -> true, and x
+static bool parseDirective(const char * line, const char * end, const char * directive, std::string * argument){
+	while ( line < end && (*line == ' ' || *line == '\t') ) line++;
+	if ( line == end || *line != '#' )
+		return false;
+	line++;
+	while ( line < end && (*line == ' ' || *line == '\t') ) line++;
+	size_t length = strlen(directive);
+	if ( (size_t)(end - line) < length || strncmp(line, directive, length) != 0 )
+		return false;
+	line += length;
+	if ( line < end && *line != ' ' && *line != '\t' && *line != '"' && *line != '<' && *line != '\r' )
+		return false; // #versionX, #includes...
+
+	if ( argument ){
+		// The name between "" or <>
+		const char * open = std::find(line, end, '"');
+		char closing = '"';
+		if ( open == end ){
+			open = std::find(line, end, '<');
+			closing = '>';
+		}
+		if ( open == end )
+			return false;
+		const char * close = std::find(open + 1, end, closing);
+		if ( close == end )
+			return false;
+		argument->assign(open + 1, close);
+	}
+	return true;
+}
+
+static void appendLineDirective(std::string & out, size_t line, size_t fileIndex){
+	char buffer[64];
+	sprintf(buffer, "#line %u %u\n", (unsigned int)line, (unsigned int)fileIndex);
+	out += buffer;
+}
+
+static void appendDefines(std::string & out, PreprocessContext & context){
+	for ( size_t i=0; i<context.defines->size(); i++ )
+		out += "#define " + (*context.defines)[i] + "\n";
+	context.definesDone = true;
+}
+
+static bool hasVersion(const std::string & text){
+	const char * p = text.c_str();
+	const char * end = p + text.size();
+	while ( p < end ){
+		const char * lineEnd = std::find(p, end, '\n');
+		if ( parseDirective(p, lineEnd, "version", NULL) )
+			return true;
+		p = lineEnd + 1;
+	}
+	return false;
+}
+
+static bool appendFile(const std::string & path, PreprocessContext & context, std::string & out){
+
+	std::string text;
+	if ( !readTextFile(path.c_str(), text) ){
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", path.c_str());
+		return false;
+	}
+
+	size_t fileIndex = context.files.size();
+	context.files.push_back(path);
+
+	// Includes are relative to this file
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+
+	// Without #version, the defines can go at the very beginning
+	if ( fileIndex == 0 && !hasVersion(text) && !context.defines->empty() ){
+		appendDefines(out, context);
+		appendLineDirective(out, 1, 0);
+	}
+
+	const char * p = text.c_str();
+	const char * end = p + text.size();
+	size_t lineNumber = 1;
+	while ( p < end ){
+		const char * lineEnd = std::find(p, end, '\n');
+		std::string argument;
+
+		if ( !context.definesDone && parseDirective(p, lineEnd, "version", NULL) ){
+			// #version must stay first : the defines go just after it
+			out.append(p, lineEnd);
+			out += "\n";
+			if ( !context.defines->empty() ){
+				appendDefines(out, context);
+				appendLineDirective(out, lineNumber + 1, fileIndex);
+			}
+			context.definesDone = true;
+
+		}else if ( parseDirective(p, lineEnd, "include", &argument) ){
+			std::string includePath = directory + argument;
+			if ( std::find(context.files.begin(), context.files.end(), includePath) == context.files.end() ){
+				appendLineDirective(out, 1, context.files.size());
+				if ( !appendFile(includePath, context, out) ){
+					printf("(included from %s, line %u)\n", path.c_str(), (unsigned int)lineNumber);
+					return false;
+				}
+				appendLineDirective(out, lineNumber + 1, fileIndex);
+			}else{
+				out += "\n"; // Already included : an empty line keeps the line numbers right
+			}
+
+		}else{
+			out.append(p, lineEnd);
+			if ( lineEnd < end )
+				out += "\n";
+		}
+
+		p = lineEnd + 1;
+		lineNumber++;
+	}
+	// Make sure the next file starts on a new line
+	if ( !text.empty() && text[text.size()-1] != '\n' && fileIndex > 0 )
+		out += "\n";
+	return true;
+}
+
+bool preprocessShader(
+	const char * path,
+	const std::vector<std::string> & defines,
+	std::string & out_source,
+	std::vector<std::string> * out_files
+){
+	PreprocessContext context;
+	context.defines = &defines;
+	context.definesDone = false;
+
+	out_source.clear();
+	bool ok = appendFile(path, context, out_source);
+	if ( out_files )
+		out_files->swap(context.files);
+	return ok;
+}
+
+unsigned long long shaderProgramKey(
+	const std::string & vertexSource,
+	const std::string & fragmentSource,
+	const std::string & driver
+){
+	// The size of each part is hashed too, so that moving text from one
+	// to the other changes the key
+	unsigned long long sizes[3] = { vertexSource.size(), fragmentSource.size(), driver.size() };
+	unsigned long long key = hashBytes(sizes, sizeof(sizes));
+	key = hashBytes(vertexSource.data(), vertexSource.size(), key);
+	key = hashBytes(fragmentSource.data(), fragmentSource.size(), key);
+	key = hashBytes(driver.data(), driver.size(), key);
+	return key;
+}
+
+std::string shaderBinaryPath(const char * directory, unsigned long long key){
+	char name[32];
+	sprintf(name, "%016llx.programbinary", key);
+	std::string path(directory ? directory : "");
+	if ( !path.empty() && path[path.size()-1] != '/' && path[path.size()-1] != '\\' )
+		path += "/";
+	return path + name;
+}
@@ -0,0 +1,48 @@
+#ifndef SHADERSOURCE_HPP
+#define SHADERSOURCE_HPP
+
+#include <vector>
+#include <string>
+
+// The CPU side of shader loading (see ShaderCache in shader.hpp) : reading,
+// preprocessing and hashing the sources. No OpenGL here.
+//
+// GLSL has no #include, so we do it ourselves :
+//   #include "lighting.glsl"   // Relative to the file that includes it
+// Each file is only included once (as if it had #pragma once), so two
+// headers can include the same one.
+//
+// Variants of a shader are made with #defines, added just after the
+// #version line. "USE_SHADOWS" gives "#define USE_SHADOWS", "LIGHT_COUNT 4"
+// gives "#define LIGHT_COUNT 4".
+//
+// So that error messages still make sense, "#line" directives are added
+// where needed : in "2(15) : error ...", 2 is the index of the file in
+// out_files, and 15 the line in this file.
+
+// Reads a whole file at once. Returns false if it can't be opened.
+bool readTextFile(const char * path, std::string & out_text);
+
+// Reads path, resolves its #includes and adds the defines.
+// out_files receives all the files that were read, path first (can be NULL).
+// Prints why and returns false if a file is missing.
+bool preprocessShader(
+	const char * path,
+	const std::vector<std::string> & defines,
+	std::string & out_source,
+	std::vector<std::string> * out_files = NULL
+);
+
+// Identifies a compiled program : the same preprocessed sources, compiled by
+// the same driver, give the same program. driver is for instance
+// GL_VENDOR + GL_RENDERER + GL_VERSION.
+unsigned long long shaderProgramKey(
+	const std::string & vertexSource,
+	const std::string & fragmentSource,
+	const std::string & driver
+);
+
+// Where the program binary of this key is saved, in directory
+std::string shaderBinaryPath(const char * directory, unsigned long long key);
+
+#endif
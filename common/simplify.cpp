@@ -0,0 +1,435 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "vboindexer.hpp"
+#include "mesh.hpp"
+#include "simplify.hpp"
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix.
+// Error at position p : (p,1)^T Q (p,1). Adding two quadrics adds their planes.
+// Planes are weighted, and the error is divided by the total weight : it is
+// a mean squared distance, whatever the number and size of the triangles.
+struct Quadric{
+	double a2, ab, ac, ad;
+	double     b2, bc, bd;
+	double         c2, cd;
+	double             d2;
+	double weight;
+
+	Quadric(){ a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = weight = 0.0; }
+
+	// The plane dot(n, p) + d = 0, counted weight times
+	void addPlane(const glm::vec3 & n, float d, float weight){
+		a2 += weight * n.x*n.x; ab += weight * n.x*n.y; ac += weight * n.x*n.z; ad += weight * n.x*d;
+		b2 += weight * n.y*n.y; bc += weight * n.y*n.z; bd += weight * n.y*d;
+		c2 += weight * n.z*n.z; cd += weight * n.z*d;
+		d2 += weight * d*d;
+		this->weight += weight;
+	}
+
+	Quadric & operator+=(const Quadric & q){
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+		weight += q.weight;
+		return *this;
+	}
+
+	double error(const glm::vec3 & p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double e = a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+		         + b2*y*y + 2*bc*y*z + 2*bd*y
+		         + c2*z*z + 2*cd*z
+		         + d2;
+		return e > 0.0 && weight > 0.0 ? e / weight : 0.0;
+	}
+};
+
+// What a vertex (all the vertices at the same position) can do
+enum VertexKind{
+	KIND_MANIFOLD, // Inside a smooth part of the mesh : can go anywhere
+	KIND_BORDER,   // On the border of the mesh : can only move along it
+	KIND_SEAM,     // On a UV/normal seam, with exactly 2 copies : can only move along the seam
+	KIND_LOCKED    // Anything more complex : never moves
+};
+
+static inline unsigned long long edgeKey(unsigned int a, unsigned int b){
+	return ((unsigned long long)a << 32) | b;
+}
+
+static inline bool hasEdge(const std::vector<unsigned long long> & sortedEdges, unsigned int a, unsigned int b){
+	return std::binary_search(sortedEdges.begin(), sortedEdges.end(), edgeKey(a, b));
+}
+
+// Directed edges of the current triangles, between vertices and between positions
+struct EdgeSets{
+	std::vector<unsigned long long> vertexEdges;
+	std::vector<unsigned long long> positionEdges;
+
+	void build(const std::vector<unsigned int> & indices, const std::vector<unsigned int> & position){
+		vertexEdges.resize(indices.size());
+		positionEdges.resize(indices.size());
+		for ( size_t t=0; t<indices.size(); t+=3 ){
+			for ( int k=0; k<3; k++ ){
+				unsigned int a = indices[t+k];
+				unsigned int b = indices[t+(k+1)%3];
+				vertexEdges  [t+k] = edgeKey(a, b);
+				positionEdges[t+k] = edgeKey(position[a], position[b]);
+			}
+		}
+		std::sort(vertexEdges.begin(), vertexEdges.end());
+		std::sort(positionEdges.begin(), positionEdges.end());
+	}
+
+	// No triangle on the other side
+	bool isBorder(unsigned int pa, unsigned int pb) const {
+		return !hasEdge(positionEdges, pb, pa);
+	}
+	// A triangle on the other side, but with other vertices at the same positions
+	bool isSeam(unsigned int a, unsigned int b, unsigned int pa, unsigned int pb) const {
+		return hasEdge(positionEdges, pb, pa) && !hasEdge(vertexEdges, b, a);
+	}
+};
+
+// Can a vertex of kind "from" go to a vertex of kind "to", along this edge ?
+static inline bool canCollapse(VertexKind from, VertexKind to, bool borderEdge, bool seamEdge){
+	switch ( from ){
+		case KIND_MANIFOLD : return true;
+		case KIND_BORDER   : return borderEdge && (to == KIND_BORDER || to == KIND_LOCKED);
+		case KIND_SEAM     : return seamEdge   && (to == KIND_SEAM   || to == KIND_LOCKED);
+		default            : return false;
+	}
+}
+
+struct Collapse{
+	unsigned int from; // Vertex that disappears
+	unsigned int to;   // Vertex that replaces it
+	double error;
+
+	bool operator<(const Collapse & other) const { return error < other.error; }
+};
+
+float simplifyMesh(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & in_vertices,
+	size_t targetIndexCount,
+	std::vector<unsigned int> & out_indices,
+	float maxError
+){
+	size_t vertexCount = in_vertices.size();
+	out_indices = indices;
+	if ( indices.size() <= targetIndexCount || vertexCount == 0 )
+		return 0.0f;
+
+	// Work in a unit box, so that errors are relative to the size of the mesh
+	glm::vec3 minimum = in_vertices[0], maximum = in_vertices[0];
+	for ( size_t i=0; i<vertexCount; i++ ){
+		minimum = glm::min(minimum, in_vertices[i]);
+		maximum = glm::max(maximum, in_vertices[i]);
+	}
+	glm::vec3 extent = maximum - minimum;
+	float scale = std::max(extent.x, std::max(extent.y, extent.z));
+	scale = scale > 0.0f ? 1.0f / scale : 1.0f;
+	std::vector<glm::vec3> vertices(vertexCount);
+	for ( size_t i=0; i<vertexCount; i++ )
+		vertices[i] = (in_vertices[i] - minimum) * scale;
+
+	// position[v] : the first vertex at the same position as v.
+	// nextCopy[v] : the next vertex at this position (circular list).
+	std::vector<unsigned int> position(vertexCount), nextCopy(vertexCount);
+	{
+		std::vector<unsigned int> order(vertexCount);
+		for ( size_t i=0; i<vertexCount; i++ )
+			order[i] = i;
+		struct ByPosition{
+			const std::vector<glm::vec3> & v;
+			ByPosition(const std::vector<glm::vec3> & v) : v(v) {}
+			bool operator()(unsigned int a, unsigned int b) const {
+				if ( v[a].x != v[b].x ) return v[a].x < v[b].x;
+				if ( v[a].y != v[b].y ) return v[a].y < v[b].y;
+				if ( v[a].z != v[b].z ) return v[a].z < v[b].z;
+				return a < b;
+			}
+		};
+		std::sort(order.begin(), order.end(), ByPosition(vertices));
+		for ( size_t i=0; i<vertexCount; ){
+			size_t j = i + 1;
+			while ( j < vertexCount && vertices[order[j]] == vertices[order[i]] )
+				j++;
+			for ( size_t k=i; k<j; k++ ){
+				position[order[k]] = order[i];
+				nextCopy[order[k]] = order[ k+1 < j ? k+1 : i ];
+			}
+			i = j;
+		}
+	}
+
+	EdgeSets edges;
+	edges.build(out_indices, position);
+
+	// Kind of each position, from its copies and from its border and seam edges
+	std::vector<unsigned char> kind(vertexCount, KIND_MANIFOLD);
+	{
+		std::vector<unsigned int> borderEdges(vertexCount, 0), seamEdges(vertexCount, 0), copies(vertexCount, 0);
+		for ( size_t v=0; v<vertexCount; v++ )
+			copies[position[v]]++;
+		for ( size_t t=0; t<out_indices.size(); t+=3 ){
+			for ( int k=0; k<3; k++ ){
+				unsigned int a = out_indices[t+k], b = out_indices[t+(k+1)%3];
+				unsigned int pa = position[a], pb = position[b];
+				if ( edges.isBorder(pa, pb) ){
+					borderEdges[pa]++; borderEdges[pb]++;
+				}else if ( edges.isSeam(a, b, pa, pb) ){
+					seamEdges[pa]++; seamEdges[pb]++;
+				}
+			}
+		}
+		for ( size_t p=0; p<vertexCount; p++ ){
+			if ( position[p] != p )
+				continue;
+			if ( copies[p] == 1 && borderEdges[p] == 0 && seamEdges[p] == 0 )
+				kind[p] = KIND_MANIFOLD;
+			else if ( copies[p] == 1 && borderEdges[p] == 2 && seamEdges[p] == 0 )
+				kind[p] = KIND_BORDER;  // One border edge in, one out
+			else if ( copies[p] == 2 && borderEdges[p] == 0 && seamEdges[p] == 4 )
+				kind[p] = KIND_SEAM;    // Two seam edges, seen from both sides
+			else
+				kind[p] = KIND_LOCKED;
+		}
+	}
+
+	// Quadric of each position : the planes of its triangles, weighted by their
+	// area, plus planes through border and seam edges to keep them in place.
+	std::vector<Quadric> quadrics(vertexCount);
+	for ( size_t t=0; t<out_indices.size(); t+=3 ){
+		unsigned int v[3] = { out_indices[t], out_indices[t+1], out_indices[t+2] };
+		const glm::vec3 & p0 = vertices[v[0]];
+		glm::vec3 n = glm::cross(vertices[v[1]] - p0, vertices[v[2]] - p0);
+		float area = glm::length(n);
+		if ( area == 0.0f )
+			continue;
+		n /= area;
+		for ( int k=0; k<3; k++ )
+			quadrics[position[v[k]]].addPlane(n, -glm::dot(n, p0), area);
+
+		for ( int k=0; k<3; k++ ){
+			unsigned int a = v[k], b = v[(k+1)%3];
+			unsigned int pa = position[a], pb = position[b];
+			if ( edges.isBorder(pa, pb) || edges.isSeam(a, b, pa, pb) ){
+				glm::vec3 edge = vertices[b] - vertices[a];
+				glm::vec3 edgeNormal = glm::cross(edge, n); // In the plane of the triangle, orthogonal to the edge
+				float length = glm::length(edgeNormal);
+				if ( length == 0.0f )
+					continue;
+				edgeNormal /= length;
+				float weight = 10.0f * glm::dot(edge, edge);
+				quadrics[pa].addPlane(edgeNormal, -glm::dot(edgeNormal, vertices[a]), weight);
+				quadrics[pb].addPlane(edgeNormal, -glm::dot(edgeNormal, vertices[a]), weight);
+			}
+		}
+	}
+
+	double maxQuadricError = (double)maxError * maxError;
+	double resultError = 0.0;
+
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<char> touched(vertexCount);
+	std::vector<unsigned int> adjacencyOffset(vertexCount + 1), adjacency;
+	std::vector<Collapse> collapses;
+
+	// Passes : find all possible collapses, do the cheapest ones that don't
+	// touch each other, rebuild the triangles, and start again.
+	while ( out_indices.size() > targetIndexCount ){
+
+		// Triangles around each position
+		std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+		for ( size_t i=0; i<out_indices.size(); i++ )
+			adjacencyOffset[ position[out_indices[i]] + 1 ]++;
+		for ( size_t p=0; p<vertexCount; p++ )
+			adjacencyOffset[p+1] += adjacencyOffset[p];
+		adjacency.resize(out_indices.size());
+		{
+			std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+			for ( size_t i=0; i<out_indices.size(); i++ )
+				adjacency[ fill[ position[out_indices[i]] ]++ ] = i / 3;
+		}
+
+		// All the allowed collapses, from cheapest to most expensive
+		collapses.clear();
+		for ( size_t t=0; t<out_indices.size(); t+=3 ){
+			for ( int k=0; k<3; k++ ){
+				unsigned int a = out_indices[t+k], b = out_indices[t+(k+1)%3];
+				unsigned int pa = position[a], pb = position[b];
+				if ( pa == pb )
+					continue;
+				bool border = edges.isBorder(pa, pb);
+				bool seam   = edges.isSeam(a, b, pa, pb);
+				// a -> b, then b -> a
+				for ( int direction=0; direction<2; direction++ ){
+					unsigned int from = direction ? b : a, to = direction ? a : b;
+					unsigned int pf = position[from], pt = position[to];
+					if ( !canCollapse((VertexKind)kind[pf], (VertexKind)kind[pt], border, seam) )
+						continue;
+					Quadric q = quadrics[pf];
+					q += quadrics[pt];
+					Collapse collapse;
+					collapse.from  = from;
+					collapse.to    = to;
+					collapse.error = q.error(vertices[pt]);
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		for ( size_t v=0; v<vertexCount; v++ )
+			remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		// Each collapse removes about 2 triangles (1 on a border)
+		size_t trianglesToRemove = (out_indices.size() - targetIndexCount + 2) / 3;
+		size_t removed = 0;
+		size_t applied = 0;
+
+		for ( size_t c=0; c<collapses.size() && removed < trianglesToRemove; c++ ){
+			const Collapse & collapse = collapses[c];
+			unsigned int pa = position[collapse.from], pb = position[collapse.to];
+			if ( collapse.error > maxQuadricError )
+				break;
+			if ( touched[pa] || touched[pb] )
+				continue;
+
+			// Where each copy of "from" goes : to the copy of "to" it shares an edge with
+			bool ok = true;
+			unsigned int copy = collapse.from;
+			do{
+				unsigned int target = (copy == collapse.from) ? collapse.to : 0xFFFFFFFF;
+				for ( unsigned int j=adjacencyOffset[pa]; j<adjacencyOffset[pa+1] && target == 0xFFFFFFFF; j++ ){
+					const unsigned int * triangle = &out_indices[3*adjacency[j]];
+					if ( triangle[0] != copy && triangle[1] != copy && triangle[2] != copy )
+						continue;
+					for ( int k=0; k<3; k++ ){
+						if ( position[triangle[k]] == pb )
+							target = triangle[k];
+					}
+				}
+				if ( target == 0xFFFFFFFF ){
+					ok = false;
+					break;
+				}
+				remap[copy] = target;
+				copy = nextCopy[copy];
+			}while ( copy != collapse.from );
+
+			// Don't flip triangles : the ones that stay must keep their orientation
+			const glm::vec3 & newPosition = vertices[pb];
+			unsigned int triangleCount = 0;
+			for ( unsigned int j=adjacencyOffset[pa]; j<adjacencyOffset[pa+1] && ok; j++ ){
+				const unsigned int * triangle = &out_indices[3*adjacency[j]];
+				glm::vec3 p[3];
+				bool collapsing = false;
+				for ( int k=0; k<3; k++ ){
+					unsigned int pk = position[triangle[k]];
+					collapsing = collapsing || pk == pb;
+					p[k] = pk == pa ? newPosition : vertices[pk];
+				}
+				if ( collapsing ){
+					triangleCount++;
+					continue; // This one disappears
+				}
+				glm::vec3 before = glm::cross(vertices[position[triangle[1]]] - vertices[position[triangle[0]]], vertices[position[triangle[2]]] - vertices[position[triangle[0]]]);
+				glm::vec3 after  = glm::cross(p[1] - p[0], p[2] - p[0]);
+				if ( glm::dot(before, after) <= 0.0f )
+					ok = false;
+			}
+
+			if ( !ok ){
+				// Undo
+				copy = collapse.from;
+				do{
+					remap[copy] = copy;
+					copy = nextCopy[copy];
+				}while ( copy != collapse.from );
+				continue;
+			}
+
+			// The neighbours can't move in this pass : the checks above assumed they wouldn't
+			for ( unsigned int j=adjacencyOffset[pa]; j<adjacencyOffset[pa+1]; j++ ){
+				const unsigned int * triangle = &out_indices[3*adjacency[j]];
+				for ( int k=0; k<3; k++ )
+					touched[position[triangle[k]]] = 1;
+			}
+
+			quadrics[pb] += quadrics[pa];
+			resultError = std::max(resultError, collapse.error);
+			removed += triangleCount;
+			applied++;
+		}
+
+		if ( applied == 0 )
+			break; // Nothing more can be done within maxError
+
+		// New triangles. The ones with 2 corners at the same position are gone.
+		size_t written = 0;
+		for ( size_t t=0; t<out_indices.size(); t+=3 ){
+			unsigned int a = remap[out_indices[t]], b = remap[out_indices[t+1]], c = remap[out_indices[t+2]];
+			if ( position[a] == position[b] || position[b] == position[c] || position[c] == position[a] )
+				continue;
+			out_indices[written++] = a;
+			out_indices[written++] = b;
+			out_indices[written++] = c;
+		}
+		out_indices.resize(written);
+		edges.build(out_indices, position);
+	}
+
+	return (float)sqrt(resultError);
+}
+
+void buildLODChain(Mesh & mesh, const std::vector<float> & ratios, float maxError){
+	mesh.lods.resize(ratios.size());
+	for ( size_t l=0; l<ratios.size(); l++ ){
+		const std::vector<unsigned int> & previous = l == 0 ? mesh.indices : mesh.lods[l-1].indices;
+		size_t target = (size_t)(mesh.indices.size() / 3 * ratios[l]) * 3;
+		MeshLOD & lod = mesh.lods[l];
+		lod.ratio = ratios[l];
+		float error = simplifyMesh(previous, mesh.vertices, target, lod.indices, maxError);
+		// Errors add up, since each LOD comes from the previous one
+		lod.error = error + (l == 0 ? 0.0f : mesh.lods[l-1].error);
+	}
+}
+
+void concatenateLODs(Mesh & mesh, IndexBuffer & out_indices, std::vector<LODRange> & out_lods){
+	out_lods.resize(mesh.lods.size() + 1);
+	out_lods[0].firstIndex = 0;
+	out_lods[0].indexCount = mesh.indices.size();
+	out_lods[0].ratio = 1.0f;
+	out_lods[0].error = 0.0f;
+
+	std::vector<unsigned int> & indices = mesh.indices;
+	for ( size_t l=0; l<mesh.lods.size(); l++ ){
+		MeshLOD & lod = mesh.lods[l];
+		out_lods[l+1].firstIndex = indices.size();
+		out_lods[l+1].indexCount = lod.indices.size();
+		out_lods[l+1].ratio = lod.ratio;
+		out_lods[l+1].error = lod.error;
+		indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+	}
+	mesh.lods.clear();
+
+	moveIndices(mesh, out_indices);
+}
+
+unsigned int chooseLOD(const std::vector<LODRange> & lods, float meshSize, float distance, float maxAngularError){
+	unsigned int best = 0;
+	for ( unsigned int i=1; i<lods.size(); i++ ){
+		// Small angles : angle = size / distance
+		if ( lods[i].error * meshSize <= maxAngularError * distance )
+			best = i;
+	}
+	return best;
+}
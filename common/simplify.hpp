@@ -0,0 +1,53 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+// Mesh simplification, for levels of detail (LODs).
+//
+// Edges are collapsed one by one, always the one that changes the shape the
+// least, as measured by quadric error metrics (Garland & Heckbert).
+// A vertex is always collapsed onto one of its neighbours : the simplified
+// mesh only needs a new index buffer, not new vertices.
+//
+// indexVBO output has several vertices at the same position where the UVs or
+// the normals are discontinuous (seams). These vertices are kept together :
+// a vertex on a seam only moves along this seam, with all its copies, so
+// textures don't tear. Vertices on the border of the mesh only move along
+// the border, and vertices where several seams meet never move.
+
+struct Mesh;
+
+// Where a LOD is, in an index buffer that contains all of them
+struct LODRange{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float ratio; // See MeshLOD
+	float error; // See MeshLOD
+};
+
+// Simplifies an indexed mesh, until it has at most targetIndexCount indices
+// or until the error would become larger than maxError.
+// Errors are distances, relative to the size of the mesh (1 = the size of its bounding box).
+// Returns the error of the result.
+float simplifyMesh(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	size_t targetIndexCount,
+	std::vector<unsigned int> & out_indices,
+	float maxError = 1.0f
+);
+
+// Fills mesh.lods, one for each ratio (for instance 0.5, 0.25, 0.125).
+// Each LOD is simplified from the previous one, which is faster.
+void buildLODChain(Mesh & mesh, const std::vector<float> & ratios, float maxError = 1.0f);
+
+// Puts the full mesh and all its LODs in a single index buffer, to draw any
+// of them from the same element buffer. out_lods[0] is the full mesh,
+// out_lods[i] is mesh.lods[i-1]. The indices are moved out of the mesh.
+void concatenateLODs(Mesh & mesh, IndexBuffer & out_indices, std::vector<LODRange> & out_lods);
+
+// The most simplified LOD that still looks like the full mesh, for a mesh of
+// size meshSize seen from distance : its error, seen from there, is at most
+// maxAngularError (in radians).
+unsigned int chooseLOD(const std::vector<LODRange> & lods, float meshSize, float distance, float maxAngularError = 0.002f);
+
+#endif
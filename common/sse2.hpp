@@ -0,0 +1,12 @@
+#ifndef SSE2_HPP
+#define SSE2_HPP
+
+// COMMON_SSE2 is defined when the compiler targets SSE2 : always on x64, and
+// on x86 with -msse2 (GCC, Clang) or /arch:SSE2 (Visual). The code that uses
+// it always has a plain C++ version for the other CPUs.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define COMMON_SSE2
+#endif
+
+#endif
@@ -1,7 +1,43 @@
 #include <vector>
+#include <math.h>
+
+#include "sse2.hpp"
+
 #include <glm/glm.hpp>
 
 #include "tangentspace.hpp"
+#include "vboindexer.hpp"
+#include "mesh.hpp"
+
+// Tangent and bitangent of a triangle : the directions of U and V in world space
+static inline void triangleTangents(
+	const glm::vec3 & v0, const glm::vec3 & v1, const glm::vec3 & v2,
+	const glm::vec2 & uv0, const glm::vec2 & uv1, const glm::vec2 & uv2,
+	glm::vec3 & tangent, glm::vec3 & bitangent
+){
+	// Edges of the triangle : postion delta
+	glm::vec3 deltaPos1 = v1-v0;
+	glm::vec3 deltaPos2 = v2-v0;
+
+	// UV delta
+	glm::vec2 deltaUV1 = uv1-uv0;
+	glm::vec2 deltaUV2 = uv2-uv0;
+
+	float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+	tangent = (deltaPos1 * deltaUV2.y   - deltaPos2 * deltaUV1.y)*r;
+	bitangent = (deltaPos2 * deltaUV1.x   - deltaPos1 * deltaUV2.x)*r;
+}
+
+// See "Going Further"
+static inline void orthogonalize(const glm::vec3 & n, glm::vec3 & t, const glm::vec3 & b){
+	// Gram-Schmidt orthogonalize
+	t = glm::normalize(t - n * glm::dot(n, t));
+	
+	// Calculate handedness
+	if (glm::dot(glm::cross(n, t), b) < 0.0f){
+		t = t * -1.0f;
+	}
+}
 
 void computeTangentBasis(
 	// inputs
@@ -13,29 +49,14 @@ void computeTangentBasis(
 	std::vector<glm::vec3> & bitangents
 ){
 
-	for (unsigned int i=0; i<vertices.size(); i+=3 ){
-
-		// Shortcuts for vertices
-		glm::vec3 & v0 = vertices[i+0];
-		glm::vec3 & v1 = vertices[i+1];
-		glm::vec3 & v2 = vertices[i+2];
+	size_t first = tangents.size();
+	tangents  .reserve(first + vertices.size());
+	bitangents.reserve(first + vertices.size());
 
-		// Shortcuts for UVs
-		glm::vec2 & uv0 = uvs[i+0];
-		glm::vec2 & uv1 = uvs[i+1];
-		glm::vec2 & uv2 = uvs[i+2];
-
-		// Edges of the triangle : postion delta
-		glm::vec3 deltaPos1 = v1-v0;
-		glm::vec3 deltaPos2 = v2-v0;
-
-		// UV delta
-		glm::vec2 deltaUV1 = uv1-uv0;
-		glm::vec2 deltaUV2 = uv2-uv0;
+	for (unsigned int i=0; i<vertices.size(); i+=3 ){
 
-		float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-		glm::vec3 tangent = (deltaPos1 * deltaUV2.y   - deltaPos2 * deltaUV1.y)*r;
-		glm::vec3 bitangent = (deltaPos2 * deltaUV1.x   - deltaPos1 * deltaUV2.x)*r;
+		glm::vec3 tangent, bitangent;
+		triangleTangents(vertices[i+0], vertices[i+1], vertices[i+2], uvs[i+0], uvs[i+1], uvs[i+2], tangent, bitangent);
 
 		// Set the same tangent for all three vertices of the triangle.
 		// They will be merged later, in vboindexer.cpp
@@ -50,24 +71,222 @@ void computeTangentBasis(
 
 	}
 
-	// See "Going Further"
 	for (unsigned int i=0; i<vertices.size(); i+=1 )
-	{
-		glm::vec3 & n = normals[i];
-		glm::vec3 & t = tangents[i];
-		glm::vec3 & b = bitangents[i];
-		
-		// Gram-Schmidt orthogonalize
-		t = glm::normalize(t - n * glm::dot(n, t));
-		
-		// Calculate handedness
-		if (glm::dot(glm::cross(n, t), b) < 0.0f){
-			t = t * -1.0f;
-		}
+		orthogonalize(normals[i], tangents[first+i], bitangents[first+i]);
+
+}
+
+
 
+// The indexed version. Each triangle gives a tangent and a bitangent, which
+// are projected on the tangent plane of each of its vertices, normalized,
+// and weighted by the angle of the triangle at this vertex (like MikkTSpace) :
+// this way, the result doesn't depend on how a surface is triangulated.
+// Instead of dividing by the UV determinant (r in the function above, which is
+// infinite when the UVs are degenerate), only its sign is used, since the
+// vectors are normalized anyway. Triangles with degenerate UVs don't contribute.
+
+// Angle of the triangle at corner p0
+static inline float cornerAngle(const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2){
+	glm::vec3 e1 = p1 - p0;
+	glm::vec3 e2 = p2 - p0;
+	float lengths = glm::length(e1) * glm::length(e2);
+	if ( lengths <= 0.0f )
+		return 0.0f;
+	return acosf( glm::clamp(glm::dot(e1, e2) / lengths, -1.0f, 1.0f) );
+}
+
+// Normals from files are not always unit length
+static inline glm::vec3 safeNormalize(const glm::vec3 & n){
+	float length = glm::length(n);
+	return length > 0.0f ? n / length : n;
+}
+
+// Adds v, projected on the plane orthogonal to n and normalized, times weight
+static inline void accumulateProjected(const glm::vec3 & v, const glm::vec3 & n, float weight, float * x, float * y, float * z){
+	glm::vec3 p = v - n * glm::dot(n, v);
+	float length = glm::length(p);
+	if ( length > 0.0f ){
+		p *= weight / length;
+		*x += p.x; *y += p.y; *z += p.z;
 	}
+}
 
+// Any unit vector orthogonal to n, for vertices without a usable tangent
+static inline glm::vec3 anyTangent(const glm::vec3 & normal){
+	glm::vec3 n = safeNormalize(normal);
+	glm::vec3 axis = fabsf(n.x) < 0.9f ? glm::vec3(1,0,0) : glm::vec3(0,1,0);
+	glm::vec3 t = glm::cross(n, axis);
+	float length = glm::length(t);
+	return length > 0.0f ? t / length : glm::vec3(1,0,0);
+}
 
+// Gram-Schmidt + handedness of vertex i, one at a time. Returns false if the
+// tangent is degenerate.
+static inline bool orthonormalizeVertex(
+	const glm::vec3 & normal, float tx, float ty, float tz, float bx, float by, float bz,
+	glm::vec4 & result
+){
+	glm::vec3 t(tx, ty, tz);
+	glm::vec3 b(bx, by, bz);
+	glm::vec3 n = safeNormalize(normal);
+	t = t - n * glm::dot(n, t);
+	float length2 = glm::dot(t, t);
+	if ( !(length2 > 1e-20f) )
+		return false;
+	t /= sqrtf(length2);
+	float w = glm::dot(glm::cross(n, t), b) < 0.0f ? -1.0f : 1.0f;
+	result = glm::vec4(t, w);
+	return true;
+}
+
+void computeTangentBasis_indexed(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	std::vector<glm::vec4> & tangents
+){
+	size_t vertexCount = vertices.size();
+
+	// Sums of the tangents (t) and bitangents (b) of each vertex. One array
+	// per component, so that they can be loaded 4 vertices at a time below.
+	// Padded to a multiple of 4.
+	size_t paddedCount = (vertexCount + 3) & ~(size_t)3;
+	std::vector<float> sums(6 * paddedCount, 0.0f);
+	float * tx = &sums[0] + 0*paddedCount;
+	float * ty = &sums[0] + 1*paddedCount;
+	float * tz = &sums[0] + 2*paddedCount;
+	float * bx = &sums[0] + 3*paddedCount;
+	float * by = &sums[0] + 4*paddedCount;
+	float * bz = &sums[0] + 5*paddedCount;
+
+	for ( size_t i=0; i+2<indices.size(); i+=3 ){
+		unsigned int corners[3] = { indices[i], indices[i+1], indices[i+2] };
+
+		const glm::vec3 & v0 = vertices[corners[0]];
+		const glm::vec3 & v1 = vertices[corners[1]];
+		const glm::vec3 & v2 = vertices[corners[2]];
+
+		glm::vec3 deltaPos1 = v1-v0;
+		glm::vec3 deltaPos2 = v2-v0;
+		glm::vec2 deltaUV1 = uvs[corners[1]] - uvs[corners[0]];
+		glm::vec2 deltaUV2 = uvs[corners[2]] - uvs[corners[0]];
+
+		float determinant = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+		if ( fabsf(determinant) < 1e-12f )
+			continue; // Degenerate UVs : no idea where U and V are
+		float r = determinant > 0.0f ? 1.0f : -1.0f;
+		glm::vec3 tangent   = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+		glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
+
+		float angles[3] = {
+			cornerAngle(v0, v1, v2),
+			cornerAngle(v1, v2, v0),
+			cornerAngle(v2, v0, v1),
+		};
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = corners[k];
+			glm::vec3 n = safeNormalize(normals[v]);
+			accumulateProjected(tangent,   n, angles[k], tx+v, ty+v, tz+v);
+			accumulateProjected(bitangent, n, angles[k], bx+v, by+v, bz+v);
+		}
+	}
+
+	// Orthonormalize, and compute the handedness
+	tangents.resize(vertexCount);
+	size_t i = 0;
+#ifdef COMMON_SSE2
+	// 4 vertices at a time. Lanes with a degenerate tangent are fixed below, one by one.
+	const __m128 epsilon = _mm_set1_ps(1e-20f);
+	const __m128 zero    = _mm_setzero_ps();
+	const __m128 one     = _mm_set1_ps(1.0f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	for ( ; i+4<=vertexCount; i+=4 ){
+		const glm::vec3 * n = &normals[i];
+		__m128 nx = _mm_setr_ps(n[0].x, n[1].x, n[2].x, n[3].x);
+		__m128 ny = _mm_setr_ps(n[0].y, n[1].y, n[2].y, n[3].y);
+		__m128 nz = _mm_setr_ps(n[0].z, n[1].z, n[2].z, n[3].z);
+		__m128 normalLength2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+		__m128 inverseNormalLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(normalLength2, epsilon)));
+		nx = _mm_mul_ps(nx, inverseNormalLength);
+		ny = _mm_mul_ps(ny, inverseNormalLength);
+		nz = _mm_mul_ps(nz, inverseNormalLength);
+		__m128 x = _mm_loadu_ps(tx+i);
+		__m128 y = _mm_loadu_ps(ty+i);
+		__m128 z = _mm_loadu_ps(tz+i);
+
+		// t = t - n * dot(n, t)
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_mul_ps(nz, z));
+		x = _mm_sub_ps(x, _mm_mul_ps(nx, d));
+		y = _mm_sub_ps(y, _mm_mul_ps(ny, d));
+		z = _mm_sub_ps(z, _mm_mul_ps(nz, d));
+
+		// t = normalize(t)
+		__m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 valid = _mm_cmpgt_ps(length2, epsilon);
+		__m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(length2, epsilon)));
+		x = _mm_mul_ps(x, inverseLength);
+		y = _mm_mul_ps(y, inverseLength);
+		z = _mm_mul_ps(z, inverseLength);
+
+		// w = sign( dot(cross(n, t), b) )
+		__m128 cx = _mm_sub_ps(_mm_mul_ps(ny, z), _mm_mul_ps(nz, y));
+		__m128 cy = _mm_sub_ps(_mm_mul_ps(nz, x), _mm_mul_ps(nx, z));
+		__m128 cz = _mm_sub_ps(_mm_mul_ps(nx, y), _mm_mul_ps(ny, x));
+		__m128 handedness = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(cx, _mm_loadu_ps(bx+i)),
+			_mm_mul_ps(cy, _mm_loadu_ps(by+i))),
+			_mm_mul_ps(cz, _mm_loadu_ps(bz+i)));
+		__m128 w = _mm_or_ps(one, _mm_and_ps(_mm_cmplt_ps(handedness, zero), signBit));
+
+		// From 4 x, 4 y, 4 z, 4 w to 4 vec4
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		float * out = &tangents[i].x;
+		_mm_storeu_ps(out +  0, x);
+		_mm_storeu_ps(out +  4, y);
+		_mm_storeu_ps(out +  8, z);
+		_mm_storeu_ps(out + 12, w);
+
+		int validMask = _mm_movemask_ps(valid);
+		for ( int k=0; k<4; k++ ){
+			if ( !(validMask & (1<<k)) )
+				tangents[i+k] = glm::vec4(anyTangent(normals[i+k]), 1.0f);
+		}
+	}
+#endif
+	for ( ; i<vertexCount; i++ ){
+		if ( !orthonormalizeVertex(normals[i], tx[i], ty[i], tz[i], bx[i], by[i], bz[i], tangents[i]) )
+			tangents[i] = glm::vec4(anyTangent(normals[i]), 1.0f);
+	}
 }
 
+void computeTangentBasis(Mesh & mesh){
+	size_t vertexCount = mesh.vertices.size();
 
+	// Both paths give a tangent and a handedness w, and the bitangent is
+	// always cross(n, t) * w : the tangent follows U even when the UVs are
+	// mirrored, whether the mesh is indexed or not.
+	std::vector<glm::vec4> tangents;
+	if ( mesh.isIndexed() ){
+		computeTangentBasis_indexed(mesh.indices, mesh.vertices, mesh.uvs, mesh.normals, tangents);
+	}else{
+		// Triangle soup : each vertex gets the tangent of its only triangle
+		tangents.resize(vertexCount, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		for (size_t i=0; i+2<vertexCount; i+=3 ){
+			glm::vec3 tangent, bitangent;
+			triangleTangents(mesh.vertices[i], mesh.vertices[i+1], mesh.vertices[i+2], mesh.uvs[i], mesh.uvs[i+1], mesh.uvs[i+2], tangent, bitangent);
+			for ( int k=0; k<3; k++ ){
+				if ( !orthonormalizeVertex(mesh.normals[i+k], tangent.x, tangent.y, tangent.z, bitangent.x, bitangent.y, bitangent.z, tangents[i+k]) )
+					tangents[i+k] = glm::vec4(anyTangent(mesh.normals[i+k]), 1.0f);
+			}
+		}
+	}
+
+	mesh.tangents  .resize(vertexCount);
+	mesh.bitangents.resize(vertexCount);
+	for ( size_t i=0; i<vertexCount; i++ ){
+		mesh.tangents[i]   = glm::vec3(tangents[i]);
+		mesh.bitangents[i] = glm::cross(mesh.normals[i], mesh.tangents[i]) * tangents[i].w;
+	}
+}
@@ -11,5 +11,19 @@ void computeTangentBasis(
 	std::vector<glm::vec3> & bitangents
 );
 
+// One tangent per vertex of an indexed mesh, computed in a single pass over
+// the triangles : shared vertices get a smooth tangent, without welding a
+// triangle soup afterwards. tangent.xyz is orthonormal to the normal, and
+// tangent.w is the handedness : bitangent = cross(normal, tangent.xyz) * tangent.w
+// Vertices whose triangles all have degenerate UVs get an arbitrary tangent.
+void computeTangentBasis_indexed(
+	// inputs
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	// output
+	std::vector<glm::vec4> & tangents
+);
 
 #endif
\ No newline at end of file
@@ -1,5 +1,8 @@
+#include <stdio.h>
 #include <vector>
+#include <string>
 #include <cstring>
+#include <algorithm>
 
 #include <GL/glew.h>
 
@@ -9,74 +12,177 @@ using namespace glm;
 
 #include "shader.hpp"
 #include "texture.hpp"
+#include "image.hpp"
+#include "fontatlas.hpp"
+#include "textbatch.hpp"
 
 #include "text2D.hpp"
 
 unsigned int Text2DTextureID;
+unsigned int Text2DVertexArrayID;
 unsigned int Text2DVertexBufferID;
-unsigned int Text2DUVBufferID;
+unsigned int Text2DIndexBufferID;
 unsigned int Text2DShaderID;
 unsigned int Text2DUniformID;
 
-void initText2D(const char * texturePath){
+// The queued characters. These arrays only grow : once they are big enough,
+// queueing text doesn't allocate anything.
+std::vector<TextVertex> Text2DVertices; // 4 per character
+unsigned int Text2DQuadCount = 0;       // Characters queued
+unsigned int Text2DBufferCapacity = 0;  // Characters that fit in the buffers
 
-	// Initialize texture
-	Text2DTextureID = loadDDS(texturePath);
+// With initText2DFont : the glyphs of the proportional font
+bool Text2DProportional = false;
+FontAtlas Text2DFont;
 
-	// Initialize VBO
+// The quads of the characters, and the shader
+static void initText2DBuffers(const std::vector<std::string> & defines){
+
+	// Initialize VBO. Text has its own VAO, so that its buffers and
+	// attributes don't change the ones of the application.
+	glGenVertexArrays(1, &Text2DVertexArrayID);
 	glGenBuffers(1, &Text2DVertexBufferID);
-	glGenBuffers(1, &Text2DUVBufferID);
+	glGenBuffers(1, &Text2DIndexBufferID);
+
+	GLint previousVertexArrayID;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArrayID);
+	glBindVertexArray(Text2DVertexArrayID);
+
+	// 1rst attribute buffer : vertices
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)0 );
+
+	// 2nd attribute buffer : UVs, in the same buffer
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)(2*sizeof(float)) );
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Text2DIndexBufferID);
+
+	glBindVertexArray(previousVertexArrayID);
 
 	// Initialize Shader
-	Text2DShaderID = LoadShaders( "TextVertexShader.vertexshader", "TextVertexShader.fragmentshader" );
+	Text2DShaderID = LoadShaders( "TextVertexShader.vertexshader", "TextVertexShader.fragmentshader", defines );
 
 	// Initialize uniforms' IDs
 	Text2DUniformID = glGetUniformLocation( Text2DShaderID, "myTextureSampler" );
+}
 
+void initText2D(const char * texturePath){
+
+	// Initialize texture
+	Text2DTextureID = loadDDS(texturePath);
+
+	Text2DProportional = false;
+	initText2DBuffers(std::vector<std::string>());
+}
+
+bool initText2DFont(const char * fontPath, const char * gridTexturePath){
+
+	FontAtlas font;
+	if ( !loadFontAtlas(fontPath, font) ){
+		// Not baked yet : make it from the grid, and save it for the next time
+		Image grid;
+		GlyphSet glyphs;
+		if ( !gridTexturePath || !decodeImage(gridTexturePath, grid) || !glyphsFromGrid(grid, glyphs) )
+			return false;
+		computeKerning(glyphs);
+
+		// A distance field, at half the resolution of the grid : still sharp when big
+		FontBakeOptions options;
+		options.distanceField = true;
+		options.downscale = 2;
+		options.spread = 8;
+		options.padding = 2;
+		if ( !bakeFontAtlas(glyphs, options, font) )
+			return false;
+		if ( !saveFontAtlas(fontPath, font) )
+			printf("Could not save the font in %s\n", fontPath);
+	}
+
+	// Initialize texture : one channel, used as the alpha of white text
+	glGenTextures(1, &Text2DTextureID);
+	glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
+	GLint previousAlignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, font.width, font.height, 0, GL_RED, GL_UNSIGNED_BYTE, &font.pixels[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+	GLint swizzle[4] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if ( font.distanceField ){
+		// Distances can be interpolated, but averaging them in mipmaps rounds the glyphs
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	}else{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	// The pixels are on the GPU now
+	std::vector<unsigned char>().swap(font.pixels);
+	Text2DFont = font;
+	Text2DProportional = true;
+
+	std::vector<std::string> defines;
+	if ( font.distanceField )
+		defines.push_back("DISTANCE_FIELD");
+	initText2DBuffers(defines);
+	return true;
 }
 
 void printText2D(const char * text, int x, int y, int size){
+	queueText2D(text, x, y, size);
+	flushText2D();
+}
+
+void queueText2D(const char * text, int x, int y, int size){
 
 	unsigned int length = strlen(text);
+	if ( length == 0 )
+		return; // Nothing to queue, and the arena may be empty : no &Text2DVertices[...]
+
+	// Grow the arena if needed (geometrically, so that it happens rarely)
+	unsigned int quadCount = Text2DQuadCount + length;
+	if ( 4*quadCount > Text2DVertices.size() )
+		Text2DVertices.resize( 4 * std::max(quadCount, 2*(unsigned int)Text2DVertices.size()/4) );
+
+	// Fill the arena
+	if ( Text2DProportional )
+		quadCount = Text2DQuadCount + generateFontQuads(Text2DFont, text, length, (float)x, (float)y, (float)size, &Text2DVertices[4*Text2DQuadCount]);
+	else
+		generateTextQuads(text, length, (float)x, (float)y, (float)size, &Text2DVertices[4*Text2DQuadCount]);
+	Text2DQuadCount = quadCount;
+}
 
-	// Fill buffers
-	std::vector<glm::vec2> vertices;
-	std::vector<glm::vec2> UVs;
-	for ( unsigned int i=0 ; i<length ; i++ ){
-		
-		glm::vec2 vertex_up_left    = glm::vec2( x+i*size     , y+size );
-		glm::vec2 vertex_up_right   = glm::vec2( x+i*size+size, y+size );
-		glm::vec2 vertex_down_right = glm::vec2( x+i*size+size, y      );
-		glm::vec2 vertex_down_left  = glm::vec2( x+i*size     , y      );
-
-		vertices.push_back(vertex_up_left   );
-		vertices.push_back(vertex_down_left );
-		vertices.push_back(vertex_up_right  );
-
-		vertices.push_back(vertex_down_right);
-		vertices.push_back(vertex_up_right);
-		vertices.push_back(vertex_down_left);
-
-		char character = text[i];
-		float uv_x = (character%16)/16.0f;
-		float uv_y = (character/16)/16.0f;
-
-		glm::vec2 uv_up_left    = glm::vec2( uv_x           , uv_y );
-		glm::vec2 uv_up_right   = glm::vec2( uv_x+1.0f/16.0f, uv_y );
-		glm::vec2 uv_down_right = glm::vec2( uv_x+1.0f/16.0f, (uv_y + 1.0f/16.0f) );
-		glm::vec2 uv_down_left  = glm::vec2( uv_x           , (uv_y + 1.0f/16.0f) );
-		UVs.push_back(uv_up_left   );
-		UVs.push_back(uv_down_left );
-		UVs.push_back(uv_up_right  );
-
-		UVs.push_back(uv_down_right);
-		UVs.push_back(uv_up_right);
-		UVs.push_back(uv_down_left);
-	}
+void flushText2D(){
+
+	if ( Text2DQuadCount == 0 )
+		return;
+
+	GLint previousVertexArrayID;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArrayID);
+	glBindVertexArray(Text2DVertexArrayID);
 	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), &vertices[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-	glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs[0], GL_STATIC_DRAW);
+
+	if ( Text2DQuadCount > Text2DBufferCapacity ){
+		// The buffers are too small : make them as big as the arena.
+		// The indices are the same for every frame, so they are only written now.
+		Text2DBufferCapacity = Text2DVertices.size() / 4;
+		std::vector<unsigned int> indices(6 * Text2DBufferCapacity);
+		generateQuadIndices(0, Text2DBufferCapacity, &indices[0]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, Text2DBufferCapacity * 4 * sizeof(TextVertex), NULL, GL_STREAM_DRAW);
+	}else{
+		// "Orphan" the buffer : the driver gives us new memory instead of
+		// waiting for the previous draw call to finish with the old one.
+		glBufferData(GL_ARRAY_BUFFER, Text2DBufferCapacity * 4 * sizeof(TextVertex), NULL, GL_STREAM_DRAW);
+	}
+
+	// One upload for all the queued text
+	glBufferSubData(GL_ARRAY_BUFFER, 0, Text2DQuadCount * 4 * sizeof(TextVertex), &Text2DVertices[0]);
 
 	// Bind shader
 	glUseProgram(Text2DShaderID);
@@ -87,37 +193,35 @@ void printText2D(const char * text, int x, int y, int size){
 	// Set our "myTextureSampler" sampler to user Texture Unit 0
 	glUniform1i(Text2DUniformID, 0);
 
-	// 1rst attribute buffer : vertices
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
-
-	// 2nd attribute buffer : UVs
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
-
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// Draw call
-	glDrawArrays(GL_TRIANGLES, 0, vertices.size() );
+	// Draw call : all the queued text at once
+	glDrawElements(GL_TRIANGLES, Text2DQuadCount * 6, GL_UNSIGNED_INT, (void*)0 );
 
 	glDisable(GL_BLEND);
 
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+	glBindVertexArray(previousVertexArrayID);
 
+	Text2DQuadCount = 0;
 }
 
 void cleanupText2D(){
 
 	// Delete buffers
 	glDeleteBuffers(1, &Text2DVertexBufferID);
-	glDeleteBuffers(1, &Text2DUVBufferID);
+	glDeleteBuffers(1, &Text2DIndexBufferID);
+	glDeleteVertexArrays(1, &Text2DVertexArrayID);
+
+	// Free the arena
+	std::vector<TextVertex>().swap(Text2DVertices);
+	Text2DQuadCount = 0;
+	Text2DBufferCapacity = 0;
 
 	// Delete texture
 	glDeleteTextures(1, &Text2DTextureID);
+	Text2DFont = FontAtlas();
+	Text2DProportional = false;
 
 	// Delete shader
 	glDeleteProgram(Text2DShaderID);
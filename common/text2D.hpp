@@ -1,8 +1,24 @@
 #ifndef TEXT2D_HPP
 #define TEXT2D_HPP
 
+// A monospaced font : a .DDS texture with a 16x16 grid of characters
 void initText2D(const char * texturePath);
+
+// A proportional font, with kerning (see fontatlas.hpp). If fontPath doesn't
+// exist yet, it's baked from gridTexturePath (a grid, like for initText2D)
+// and saved in fontPath. Returns false if neither works.
+bool initText2DFont(const char * fontPath, const char * gridTexturePath = NULL);
+
+// Draws text now. To draw many strings, use queueText2D and flushText2D :
+// it's much faster.
 void printText2D(const char * text, int x, int y, int size);
+
+// Adds text to the batch. Nothing is drawn until flushText2D().
+void queueText2D(const char * text, int x, int y, int size);
+
+// Draws all the queued text with one upload and one draw call, and empties the batch.
+void flushText2D();
+
 void cleanupText2D();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include "sse2.hpp"
+
+#include "fontatlas.hpp"
+#include "textbatch.hpp"
+
+// Where each character is in the texture : u0, v0 (up left), u1, v1 (down right)
+struct GlyphRects{
+	float rect[256][4];
+
+	GlyphRects(){
+		for ( int c=0; c<256; c++ ){
+			float uv_x = (c%16)/16.0f;
+			float uv_y = (c/16)/16.0f;
+			rect[c][0] = uv_x;
+			rect[c][1] = uv_y;
+			rect[c][2] = uv_x + 1.0f/16.0f;
+			rect[c][3] = uv_y + 1.0f/16.0f;
+		}
+	}
+};
+
+static const GlyphRects & glyphRects(){
+	static GlyphRects rects;
+	return rects;
+}
+
+void generateTextQuads(const char * text, unsigned int length, float x, float y, float size, TextVertex * out){
+
+	const GlyphRects & glyphs = glyphRects();
+
+	for ( unsigned int i=0 ; i<length ; i++ ){
+
+		const float * uv = glyphs.rect[(unsigned char)text[i]];
+		float x0 = x + i*size;
+
+#ifdef COMMON_SSE2
+		// One register per vertex : the position comes from pos, the UV from uvs
+		__m128 pos = _mm_setr_ps(x0, y, x0+size, y+size); // left, down, right, up
+		__m128 uvs = _mm_loadu_ps(uv);                    // u0, v0, u1, v1
+		float * v = &out[4*i].x;
+		_mm_storeu_ps(v +  0, _mm_shuffle_ps(pos, uvs, _MM_SHUFFLE(1,0,3,0))); // up left    : left,  up,   u0, v0
+		_mm_storeu_ps(v +  4, _mm_shuffle_ps(pos, uvs, _MM_SHUFFLE(1,2,3,2))); // up right   : right, up,   u1, v0
+		_mm_storeu_ps(v +  8, _mm_shuffle_ps(pos, uvs, _MM_SHUFFLE(3,2,1,2))); // down right : right, down, u1, v1
+		_mm_storeu_ps(v + 12, _mm_shuffle_ps(pos, uvs, _MM_SHUFFLE(3,0,1,0))); // down left  : left,  down, u0, v1
+#else
+		TextVertex * v = &out[4*i];
+		TextVertex vertex_up_left    = { x0     , y+size, uv[0], uv[1] };
+		TextVertex vertex_up_right   = { x0+size, y+size, uv[2], uv[1] };
+		TextVertex vertex_down_right = { x0+size, y     , uv[2], uv[3] };
+		TextVertex vertex_down_left  = { x0     , y     , uv[0], uv[3] };
+		v[0] = vertex_up_left;
+		v[1] = vertex_up_right;
+		v[2] = vertex_down_right;
+		v[3] = vertex_down_left;
+#endif
+	}
+}
+
+unsigned int generateFontQuads(const FontAtlas & font, const char * text, unsigned int length, float x, float y, float size, TextVertex * out){
+
+	float scale = size / font.lineHeight;
+	float inverseWidth = 1.0f / font.width;
+	float inverseHeight = 1.0f / font.height;
+
+	// y is the bottom of the line, like for the grid
+	float baseline = y + (font.lineHeight - font.ascent) * scale;
+	float pen = x;
+
+	unsigned int quadCount = 0;
+	unsigned int previous = 0;
+	for ( unsigned int i=0 ; i<length ; i++ ){
+
+		unsigned int character = (unsigned char)text[i];
+		const FontGlyph * glyph = font.glyph(character);
+		if ( !glyph )
+			continue;
+		if ( previous )
+			pen += font.kerning(previous, character) * scale;
+		previous = character;
+
+		if ( glyph->width ){
+			float left   = pen + glyph->left * scale;
+			float right  = left + glyph->width * scale;
+			float top    = baseline + glyph->top * scale;
+			float bottom = top - glyph->height * scale;
+			float u0 = glyph->x * inverseWidth;
+			float v0 = glyph->y * inverseHeight;
+			float u1 = (glyph->x + glyph->width) * inverseWidth;
+			float v1 = (glyph->y + glyph->height) * inverseHeight;
+
+			TextVertex * v = &out[4*quadCount];
+			TextVertex vertex_up_left    = { left , top   , u0, v0 };
+			TextVertex vertex_up_right   = { right, top   , u1, v0 };
+			TextVertex vertex_down_right = { right, bottom, u1, v1 };
+			TextVertex vertex_down_left  = { left , bottom, u0, v1 };
+			v[0] = vertex_up_left;
+			v[1] = vertex_up_right;
+			v[2] = vertex_down_right;
+			v[3] = vertex_down_left;
+			quadCount++;
+		}
+
+		pen += glyph->advance * (scale / 64.0f);
+	}
+	return quadCount;
+}
+
+void generateQuadIndices(unsigned int firstQuad, unsigned int quadCount, unsigned int * out){
+	for ( unsigned int i=0; i<quadCount; i++ ){
+		unsigned int v = 4*(firstQuad + i);
+		// Same triangles as before : (up left, down left, up right) and (down right, up right, down left)
+		out[6*i+0] = v+0;
+		out[6*i+1] = v+3;
+		out[6*i+2] = v+1;
+		out[6*i+3] = v+2;
+		out[6*i+4] = v+1;
+		out[6*i+5] = v+3;
+	}
+}
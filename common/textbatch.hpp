@@ -0,0 +1,32 @@
+#ifndef TEXTBATCH_HPP
+#define TEXTBATCH_HPP
+
+// The CPU side of text2D : the quads of the characters, without OpenGL.
+//
+// Each character is one quad of 4 vertices, interleaved (position and UV
+// together), and drawn with 6 indices. The font is a 16x16 grid of characters
+// in a texture : character c is in column c%16, row c/16.
+
+struct FontAtlas;
+
+struct TextVertex{
+	float x, y; // In pixels, like printText2D's x and y
+	float u, v;
+};
+
+// Writes the 4 vertices of each character of text (length characters) in
+// out, which must have room for 4*length vertices.
+// The first character is at (x, y), and each character is size x size pixels.
+void generateTextQuads(const char * text, unsigned int length, float x, float y, float size, TextVertex * out);
+
+// Same thing with a proportional font (see fontatlas.hpp) : size is the
+// height of a line, and the characters are as wide as they should be, with
+// kerning. Characters without pixels (spaces) or not in the font don't get a
+// quad. Returns the number of quads written (length at most).
+unsigned int generateFontQuads(const FontAtlas & font, const char * text, unsigned int length, float x, float y, float size, TextVertex * out);
+
+// Writes the 6 indices of quads firstQuad ... firstQuad+quadCount-1 in out.
+// They are the same for all the strings, so they are computed only once.
+void generateQuadIndices(unsigned int firstQuad, unsigned int quadCount, unsigned int * out);
+
+#endif
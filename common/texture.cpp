@@ -2,88 +2,27 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+#include <algorithm>
+#include <string>
+
 #include <GL/glew.h>
 
 #include <glfw3.h>
 
+#include "threadpool.hpp"
+#include "texture.hpp"
 
-GLuint loadBMP_custom(const char * imagepath){
-
-	printf("Reading image %s\n", imagepath);
-
-	// Data read from the header of the BMP file
-	unsigned char header[54];
-	unsigned int dataPos;
-	unsigned int imageSize;
-	unsigned int width, height;
-	// Actual RGB data
-	unsigned char * data;
-
-	// Open the file
-	FILE * file = fopen(imagepath,"rb");
-	if (!file)							    {printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); return 0;}
 
-	// Read the header, i.e. the 54 first bytes
+GLuint loadBMP_custom(const char * imagepath){
 
-	// If less than 54 bytes are read, problem
-	if ( fread(header, 1, 54, file)!=54 ){ 
-		printf("Not a correct BMP file\n");
+	// Read the file on the CPU (see image.cpp)
+	Image image;
+	if ( !decodeBMP(imagepath, image) )
 		return 0;
-	}
-	// A BMP files always begins with "BM"
-	if ( header[0]!='B' || header[1]!='M' ){
-		printf("Not a correct BMP file\n");
-		return 0;
-	}
-	// Make sure this is a 24bpp file
-	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    return 0;}
-	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    return 0;}
-
-	// Read the information about the image
-	dataPos    = *(int*)&(header[0x0A]);
-	imageSize  = *(int*)&(header[0x22]);
-	width      = *(int*)&(header[0x12]);
-	height     = *(int*)&(header[0x16]);
-
-	// Some BMP files are misformatted, guess missing information
-	if (imageSize==0)    imageSize=width*height*3; // 3 : one byte for each Red, Green and Blue component
-	if (dataPos==0)      dataPos=54; // The BMP header is done that way
-
-	// Create a buffer
-	data = new unsigned char [imageSize];
-
-	// Read the actual data from the file into the buffer
-	fread(data,1,imageSize,file);
-
-	// Everything is in memory now, the file wan be closed
-	fclose (file);
-
-	// Create one OpenGL texture
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-	// OpenGL has now copied the data. Free our own version
-	delete [] data;
 
-	// Poor filtering, or ...
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); 
-
-	// ... nice trilinear filtering.
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); 
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	// Return the ID of the texture we just created
-	return textureID;
+	// Then give it to OpenGL
+	return uploadTexture(image);
 }
 
 // Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
@@ -113,99 +52,231 @@ GLuint loadBMP_custom(const char * imagepath){
 
 
 
-#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
-#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
-#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+
 
 GLuint loadDDS(const char * imagepath){
 
-	unsigned char header[124];
+	Image image;
+	if ( !decodeDDS(imagepath, image) )
+		return 0;
 
-	FILE *fp; 
- 
-	/* try to open the file */ 
-	fp = fopen(imagepath, "rb"); 
-	if (fp == NULL){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
+	return uploadTexture(image);
+}
+
+GLenum textureTarget(const Image & image){
+	if ( image.layerCount > 1 )
+		return image.isCubemap() ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_2D_ARRAY;
+	return image.isCubemap() ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+}
+
+GLuint uploadTexture(const Image & image){
+
+	if ( image.mips.empty() )
 		return 0;
+
+	GLenum target = textureTarget(image);
+
+	// Create one OpenGL texture
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+
+	// "Bind" the newly created texture : all future texture functions will modify this texture
+	glBindTexture(target, textureID);
+
+	if ( !image.isCompressed() ){
+
+		bool hasAlpha = image.format == IMAGE_BGRA8;
+		GLint internalFormat = hasAlpha ? (image.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA) : (image.srgb ? GL_SRGB8 : GL_RGB);
+
+		// Give the image to OpenGL. BMP rows are padded to 4 bytes, like OpenGL expects by default.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (unsigned int level = 0; level < image.mips.size(); ++level){
+			const ImageMip & mip = image.mips[level];
+			glTexImage2D(GL_TEXTURE_2D, level, internalFormat, mip.width, mip.height, 0, hasAlpha ? GL_BGRA : GL_BGR, GL_UNSIGNED_BYTE, image.mipData(level));
+		}
+
+		// Poor filtering, or ...
+		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); 
+
+		// ... nice trilinear filtering.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); 
+
+		// Let the driver make the mipmaps, unless they were made on the CPU (see mipmap.hpp)
+		if ( image.mips.size() == 1 )
+			glGenerateMipmap(GL_TEXTURE_2D);
+		else
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.mips.size() - 1);
+
+		// Return the ID of the texture we just created
+		return textureID;
 	}
-   
-	/* verify the type of file */ 
-	char filecode[4]; 
-	fread(filecode, 1, 4, fp); 
-	if (strncmp(filecode, "DDS ", 4) != 0) { 
-		fclose(fp); 
-		return 0; 
-	}
-	
-	/* get the surface desc */ 
-	fread(&header, 124, 1, fp); 
-
-	unsigned int height      = *(unsigned int*)&(header[8 ]);
-	unsigned int width	     = *(unsigned int*)&(header[12]);
-	unsigned int linearSize	 = *(unsigned int*)&(header[16]);
-	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-	unsigned int fourCC      = *(unsigned int*)&(header[80]);
-
- 
-	unsigned char * buffer;
-	unsigned int bufsize;
-	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
-	/* close the file pointer */ 
-	fclose(fp);
-
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
+
 	unsigned int format;
-	switch(fourCC) 
+	switch(image.format) 
 	{ 
-	case FOURCC_DXT1: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
+	case IMAGE_DXT1: 
+		format = image.srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
+		break; 
+	case IMAGE_DXT3: 
+		format = image.srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT : GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
+		break; 
+	case IMAGE_DXT5: 
+		format = image.srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
 		break; 
-	case FOURCC_DXT3: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
+	case IMAGE_BC4: 
+		format = GL_COMPRESSED_RED_RGTC1; 
 		break; 
-	case FOURCC_DXT5: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
+	case IMAGE_BC4_SIGNED: 
+		format = GL_COMPRESSED_SIGNED_RED_RGTC1; 
+		break; 
+	case IMAGE_BC5: 
+		format = GL_COMPRESSED_RG_RGTC2; 
+		break; 
+	case IMAGE_BC5_SIGNED: 
+		format = GL_COMPRESSED_SIGNED_RG_RGTC2; 
 		break; 
 	default: 
-		free(buffer); 
-		return 0; 
+		format = image.srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM; 
+		break; 
 	}
 
-	// Create one OpenGL texture
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
 	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
-	
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
-	unsigned int offset = 0;
+
+	// The file may have fewer mips than a full chain : tell OpenGL, or the texture is incomplete
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)image.mips.size() - 1);
 
 	/* load the mipmaps */ 
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) 
+	for (unsigned int level = 0; level < image.mips.size(); ++level) 
 	{ 
-		unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize; 
-		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,  
-			0, size, buffer + offset); 
-	 
-		offset += size; 
-		width  /= 2; 
-		height /= 2; 
-
-		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-		if(width < 1) width = 1;
-		if(height < 1) height = 1;
-
+		const ImageMip & mip = image.mips[level];
+
+		if ( target == GL_TEXTURE_2D ){
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, mip.width, mip.height,  
+				0, (GLsizei)mip.size, image.mipData(level)); 
+		}else if ( target == GL_TEXTURE_CUBE_MAP ){
+			// The faces are in the same order as the GL_TEXTURE_CUBE_MAP_* enums
+			for ( unsigned int face=0; face<6; face++ )
+				glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, format, mip.width, mip.height,  
+					0, (GLsizei)mip.size, image.mipData(level, face)); 
+		}else{
+			// Arrays : in the file, all the mips of a face are together, but
+			// OpenGL wants all the faces of a mip together. So allocate the
+			// mip, then fill it one face at a time. For cubemap arrays, the
+			// faces are layer-faces : layer 0 +X, layer 0 -X, ..., layer 1 +X...
+			GLsizei depth = image.layerCount * image.faceCount;
+			glCompressedTexImage3D(target, level, format, mip.width, mip.height, depth,
+				0, (GLsizei)(mip.size * depth), NULL);
+			for ( unsigned int layer=0; layer<image.layerCount; layer++ )
+				for ( unsigned int face=0; face<image.faceCount; face++ )
+					glCompressedTexSubImage3D(target, level, 0, 0, layer * image.faceCount + face,
+						mip.width, mip.height, 1, format, (GLsizei)mip.size, image.mipData(level, face, layer));
+		}
 	} 
 
-	free(buffer); 
-
 	return textureID;
+}
+
+bool loadTextures(
+	const std::vector<std::string> & paths,
+	std::vector<GLuint> & textures,
+	unsigned int threadCount
+){
+	ThreadPool pool(threadCount);
+	TextureLoader loader(pool);
+	for ( size_t i=0; i<paths.size(); i++ )
+		loader.load(paths[i].c_str()); // ids are 0, 1, 2... : the same as i
+	loader.finish();
+
+	bool ok = true;
+	textures.resize(paths.size());
+	for ( size_t i=0; i<paths.size(); i++ ){
+		textures[i] = loader.texture((unsigned int)i);
+		ok = ok && textures[i] != 0;
+	}
+	return ok;
+}
+
+TextureLoader::TextureLoader(ThreadPool & pool) : images(pool) {
+}
+
+unsigned int TextureLoader::load(const char * imagepath){
+	textures.push_back(0);
+	return images.load(imagepath);
+}
+
+size_t TextureLoader::update(size_t maxUploads){
+	images.takeFinished(decoded);
+
+	size_t uploadCount = std::min(maxUploads, decoded.size());
+	for ( size_t i=0; i<uploadCount; i++ ){
+		if ( decoded[i].ok )
+			textures[decoded[i].id] = uploadTexture(decoded[i].image);
+	}
+	decoded.erase(decoded.begin(), decoded.begin() + uploadCount);
+	return uploadCount;
+}
+
+void TextureLoader::finish(){
+	// Upload what's ready while the others are decoded
+	while ( images.pendingCount() > 0 || !decoded.empty() ){
+		if ( update() == 0 )
+			images.waitAny();
+	}
+}
 
+bool TextureLoader::isDone(){
+	return images.pendingCount() == 0 && decoded.empty();
+}
+
+TextureCache::TextureCache(size_t imageBudgetBytes) : images(imageBudgetBytes) {
+}
+
+TextureCache::~TextureCache(){
+	for ( std::map<GLuint, Texture>::iterator t = textures.begin(); t != textures.end(); ++t ){
+		glDeleteTextures(1, &t->first);
+		images.release(t->second.image);
+	}
+}
 
-}
\ No newline at end of file
+GLuint TextureCache::acquire(const char * imagepath){
+	const Image * image = images.acquire(imagepath);
+	if ( image == NULL )
+		return 0;
+
+	// Each texture holds one reference to its image
+	std::map<const Image *, GLuint>::iterator t = textureOfImage.find(image);
+	if ( t != textureOfImage.end() ){
+		images.release(image);
+		textures[t->second].refCount++;
+		return t->second;
+	}
+
+	Texture texture;
+	texture.image = image;
+	texture.refCount = 1;
+	GLuint textureID = uploadTexture(*image);
+	if ( textureID == 0 ){
+		images.release(image);
+		return 0;
+	}
+	textures[textureID] = texture;
+	textureOfImage[image] = textureID;
+	return textureID;
+}
+
+void TextureCache::release(GLuint textureID){
+	std::map<GLuint, Texture>::iterator t = textures.find(textureID);
+	if ( t == textures.end() )
+		return;
+	if ( --t->second.refCount > 0 )
+		return;
+
+	glDeleteTextures(1, &textureID);
+	textureOfImage.erase(t->second.image);
+	images.release(t->second.image);
+	textures.erase(t);
+}
@@ -1,6 +1,9 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
+#include "image.hpp"
+#include "imagecache.hpp"
+
 // Load a .BMP file using our custom loader
 GLuint loadBMP_custom(const char * imagepath);
 
@@ -12,5 +15,85 @@ GLuint loadBMP_custom(const char * imagepath);
 // Load a .DDS file using GLFW's own loader
 GLuint loadDDS(const char * imagepath);
 
+// Creates an OpenGL texture from an image decoded by decodeBMP/decodeDDS (see image.hpp).
+// This is the only part of loadBMP_custom/loadDDS that needs the GL context.
+// Compressed .DDS images are uploaded with all their mips, and can be cubemaps
+// or arrays : bind them to textureTarget(image).
+GLuint uploadTexture(const Image & image);
+
+// GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP_ARRAY
+GLenum textureTarget(const Image & image);
+
+// Loads many .BMP/.DDS files at once : they are decoded in parallel, and
+// uploaded on this thread as soon as each one is ready.
+// textures[i] is 0 if paths[i] couldn't be loaded. Returns true if all were loaded.
+bool loadTextures(
+	const std::vector<std::string> & paths,
+	std::vector<GLuint> & textures,
+	unsigned int threadCount = 0 // 0 : one thread per core
+);
+
+// Loads textures in the background, while the application keeps rendering :
+//   TextureLoader loader(pool);
+//   unsigned int id = loader.load("uvmap.DDS");
+//   each frame : loader.update(4); then draw with loader.texture(id), which is 0 until it's ready.
+class TextureLoader{
+public:
+	explicit TextureLoader(ThreadPool & pool);
+
+	// Starts decoding the file. Returns its id : 0 for the first call, then 1, 2...
+	unsigned int load(const char * imagepath);
+
+	// Uploads at most maxUploads of the textures that are decoded (to limit the
+	// time spent per frame). Returns how many were uploaded.
+	size_t update(size_t maxUploads = (size_t)-1);
+
+	// Waits for all the textures and uploads them
+	void finish();
+
+	// All the requested textures are uploaded (or failed)
+	bool isDone();
+
+	// 0 if the texture isn't uploaded yet, or couldn't be loaded
+	GLuint texture(unsigned int id) const { return id < textures.size() ? textures[id] : 0; }
+
+private:
+	ImageLoader images;
+	std::vector<LoadedImage> decoded; // Decoded, but not uploaded yet
+	std::vector<GLuint> textures;     // By id
+};
+
+// Shares the textures between everything that loads the same files :
+//   GLuint texture = cache.acquire("uvmap.DDS"); // Same texture for every call
+//   ...
+//   cache.release(texture); // Deleted after the last release
+// Deleted textures keep their decoded image in an ImageCache (see
+// imagecache.hpp) while it fits in the budget : loading them again is just an upload.
+// Only use it on the thread that renders.
+class TextureCache{
+public:
+	explicit TextureCache(size_t imageBudgetBytes = 256*1024*1024);
+
+	// Must be destroyed while the GL context exists : deletes all the textures
+	~TextureCache();
+
+	// 0 if the file can't be loaded
+	GLuint acquire(const char * imagepath);
+	void release(GLuint texture);
+
+	// Hits, misses, evictions of the decoded images
+	ImageCacheStats stats() { return images.stats(); }
+	ImageCache & imageCache() { return images; }
+
+private:
+	struct Texture{
+		const Image * image;
+		unsigned int refCount;
+	};
+
+	ImageCache images;
+	std::map<const Image *, GLuint> textureOfImage;
+	std::map<GLuint, Texture> textures;
+};
 
-#endif
\ No newline at end of file
+#endif
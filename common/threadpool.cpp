@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(unsigned int threadCount) : busyCount(0), stopping(false) {
+	if ( threadCount == 0 )
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	for ( unsigned int i=0; i<threadCount; i++ )
+		threads.push_back( std::thread(&ThreadPool::workerLoop, this) );
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	for ( size_t i=0; i<threads.size(); i++ )
+		threads[i].join();
+}
+
+void ThreadPool::submit(const std::function<void()> & job){
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::wait(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while ( !jobs.empty() || busyCount > 0 )
+		allDone.wait(lock);
+}
+
+// What the threads of a parallelFor share. The threads that start after the
+// end of the loop only look at it, so it lives as long as the last of them.
+struct ParallelForState{
+	std::function<void(size_t)> function;
+	size_t count;
+	std::atomic<size_t> next;     // First index not taken yet
+	std::atomic<size_t> finished; // Number of indices done
+	std::mutex mutex;
+	std::condition_variable allDone;
+
+	// Takes indices until there are none left
+	void run(){
+		for(;;){
+			size_t i = next++;
+			if ( i >= count )
+				return;
+			function(i);
+			if ( ++finished == count ){
+				std::unique_lock<std::mutex> lock(mutex);
+				allDone.notify_all();
+			}
+		}
+	}
+};
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> & function){
+	if ( count == 0 )
+		return;
+
+	std::shared_ptr<ParallelForState> state(new ParallelForState);
+	state->function = function;
+	state->count = count;
+	state->next = 0;
+	state->finished = 0;
+
+	size_t helperCount = std::min(count - 1, threads.size());
+	for ( size_t i=0; i<helperCount; i++ )
+		submit([state](){ state->run(); });
+
+	// This thread works too : even if all the threads are busy (or if this
+	// is one of them), the loop finishes.
+	state->run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	while ( state->finished < count )
+		state->allDone.wait(lock);
+}
+
+void ThreadPool::workerLoop(){
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;){
+		while ( jobs.empty() && !stopping )
+			jobAvailable.wait(lock);
+		// Finish the queue before stopping
+		if ( jobs.empty() )
+			return;
+
+		std::function<void()> job;
+		job.swap(jobs.front());
+		jobs.pop_front();
+		busyCount++;
+
+		lock.unlock();
+		job();
+		lock.lock();
+
+		busyCount--;
+		if ( jobs.empty() && busyCount == 0 )
+			allDone.notify_all();
+	}
+}
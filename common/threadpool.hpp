@@ -0,0 +1,50 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// A fixed set of worker threads that run jobs in the order they were submitted.
+// Starting a thread is expensive, so create one pool and give it many small
+// jobs instead of starting a thread per job.
+class ThreadPool{
+public:
+	// 0 : one thread per core
+	explicit ThreadPool(unsigned int threadCount = 0);
+
+	// Waits for all the jobs, then stops the threads
+	~ThreadPool();
+
+	// Runs job on one of the threads, as soon as one is free. Thread-safe.
+	void submit(const std::function<void()> & job);
+
+	// Blocks until all the submitted jobs are finished
+	void wait();
+
+	// Runs function(0) ... function(count-1) on the threads, and on this one,
+	// and returns when they are all done. Unlike wait(), it only waits for
+	// these calls, so it can be used from a job.
+	void parallelFor(size_t count, const std::function<void(size_t)> & function);
+
+	unsigned int threadCount() const { return (unsigned int)threads.size(); }
+
+private:
+	ThreadPool(const ThreadPool &);            // Not copyable
+	ThreadPool & operator=(const ThreadPool &);
+
+	void workerLoop();
+
+	std::vector<std::thread> threads;
+	std::deque< std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable allDone;
+	size_t busyCount; // Jobs taken by a thread but not finished yet
+	bool stopping;
+};
+
+#endif
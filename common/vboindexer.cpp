@@ -1,11 +1,13 @@
 #include <vector>
-#include <map>
+#include <math.h>
 
 #include <glm/glm.hpp>
 
 #include "vboindexer.hpp"
+#include "mesh.hpp"
 
-#include <string.h> // for memcmp
+#include <stdio.h>
+#include <string.h> // for memcpy, memcmp
 
 
 // Returns true iif v1 can be considered equal to v2
@@ -74,30 +76,243 @@ void indexVBO_slow(
 	}
 }
 
+
+
+// The fast path : an open-addressing hash table (linear probing) that maps
+// a vertex to its index in out_XXXX.
+// A slot only stores the output index and the full hash of the vertex; the
+// vertex itself is read back from out_XXXX. So there is a single allocation
+// for the whole mesh instead of one std::map node per unique vertex, and
+// welding is O(n) instead of O(n log n).
+
+// Vertices are all position + UV + normal, seen as 8 floats.
 struct PackedVertex{
-	glm::vec3 position;
-	glm::vec2 uv;
-	glm::vec3 normal;
-	bool operator<(const PackedVertex that) const{
-		return memcmp((void*)this, (void*)&that, sizeof(PackedVertex))>0;
-	};
+	float values[8];
 };
 
-bool getSimilarVertexIndex_fast( 
-	PackedVertex & packed, 
-	std::map<PackedVertex,unsigned short> & VertexToOutIndex,
-	unsigned short & result
+static inline void packVertex(const glm::vec3 & vertex, const glm::vec2 & uv, const glm::vec3 & normal, PackedVertex & packed){
+	packed.values[0] = vertex.x; packed.values[1] = vertex.y; packed.values[2] = vertex.z;
+	packed.values[3] = uv.x;     packed.values[4] = uv.y;
+	packed.values[5] = normal.x; packed.values[6] = normal.y; packed.values[7] = normal.z;
+}
+
+static inline unsigned int floatBits(float value){
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+// Snaps a component on a 0.01 grid. Two components in the same cell are
+// always is_near(), so quantized welding never merges vertices that
+// indexVBO_slow wouldn't merge. (The opposite isn't true : two close
+// components can still fall on both sides of a cell boundary.)
+// The cell wouldn't fit in an int for huge values (and there is no cell for
+// NaN or infinity) : these keep their bits, in a range of their own.
+static inline long long quantize(float value){
+	if ( !(fabsf(value) < 2.0e7f) )
+		return (1LL << 32) | floatBits(value);
+	return (long long)floorf( value * 100.0f + 0.5f );
+}
+
+static inline unsigned int componentBits(float value, bool quantized){
+	if (quantized){
+		long long cell = quantize(value);
+		return (unsigned int)cell ^ (unsigned int)(cell >> 32);
+	}
+	return floatBits(value);
+}
+
+// MurmurHash3-style mixing of the 8 components
+static unsigned int hashVertex(const PackedVertex & packed, bool quantized){
+	unsigned int h = 0x9747b28c;
+	for (int i=0; i<8; i++){
+		unsigned int k = componentBits(packed.values[i], quantized);
+		k *= 0xcc9e2d51;
+		k  = (k << 15) | (k >> 17);
+		k *= 0x1b873593;
+		h ^= k;
+		h  = (h << 13) | (h >> 19);
+		h  = h * 5 + 0xe6546b64;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static bool sameVertex(const PackedVertex & a, const PackedVertex & b, bool quantized){
+	if ( !quantized )
+		return memcmp(a.values, b.values, sizeof(a.values)) == 0;
+	for (int i=0; i<8; i++){
+		if ( quantize(a.values[i]) != quantize(b.values[i]) )
+			return false;
+	}
+	return true;
+}
+
+// Welds count vertices from in_XXXX into out_XXXX, and writes one index per
+// input vertex in out_indices. out_XXXX must have room for count vertices.
+// If in_tangents is not NULL, the tangents and bitangents of merged vertices
+// are summed, like indexVBO_TBN always did.
+// Returns false if there are more unique vertices than IndexType can address.
+// Otherwise uniqueCount is the number of vertices written in out_XXXX.
+template <typename IndexType>
+static bool weldVertices(
+	const glm::vec3 * in_vertices,
+	const glm::vec2 * in_uvs,
+	const glm::vec3 * in_normals,
+	const glm::vec3 * in_tangents,
+	const glm::vec3 * in_bitangents,
+	unsigned int count,
+	bool quantized,
+
+	IndexType * out_indices,
+	glm::vec3 * out_vertices,
+	glm::vec2 * out_uvs,
+	glm::vec3 * out_normals,
+	glm::vec3 * out_tangents,
+	glm::vec3 * out_bitangents,
+	unsigned int & uniqueCount
 ){
-	std::map<PackedVertex,unsigned short>::iterator it = VertexToOutIndex.find(packed);
-	if ( it == VertexToOutIndex.end() ){
-		return false;
-	}else{
-		result = it->second;
+	// Keep the load factor under 2/3 : there are at most count unique vertices
+	unsigned int capacity = 16;
+	while ( capacity < count + count/2 )
+		capacity *= 2;
+	unsigned int mask = capacity - 1;
+
+	std::vector<unsigned int> slotIndex(capacity, 0); // output index + 1. 0 means "empty"
+	std::vector<unsigned int> slotHash(capacity);
+
+	const unsigned int maxIndex = (IndexType)~(IndexType)0;
+
+	uniqueCount = 0;
+
+	// For each input vertex
+	for ( unsigned int i=0; i<count; i++ ){
+
+		PackedVertex packed;
+		packVertex(in_vertices[i], in_uvs[i], in_normals[i], packed);
+		unsigned int hash = hashVertex(packed, quantized);
+
+		// Try to find a similar vertex in out_XXXX
+		unsigned int slot = hash & mask;
+		bool found = false;
+		while ( slotIndex[slot] != 0 ){
+			unsigned int candidate = slotIndex[slot] - 1;
+			if ( slotHash[slot] == hash ){
+				PackedVertex other;
+				packVertex(out_vertices[candidate], out_uvs[candidate], out_normals[candidate], other);
+				if ( sameVertex(packed, other, quantized) ){
+					found = true;
+					break;
+				}
+			}
+			slot = (slot + 1) & mask;
+		}
+
+		if ( found ){ // A similar vertex is already in the VBO, use it instead !
+			unsigned int index = slotIndex[slot] - 1;
+			out_indices[i] = (IndexType)index;
+			if ( in_tangents ){
+				// Average the tangents and the bitangents
+				out_tangents[index]   += in_tangents[i];
+				out_bitangents[index] += in_bitangents[i];
+			}
+		}else{ // If not, it needs to be added in the output data.
+			if ( uniqueCount > maxIndex ){
+				// This one wouldn't fit in an IndexType. Don't wrap around silently.
+				return false;
+			}
+			unsigned int index = uniqueCount++;
+			// Copy the tangents first : out_XXXX may be the same arrays as in_XXXX, with index <= i
+			if ( in_tangents ){
+				glm::vec3 tangent   = in_tangents[i];
+				glm::vec3 bitangent = in_bitangents[i];
+				out_tangents[index]   = tangent;
+				out_bitangents[index] = bitangent;
+			}
+			out_vertices[index] = glm::vec3(packed.values[0], packed.values[1], packed.values[2]);
+			out_uvs     [index] = glm::vec2(packed.values[3], packed.values[4]);
+			out_normals [index] = glm::vec3(packed.values[5], packed.values[6], packed.values[7]);
+			out_indices [i]     = (IndexType)index;
+			slotIndex[slot] = index + 1;
+			slotHash [slot] = hash;
+		}
+	}
+
+	return true;
+}
+
+// Shared by all the std::vector versions of indexVBO and indexVBO_TBN.
+// in_tangents and out_tangents are NULL when there is no TBN to merge.
+template <typename IndexType>
+static bool indexVBO_impl(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> * in_tangents,
+	std::vector<glm::vec3> * in_bitangents,
+
+	std::vector<IndexType> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> * out_tangents,
+	std::vector<glm::vec3> * out_bitangents,
+
+	bool weldNearVertices
+){
+	unsigned int count = in_vertices.size();
+	if ( count == 0 )
 		return true;
+
+	// Make room for the worst case (no vertex can be shared), shrink afterwards.
+	size_t firstIndex = out_indices.size();
+	size_t firstVertex = out_vertices.size();
+	out_indices .resize(firstIndex  + count);
+	out_vertices.resize(firstVertex + count);
+	out_uvs     .resize(firstVertex + count);
+	out_normals .resize(firstVertex + count);
+	if ( in_tangents ){
+		out_tangents  ->resize(firstVertex + count);
+		out_bitangents->resize(firstVertex + count);
 	}
+
+	unsigned int uniqueCount;
+	bool ok = weldVertices<IndexType>(
+		&in_vertices[0], &in_uvs[0], &in_normals[0],
+		in_tangents ? &(*in_tangents)[0] : NULL, in_bitangents ? &(*in_bitangents)[0] : NULL,
+		count, weldNearVertices,
+		&out_indices[firstIndex], &out_vertices[firstVertex], &out_uvs[firstVertex], &out_normals[firstVertex],
+		in_tangents ? &(*out_tangents)[firstVertex] : NULL, in_tangents ? &(*out_bitangents)[firstVertex] : NULL,
+		uniqueCount
+	);
+
+	// Indices are relative to what was already in out_XXXX
+	if ( ok && (unsigned long long)firstVertex + uniqueCount - 1 > (IndexType)~(IndexType)0 )
+		ok = false;
+	if ( !ok ){
+		printf("indexVBO : too many vertices for %d-bit indices. Use unsigned int indices, or splitIndexedMesh().\n", (int)(8*sizeof(IndexType)));
+		out_indices .resize(firstIndex);
+		uniqueCount = 0;
+	}else{
+		for ( unsigned int i=0; i<count; i++ )
+			out_indices[firstIndex + i] += (IndexType)firstVertex;
+	}
+
+	out_vertices.resize(firstVertex + uniqueCount);
+	out_uvs     .resize(firstVertex + uniqueCount);
+	out_normals .resize(firstVertex + uniqueCount);
+	if ( in_tangents ){
+		out_tangents  ->resize(firstVertex + uniqueCount);
+		out_bitangents->resize(firstVertex + uniqueCount);
+	}
+	return ok;
 }
 
-void indexVBO(
+bool indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
@@ -105,38 +320,89 @@ void indexVBO(
 	std::vector<unsigned short> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
+	std::vector<glm::vec3> & out_normals,
+
+	bool weldNearVertices
 ){
-	std::map<PackedVertex,unsigned short> VertexToOutIndex;
+	return indexVBO_impl<unsigned short>(in_vertices, in_uvs, in_normals, NULL, NULL,
+		out_indices, out_vertices, out_uvs, out_normals, NULL, NULL, weldNearVertices);
+}
 
-	// For each input vertex
-	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+bool indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
 
-		PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
-		
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
 
-		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex_fast( packed, VertexToOutIndex, index);
+	bool weldNearVertices
+){
+	return indexVBO_impl<unsigned int>(in_vertices, in_uvs, in_normals, NULL, NULL,
+		out_indices, out_vertices, out_uvs, out_normals, NULL, NULL, weldNearVertices);
+}
 
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
-		}else{ // If not, it needs to be added in the output data.
-			out_vertices.push_back( in_vertices[i]);
-			out_uvs     .push_back( in_uvs[i]);
-			out_normals .push_back( in_normals[i]);
-			unsigned short newindex = (unsigned short)out_vertices.size() - 1;
-			out_indices .push_back( newindex );
-			VertexToOutIndex[ packed ] = newindex;
-		}
-	}
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+
+	bool weldNearVertices
+){
+	out_indices.indices32.clear();
+	indexVBO_impl<unsigned int>(in_vertices, in_uvs, in_normals, NULL, NULL,
+		out_indices.indices32, out_vertices, out_uvs, out_normals, NULL, NULL, weldNearVertices);
+	out_indices.narrow(out_vertices.size());
 }
 
 
 
+bool indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
 
+	std::vector<unsigned short> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents,
 
+	bool weldNearVertices
+){
+	return indexVBO_impl<unsigned short>(in_vertices, in_uvs, in_normals, &in_tangents, &in_bitangents,
+		out_indices, out_vertices, out_uvs, out_normals, &out_tangents, &out_bitangents, weldNearVertices);
+}
 
+bool indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents,
+
+	bool weldNearVertices
+){
+	return indexVBO_impl<unsigned int>(in_vertices, in_uvs, in_normals, &in_tangents, &in_bitangents,
+		out_indices, out_vertices, out_uvs, out_normals, &out_tangents, &out_bitangents, weldNearVertices);
+}
 
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
@@ -145,33 +411,158 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	IndexBuffer & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
 	std::vector<glm::vec3> & out_tangents,
-	std::vector<glm::vec3> & out_bitangents
+	std::vector<glm::vec3> & out_bitangents,
+
+	bool weldNearVertices
 ){
-	// For each input vertex
-	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+	out_indices.indices32.clear();
+	indexVBO_impl<unsigned int>(in_vertices, in_uvs, in_normals, &in_tangents, &in_bitangents,
+		out_indices.indices32, out_vertices, out_uvs, out_normals, &out_tangents, &out_bitangents, weldNearVertices);
+	out_indices.narrow(out_vertices.size());
+}
 
-		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
+// Same thing, in place : unique vertices are moved to the front of the arrays,
+// which are then shrunk. The only new allocations are the hash table and the indices.
+void indexVBO(Mesh & mesh, bool weldNearVertices){
+	unsigned int count = mesh.vertices.size();
+	if ( count == 0 )
+		return;
 
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
+	bool hasTBN = mesh.hasTangents();
+	std::vector<unsigned int> remap(count);
+	unsigned int uniqueCount;
+	weldVertices<unsigned int>(
+		&mesh.vertices[0], &mesh.uvs[0], &mesh.normals[0],
+		hasTBN ? &mesh.tangents[0] : NULL, hasTBN ? &mesh.bitangents[0] : NULL,
+		count, weldNearVertices,
+		&remap[0], &mesh.vertices[0], &mesh.uvs[0], &mesh.normals[0],
+		hasTBN ? &mesh.tangents[0] : NULL, hasTBN ? &mesh.bitangents[0] : NULL,
+		uniqueCount
+	); // Can't fail with 32-bit indices
 
-			// Average the tangents and the bitangents
-			out_tangents[index] += in_tangents[i];
-			out_bitangents[index] += in_bitangents[i];
-		}else{ // If not, it needs to be added in the output data.
-			out_vertices.push_back( in_vertices[i]);
-			out_uvs     .push_back( in_uvs[i]);
-			out_normals .push_back( in_normals[i]);
-			out_tangents .push_back( in_tangents[i]);
-			out_bitangents .push_back( in_bitangents[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
+	if ( mesh.indices.empty() ){
+		mesh.indices.swap(remap); // Triangle soup : vertex i is used by index i
+	}else{
+		for ( size_t i=0; i<mesh.indices.size(); i++ )
+			mesh.indices[i] = remap[ mesh.indices[i] ];
+		for ( size_t l=0; l<mesh.lods.size(); l++ ){
+			std::vector<unsigned int> & indices = mesh.lods[l].indices;
+			for ( size_t i=0; i<indices.size(); i++ )
+				indices[i] = remap[ indices[i] ];
 		}
 	}
+
+	mesh.vertices.resize(uniqueCount);
+	mesh.uvs     .resize(uniqueCount);
+	mesh.normals .resize(uniqueCount);
+	if ( hasTBN ){
+		mesh.tangents  .resize(uniqueCount);
+		mesh.bitangents.resize(uniqueCount);
+	}
+}
+
+void moveIndices(Mesh & mesh, IndexBuffer & out_indices){
+	out_indices.indices16.clear();
+	out_indices.indices32.clear();
+	out_indices.indices32.swap(mesh.indices);
+	out_indices.narrow(mesh.vertices.size());
+}
+
+
+
+void IndexBuffer::narrow(size_t vertexCount){
+	use32bits = vertexCount > 65536;
+	if ( use32bits ){
+		indices16.clear();
+		return;
+	}
+	indices16.resize(indices32.size());
+	for ( size_t i=0; i<indices32.size(); i++ )
+		indices16[i] = (unsigned short)indices32[i];
+	std::vector<unsigned int>().swap(indices32); // Actually free the memory
+}
+
+
+
+void splitIndexedMesh(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<glm::vec3> & tangents,
+	const std::vector<glm::vec3> & bitangents,
+
+	std::vector<IndexedSubMesh> & out_submeshes,
+	unsigned int maxVertices
+){
+	const unsigned int NotInSubMesh = 0xFFFFFFFF;
+	bool hasTBN = !tangents.empty();
+
+	// remap[i] is the index of vertices[i] in the current submesh.
+	// Only the vertices of the current submesh are reset when starting a new one.
+	std::vector<unsigned int> remap(vertices.size(), NotInSubMesh);
+	std::vector<unsigned int> used;
+
+	out_submeshes.push_back(IndexedSubMesh());
+
+	for ( size_t t=0; t+2<indices.size(); t+=3 ){
+
+		// How many vertices of this triangle are not in the current submesh yet ?
+		unsigned int newVertices = 0;
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = indices[t+k];
+			bool duplicate = (k>0 && v==indices[t]) || (k>1 && v==indices[t+1]);
+			if ( remap[v] == NotInSubMesh && !duplicate )
+				newVertices++;
+		}
+
+		if ( used.size() + newVertices > maxVertices ){
+			// The triangle doesn't fit : close this submesh, start a new one
+			for ( size_t i=0; i<used.size(); i++ )
+				remap[ used[i] ] = NotInSubMesh;
+			used.clear();
+			out_submeshes.push_back(IndexedSubMesh());
+		}
+
+		IndexedSubMesh & submesh = out_submeshes.back();
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = indices[t+k];
+			if ( remap[v] == NotInSubMesh ){
+				remap[v] = used.size();
+				used.push_back(v);
+				submesh.vertices.push_back(vertices[v]);
+				submesh.uvs     .push_back(uvs[v]);
+				submesh.normals .push_back(normals[v]);
+				if ( hasTBN ){
+					submesh.tangents  .push_back(tangents[v]);
+					submesh.bitangents.push_back(bitangents[v]);
+				}
+			}
+			submesh.indices.push_back( (unsigned short)remap[v] );
+		}
+	}
+}
+
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<IndexedSubMesh> & out_submeshes,
+
+	bool weldNearVertices
+){
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	indexVBO(in_vertices, in_uvs, in_normals, indices, vertices, uvs, normals, weldNearVertices);
+
+	std::vector<glm::vec3> noTBN;
+	splitIndexedMesh(indices, vertices, uvs, normals, noTBN, noTBN, out_submeshes);
 }
@@ -1,17 +1,142 @@
 #ifndef VBOINDEXER_HPP
 #define VBOINDEXER_HPP
 
+// Index buffer with the narrowest index type that can address all the vertices :
+// 16 bits up to 65536 vertices, 32 bits above. Only one of the two vectors is used.
+// Draw it with glDrawElements(..., use32bits ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT, ...)
+struct IndexBuffer{
+	std::vector<unsigned short> indices16;
+	std::vector<unsigned int>   indices32;
+	bool use32bits;
+
+	IndexBuffer() : use32bits(false) {}
+
+	size_t size() const        { return use32bits ? indices32.size() : indices16.size(); }
+	size_t sizeInBytes() const { return use32bits ? indices32.size()*sizeof(unsigned int) : indices16.size()*sizeof(unsigned short); }
+	const void * data() const  { return size()==0 ? NULL : use32bits ? (const void*)&indices32[0] : (const void*)&indices16[0]; }
+	unsigned int operator[](size_t i) const { return use32bits ? indices32[i] : indices16[i]; }
+
+	// Moves indices32 to indices16 if vertexCount allows it
+	void narrow(size_t vertexCount);
+};
+
+// A part of a mesh that can be drawn with 16-bit indices
+struct IndexedSubMesh{
+	std::vector<unsigned short> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec3> tangents;   // Empty if the mesh had no tangents
+	std::vector<glm::vec3> bitangents; // Empty if the mesh had no bitangents
+};
+
+// Merges identical vertices, using a hash table : O(n).
+// If weldNearVertices is true, components are snapped on a 0.01 grid before
+// being compared, which approximates is_near(). Otherwise, vertices must be
+// bit-for-bit identical.
+// The unsigned short version returns false (and outputs no index) if the mesh
+// has more than 65536 unique vertices, instead of silently wrapping around.
+bool indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned short> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+
+	bool weldNearVertices = false
+);
+
+bool indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+
+	bool weldNearVertices = false
+);
+
+// Chooses 16 or 32-bit indices depending on the number of unique vertices.
+// out_indices is overwritten.
 void indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+
+	bool weldNearVertices = false
+);
+
+// Always 16-bit indices : the mesh is split in as many submeshes as needed.
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<IndexedSubMesh> & out_submeshes,
+
+	bool weldNearVertices = false
+);
+
+// Like indexVBO(..., true), but with a lame linear search : O(n^2).
+// Only kept as a reference. The results can differ a little : here, vertices
+// whose components are all closer than 0.01 are merged; indexVBO only merges
+// them if they fall in the same cells of its 0.01 grid.
+void indexVBO_slow(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
 	std::vector<unsigned short> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 );
 
+// Like indexVBO, but the tangents and bitangents of merged vertices are summed.
+bool indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<unsigned short> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents,
+
+	bool weldNearVertices = true
+);
+
+bool indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents,
+
+	bool weldNearVertices = true
+);
 
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
@@ -20,12 +145,29 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	IndexBuffer & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
 	std::vector<glm::vec3> & out_tangents,
-	std::vector<glm::vec3> & out_bitangents
+	std::vector<glm::vec3> & out_bitangents,
+
+	bool weldNearVertices = true
+);
+
+// Splits an indexed mesh in submeshes of at most maxVertices vertices each,
+// so that each of them can use 16-bit indices. Triangles are never split.
+// tangents and bitangents may be empty.
+void splitIndexedMesh(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<glm::vec3> & tangents,
+	const std::vector<glm::vec3> & bitangents,
+
+	std::vector<IndexedSubMesh> & out_submeshes,
+	unsigned int maxVertices = 65536
 );
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,382 @@
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+#include "vertexcache.hpp"
+
+// Simulation of the post-transform cache.
+// FIFO : a vertex is in the cache if less than cacheSize vertices were
+// transformed since it was. So we only need to remember when each vertex
+// was transformed.
+// LRU : the cache is a small array, most recently used vertex first.
+template <typename IndexType>
+static VertexCacheStats simulateVertexCache_impl(
+	const IndexType * indices, size_t indexCount, size_t vertexCount,
+	unsigned int cacheSize, VertexCacheModel model
+){
+	VertexCacheStats stats;
+	stats.vertexTransforms = 0;
+
+	if ( model == VERTEX_CACHE_FIFO ){
+		std::vector<unsigned int> transformTime(vertexCount, 0); // 0 means never
+		unsigned int time = cacheSize + 1;
+		for ( size_t i=0; i<indexCount; i++ ){
+			unsigned int v = indices[i];
+			if ( time - transformTime[v] > cacheSize ){
+				transformTime[v] = time++;
+				stats.vertexTransforms++;
+			}
+		}
+	}else{
+		std::vector<unsigned int> cache;
+		cache.reserve(cacheSize + 1);
+		for ( size_t i=0; i<indexCount; i++ ){
+			unsigned int v = indices[i];
+			std::vector<unsigned int>::iterator it = std::find(cache.begin(), cache.end(), v);
+			if ( it == cache.end() ){
+				stats.vertexTransforms++;
+				if ( cache.size() == cacheSize )
+					cache.pop_back();
+				cache.insert(cache.begin(), v);
+			}else{
+				std::rotate(cache.begin(), it, it + 1); // Move to front
+			}
+		}
+	}
+
+	size_t triangleCount = indexCount / 3;
+	stats.acmr = triangleCount == 0 ? 0.0f : (float)stats.vertexTransforms / triangleCount;
+	stats.atvr = vertexCount   == 0 ? 0.0f : (float)stats.vertexTransforms / vertexCount;
+	return stats;
+}
+
+VertexCacheStats simulateVertexCache(const std::vector<unsigned short> & indices, size_t vertexCount, unsigned int cacheSize, VertexCacheModel model){
+	return simulateVertexCache_impl(indices.empty() ? NULL : &indices[0], indices.size(), vertexCount, cacheSize, model);
+}
+
+VertexCacheStats simulateVertexCache(const std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize, VertexCacheModel model){
+	return simulateVertexCache_impl(indices.empty() ? NULL : &indices[0], indices.size(), vertexCount, cacheSize, model);
+}
+
+
+
+// Forsyth's algorithm. Each vertex has a score : high if it is in the cache
+// (it's free to use it again), and high if few triangles still use it (to
+// finish small areas instead of leaving holes). Each triangle's score is the
+// sum of the scores of its vertices, and we always draw the best triangle
+// that uses a vertex of the cache. Only the vertices and triangles near the
+// cache are updated after each triangle, so this is O(n).
+
+static const int ForsythCacheSize = 32; // LRU cache assumed by the scores
+static const int ForsythMaxValence = 32; // Valence scores are tabulated up to this
+
+struct ForsythScores{
+	float cachePosition[ForsythCacheSize];
+	float valence[ForsythMaxValence];
+
+	ForsythScores(){
+		// The last 3 vertices were used by the last triangle : using them again
+		// doesn't make the cache better, so they get a slightly lower score.
+		for ( int i=0; i<ForsythCacheSize; i++ )
+			cachePosition[i] = i < 3 ? 0.75f : powf(1.0f - (float)(i - 3) / (ForsythCacheSize - 3), 1.5f);
+		for ( int i=0; i<ForsythMaxValence; i++ )
+			valence[i] = i == 0 ? 0.0f : 2.0f * powf((float)i, -0.5f);
+	}
+};
+
+static inline float vertexScore(const ForsythScores & scores, int cachePosition, unsigned int liveTriangles){
+	if ( liveTriangles == 0 )
+		return -1.0f; // Not used anymore
+	float score = cachePosition >= 0 ? scores.cachePosition[cachePosition] : 0.0f;
+	return score + scores.valence[ std::min(liveTriangles, (unsigned int)ForsythMaxValence - 1) ];
+}
+
+template <typename IndexType>
+static void optimizeVertexCache_impl(IndexType * indices, size_t indexCount, size_t vertexCount){
+	static const ForsythScores scores;
+
+	size_t triangleCount = indexCount / 3;
+	if ( triangleCount == 0 )
+		return;
+
+	// Triangles of each vertex : adjacency[ adjacencyOffset[v] ... + liveTriangles[v] ]
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for ( size_t i=0; i<3*triangleCount; i++ )
+		liveTriangles[ indices[i] ]++;
+	std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for ( size_t v=0; v<vertexCount; v++ )
+		adjacencyOffset[v+1] = adjacencyOffset[v] + liveTriangles[v];
+	std::vector<unsigned int> adjacency(3*triangleCount);
+	{
+		std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for ( size_t i=0; i<3*triangleCount; i++ )
+			adjacency[ fill[ indices[i] ]++ ] = i / 3;
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for ( size_t v=0; v<vertexCount; v++ )
+		score[v] = vertexScore(scores, -1, liveTriangles[v]);
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<IndexType> output(3*triangleCount);
+
+	unsigned int cache[ForsythCacheSize + 3];
+	unsigned int newCache[ForsythCacheSize + 3];
+	int cacheCount = 0;
+
+	size_t nextInputTriangle = 0; // For when no triangle uses a vertex of the cache
+	long long best = -1;
+
+	for ( size_t outputTriangle=0; outputTriangle<triangleCount; outputTriangle++ ){
+
+		if ( best < 0 ){
+			while ( emitted[nextInputTriangle] )
+				nextInputTriangle++;
+			best = nextInputTriangle;
+		}
+
+		const IndexType * triangle = indices + 3*best;
+		output[3*outputTriangle+0] = triangle[0];
+		output[3*outputTriangle+1] = triangle[1];
+		output[3*outputTriangle+2] = triangle[2];
+		emitted[best] = 1;
+
+		// Remove the triangle from the adjacency of its vertices
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = triangle[k];
+			unsigned int * list = &adjacency[ adjacencyOffset[v] ];
+			unsigned int count = liveTriangles[v];
+			for ( unsigned int j=0; j<count; j++ ){
+				if ( list[j] == best ){
+					list[j] = list[count-1];
+					liveTriangles[v]--;
+					break;
+				}
+			}
+		}
+
+		// The vertices of the triangle go to the front of the cache
+		int newCacheCount = 0;
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = triangle[k];
+			if ( std::find(newCache, newCache + newCacheCount, v) == newCache + newCacheCount )
+				newCache[newCacheCount++] = v;
+		}
+		for ( int i=0; i<cacheCount; i++ ){
+			unsigned int v = cache[i];
+			if ( v != triangle[0] && v != triangle[1] && v != triangle[2] )
+				newCache[newCacheCount++] = v;
+		}
+
+		// Update the scores of the vertices of the cache, and of the evicted ones
+		for ( int i=0; i<newCacheCount; i++ ){
+			unsigned int v = newCache[i];
+			cachePosition[v] = i < ForsythCacheSize ? i : -1;
+			score[v] = vertexScore(scores, cachePosition[v], liveTriangles[v]);
+		}
+
+		// Only their triangles' scores changed : the best one is among them
+		best = -1;
+		float bestScore = -1.0f;
+		for ( int i=0; i<newCacheCount; i++ ){
+			unsigned int v = newCache[i];
+			const unsigned int * list = &adjacency[ adjacencyOffset[v] ];
+			for ( unsigned int j=0; j<liveTriangles[v]; j++ ){
+				unsigned int t = list[j];
+				float s = score[indices[3*t]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+				if ( s > bestScore && cachePosition[v] >= 0 ){
+					bestScore = s;
+					best = t;
+				}
+			}
+		}
+
+		cacheCount = std::min(newCacheCount, ForsythCacheSize);
+		std::copy(newCache, newCache + cacheCount, cache);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeVertexCache(std::vector<unsigned short> & indices, size_t vertexCount){
+	if ( !indices.empty() )
+		optimizeVertexCache_impl(&indices[0], indices.size(), vertexCount);
+}
+
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertexCount){
+	if ( !indices.empty() )
+		optimizeVertexCache_impl(&indices[0], indices.size(), vertexCount);
+}
+
+
+
+// Overdraw : a cluster is a run of triangles that starts where the vertex cache
+// is cold (a triangle whose 3 vertices all miss). Swapping clusters then costs
+// almost nothing in vertex cache efficiency. Clusters that face away from the
+// center of the mesh are on its outside : drawing them first lets the depth
+// test reject more of the others.
+
+struct OverdrawCluster{
+	size_t firstTriangle;
+	size_t triangleCount;
+	float sortKey;
+
+	bool operator<(const OverdrawCluster & other) const { return sortKey > other.sortKey; } // Outside first
+};
+
+template <typename IndexType>
+static void optimizeOverdraw_impl(std::vector<IndexType> & indices, const std::vector<glm::vec3> & vertices, float threshold){
+	size_t triangleCount = indices.size() / 3;
+	if ( triangleCount == 0 )
+		return;
+
+	// Find where the cache is cold (FIFO, like the GPU)
+	const unsigned int cacheSize = 16;
+	std::vector<unsigned int> transformTime(vertices.size(), 0);
+	unsigned int time = cacheSize + 1;
+	std::vector<OverdrawCluster> clusters;
+	for ( size_t t=0; t<triangleCount; t++ ){
+		int misses = 0;
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = indices[3*t+k];
+			if ( time - transformTime[v] > cacheSize ){
+				transformTime[v] = time++;
+				misses++;
+			}
+		}
+		if ( misses == 3 || t == 0 ){
+			OverdrawCluster cluster;
+			cluster.firstTriangle = t;
+			cluster.triangleCount = 0;
+			clusters.push_back(cluster);
+		}
+		clusters.back().triangleCount++;
+	}
+	if ( clusters.size() < 2 )
+		return;
+
+	// Center of the mesh, weighted by area
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0.0f;
+	for ( size_t t=0; t<triangleCount; t++ ){
+		const glm::vec3 & p0 = vertices[indices[3*t+0]];
+		const glm::vec3 & p1 = vertices[indices[3*t+1]];
+		const glm::vec3 & p2 = vertices[indices[3*t+2]];
+		float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+		meshCenter += (p0 + p1 + p2) * (area / 3.0f);
+		meshArea += area;
+	}
+	if ( meshArea > 0.0f )
+		meshCenter /= meshArea;
+
+	// sortKey : how much the cluster faces away from the center
+	for ( size_t c=0; c<clusters.size(); c++ ){
+		OverdrawCluster & cluster = clusters[c];
+		glm::vec3 center(0.0f);
+		glm::vec3 normal(0.0f); // Sum of the area-weighted normals
+		float area = 0.0f;
+		for ( size_t t=cluster.firstTriangle; t<cluster.firstTriangle + cluster.triangleCount; t++ ){
+			const glm::vec3 & p0 = vertices[indices[3*t+0]];
+			const glm::vec3 & p1 = vertices[indices[3*t+1]];
+			const glm::vec3 & p2 = vertices[indices[3*t+2]];
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float a = glm::length(n);
+			center += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+		if ( area > 0.0f )
+			center /= area;
+		float normalLength = glm::length(normal);
+		cluster.sortKey = normalLength > 0.0f ? glm::dot(center - meshCenter, normal / normalLength) : 0.0f;
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end());
+
+	std::vector<IndexType> sorted;
+	sorted.reserve(indices.size());
+	for ( size_t c=0; c<clusters.size(); c++ ){
+		sorted.insert(sorted.end(),
+			indices.begin() + 3*clusters[c].firstTriangle,
+			indices.begin() + 3*(clusters[c].firstTriangle + clusters[c].triangleCount));
+	}
+
+	// Only keep the new order if the vertex cache doesn't suffer too much
+	VertexCacheStats before = simulateVertexCache(indices, vertices.size());
+	VertexCacheStats after  = simulateVertexCache(sorted,  vertices.size());
+	if ( after.acmr <= before.acmr * threshold )
+		indices.swap(sorted);
+}
+
+void optimizeOverdraw(std::vector<unsigned short> & indices, const std::vector<glm::vec3> & vertices, float threshold){
+	optimizeOverdraw_impl(indices, vertices, threshold);
+}
+
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, float threshold){
+	optimizeOverdraw_impl(indices, vertices, threshold);
+}
+
+
+
+// Moves element i of data to newIndex[i]. Elements with newIndex[i] == Unused are dropped.
+template <typename T>
+static void remapArray(std::vector<T> & data, const std::vector<unsigned int> & newIndex, unsigned int newCount){
+	if ( data.empty() )
+		return;
+	std::vector<T> remapped(newCount);
+	for ( size_t i=0; i<data.size(); i++ ){
+		if ( newIndex[i] < newCount )
+			remapped[ newIndex[i] ] = data[i];
+	}
+	data.swap(remapped);
+}
+
+void optimizeVertexFetch(Mesh & mesh){
+	const unsigned int Unused = 0xFFFFFFFF;
+	std::vector<unsigned int> newIndex(mesh.vertexCount(), Unused);
+	unsigned int newCount = 0;
+	for ( size_t i=0; i<mesh.indices.size(); i++ ){
+		unsigned int & index = mesh.indices[i];
+		if ( newIndex[index] == Unused )
+			newIndex[index] = newCount++;
+		index = newIndex[index];
+	}
+	// LODs only use vertices of the full mesh
+	for ( size_t l=0; l<mesh.lods.size(); l++ ){
+		std::vector<unsigned int> & indices = mesh.lods[l].indices;
+		for ( size_t i=0; i<indices.size(); i++ )
+			indices[i] = newIndex[ indices[i] ];
+	}
+
+	// One array at a time, so that there is only one temporary copy at once
+	remapArray(mesh.vertices,   newIndex, newCount);
+	remapArray(mesh.uvs,        newIndex, newCount);
+	remapArray(mesh.normals,    newIndex, newCount);
+	remapArray(mesh.tangents,   newIndex, newCount);
+	remapArray(mesh.bitangents, newIndex, newCount);
+}
+
+
+
+void optimizeMesh(Mesh & mesh){
+	if ( !mesh.isIndexed() )
+		return;
+
+	VertexCacheStats before = simulateVertexCache(mesh.indices, mesh.vertexCount());
+
+	optimizeVertexCache(mesh.indices, mesh.vertexCount());
+	optimizeOverdraw(mesh.indices, mesh.vertices);
+	for ( size_t l=0; l<mesh.lods.size(); l++ ){
+		optimizeVertexCache(mesh.lods[l].indices, mesh.vertexCount());
+		optimizeOverdraw(mesh.lods[l].indices, mesh.vertices);
+	}
+	optimizeVertexFetch(mesh); // In the order of the full mesh : it's the one drawn from up close
+
+	VertexCacheStats after = simulateVertexCache(mesh.indices, mesh.vertexCount());
+	printf("Vertex cache : ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+}
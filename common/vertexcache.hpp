@@ -0,0 +1,67 @@
+#ifndef VERTEXCACHE_HPP
+#define VERTEXCACHE_HPP
+
+// Reordering of indexed meshes for the GPU.
+//
+// After indexVBO, the triangles are in the order of the .obj file. But the
+// GPU only keeps the last few transformed vertices in a small cache : if a
+// vertex is used again much later, the vertex shader runs again. So :
+// - optimizeVertexCache reorders the triangles so that the vertices they
+//   share are used close together (Tom Forsyth's "Linear-Speed Vertex Cache
+//   Optimisation" algorithm).
+// - optimizeOverdraw then reorders groups of triangles so that the ones on the
+//   outside of the mesh are drawn first, and hide the ones behind them.
+// - optimizeVertexFetch reorders the vertices in the order they are used, so
+//   that the vertex buffer is read sequentially.
+//
+// All of this is done on the CPU, and simulateVertexCache tells how good the
+// result is, without a GPU.
+
+struct Mesh;
+
+enum VertexCacheModel{
+	VERTEX_CACHE_FIFO, // What most GPUs really do
+	VERTEX_CACHE_LRU   // What the optimizer assumes
+};
+
+struct VertexCacheStats{
+	unsigned int vertexTransforms; // How many times the vertex shader runs
+	float acmr; // Average Cache Miss Ratio : vertex shader runs per triangle. 0.5 at best, 3 at worst.
+	float atvr; // Average Transformed Vertex Ratio : vertex shader runs per vertex. 1 at best.
+};
+
+// Draws the mesh with a simulated post-transform cache of cacheSize vertices
+VertexCacheStats simulateVertexCache(
+	const std::vector<unsigned short> & indices,
+	size_t vertexCount,
+	unsigned int cacheSize = 16,
+	VertexCacheModel model = VERTEX_CACHE_FIFO
+);
+
+VertexCacheStats simulateVertexCache(
+	const std::vector<unsigned int> & indices,
+	size_t vertexCount,
+	unsigned int cacheSize = 16,
+	VertexCacheModel model = VERTEX_CACHE_FIFO
+);
+
+// Reorders the triangles for the post-transform vertex cache. The vertices don't change.
+void optimizeVertexCache(std::vector<unsigned short> & indices, size_t vertexCount);
+void optimizeVertexCache(std::vector<unsigned int>   & indices, size_t vertexCount);
+
+// Reorders clusters of triangles from outside to inside, to reduce overdraw.
+// Use it after optimizeVertexCache : clusters are cut where the vertex cache is
+// cold anyway, and the new order is only kept if its ACMR is at most
+// threshold times the old one.
+void optimizeOverdraw(std::vector<unsigned short> & indices, const std::vector<glm::vec3> & vertices, float threshold = 1.05f);
+void optimizeOverdraw(std::vector<unsigned int>   & indices, const std::vector<glm::vec3> & vertices, float threshold = 1.05f);
+
+// Renumbers the vertices in the order of their first use in mesh.indices.
+// Unused vertices are removed. The indices of the LODs are updated too.
+void optimizeVertexFetch(Mesh & mesh);
+
+// All of the above on an indexed mesh and its LODs, and prints the ACMR/ATVR
+// of the full mesh before and after.
+void optimizeMesh(Mesh & mesh);
+
+#endif
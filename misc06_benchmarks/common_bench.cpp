@@ -0,0 +1,807 @@
+// Benchmarks of the CPU code of common/ : no window, no OpenGL, so it runs
+// anywhere, and regressions in the hot paths show up without a GPU.
+//
+// Usage : common_bench [--filter text] [--time seconds] [--human] [--output file]
+// Run it from misc06_benchmarks/ : it reads the meshes and textures of the tutorials.
+// The quaternion batch functions and the threaded particles are checked against
+// the plain versions first : if they differ, the exit code is 1.
+//
+// Each benchmark prints one line of JSON on stdout, or in --output if given.
+// Nothing else goes there : the messages of the loaders go to stderr.
+//   {"name":"loadOBJ/suzanne", "iterations":120, "median_ms":0.41, "min_ms":0.39,
+//    "allocations":23, "allocated_bytes":412000, "items":2904, "items_per_second":7.1e6,
+//    "megabytes_per_second":95.2}
+// "allocations" and "allocated_bytes" are per iteration (operator new only).
+// items are what the benchmark processes : triangles, vertices, pixels, characters...
+//
+// The synthetic assets (a big mesh and big textures) are written in the current
+// directory, only if their benchmarks are selected, and removed at exit. A crash
+// leaves them there.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <new>
+
+#ifdef _WIN32
+	#include <io.h>
+	#define dup _dup
+	#define dup2 _dup2
+	#define fileno _fileno
+	#define fdopen _fdopen
+#else
+	#include <unistd.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+using namespace glm;
+
+#include <common/objloader.hpp>
+#include <common/vboindexer.hpp>
+#include <common/tangentspace.hpp>
+#include <common/image.hpp>
+#include <common/mipmap.hpp>
+#include <common/threadpool.hpp>
+#include <common/fontatlas.hpp>
+#include <common/textbatch.hpp>
+#include <common/quaternion_utils.hpp>
+#include <common/particles.hpp>
+#include <common/random.hpp>
+
+// Counts all the allocations of the program
+static std::atomic<size_t> allocationCount(0);
+static std::atomic<size_t> allocatedBytes(0);
+
+void * operator new(size_t size){
+	allocationCount++;
+	allocatedBytes += size;
+	void * p = malloc(size ? size : 1);
+	if ( !p )
+		throw std::bad_alloc();
+	return p;
+}
+void * operator new[](size_t size){
+	return operator new(size);
+}
+void operator delete(void * p) noexcept{
+	free(p);
+}
+void operator delete[](void * p) noexcept{
+	free(p);
+}
+void operator delete(void * p, size_t) noexcept{
+	free(p);
+}
+void operator delete[](void * p, size_t) noexcept{
+	free(p);
+}
+
+struct BenchOptions{
+	std::string filter;
+	double minTime;  // In seconds, for each benchmark
+	bool human;      // Aligned text instead of JSON
+	FILE * output;
+};
+
+static BenchOptions options;
+
+static bool selected(const std::string & name){
+	return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+// Is any of prefixes[i] + suffix selected ?
+static bool selectedAny(const char * const * prefixes, int count, const std::string & suffix){
+	for ( int i=0; i<count; i++ )
+		if ( selected(prefixes[i] + suffix) )
+			return true;
+	return false;
+}
+
+// Runs body as many times as fits in options.minTime (3 times at least),
+// after a first run to warm up the caches, and prints the result.
+// items and bytes : how much one run processes (0 : don't print the throughput).
+static void bench(const std::string & name, double items, double bytes, const std::function<void()> & body){
+
+	if ( !selected(name) )
+		return;
+
+	typedef std::chrono::high_resolution_clock Clock;
+	body();
+
+	// Reserved before counting, so that the loop itself doesn't allocate
+	const size_t maxRuns = 100000;
+	std::vector<double> times;
+	times.reserve(maxRuns);
+	size_t allocations = allocationCount;
+	size_t allocated = allocatedBytes;
+	Clock::time_point start = Clock::now();
+	double total = 0.0;
+	while ( times.size() < 3 || (total < options.minTime && times.size() < maxRuns) ){
+		Clock::time_point t0 = Clock::now();
+		body();
+		Clock::time_point t1 = Clock::now();
+		times.push_back(std::chrono::duration<double>(t1 - t0).count());
+		total = std::chrono::duration<double>(t1 - start).count();
+	}
+	double runs = (double)times.size();
+	double allocationsPerRun = (allocationCount - allocations) / runs;
+	double bytesPerRun = (allocatedBytes - allocated) / runs;
+
+	std::sort(times.begin(), times.end());
+	double median = times[times.size() / 2];
+	double fastest = times[0];
+
+	if ( options.human ){
+		fprintf(options.output, "%-40s %8.3f ms (min %8.3f)  %9.0f allocs %11.0f bytes", name.c_str(), median*1000.0, fastest*1000.0, allocationsPerRun, bytesPerRun);
+		if ( items > 0 )
+			fprintf(options.output, "  %10.3g items/s", items / median);
+		if ( bytes > 0 )
+			fprintf(options.output, "  %8.1f MB/s", bytes / median / 1e6);
+		fprintf(options.output, "\n");
+	}else{
+		fprintf(options.output, "{\"name\":\"%s\", \"iterations\":%u, \"median_ms\":%.4f, \"min_ms\":%.4f, \"allocations\":%.0f, \"allocated_bytes\":%.0f",
+			name.c_str(), (unsigned int)times.size(), median*1000.0, fastest*1000.0, allocationsPerRun, bytesPerRun);
+		if ( items > 0 )
+			fprintf(options.output, ", \"items\":%.0f, \"items_per_second\":%.4g", items, items / median);
+		if ( bytes > 0 )
+			fprintf(options.output, ", \"megabytes_per_second\":%.4g", bytes / median / 1e6);
+		fprintf(options.output, "}\n");
+	}
+	fflush(options.output);
+}
+
+static size_t fileSize(const char * path){
+	FILE * file = fopen(path, "rb");
+	if ( !file )
+		return 0;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size > 0 ? (size_t)size : 0;
+}
+
+// Deterministic random numbers between 0 and 1
+static float random01(unsigned int & seed){
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+// Synthetic assets, written in the current directory
+
+static std::vector<const char *> syntheticAssets; // Removed at exit
+
+static void removeSyntheticAssets(){
+	for ( size_t i=0; i<syntheticAssets.size(); i++ )
+		remove(syntheticAssets[i]);
+	syntheticAssets.clear();
+}
+
+// A wavy grid of size x size quads, with UVs and normals : 2*size*size triangles
+static bool writeSyntheticOBJ(const char * path, int size){
+	FILE * file = fopen(path, "w");
+	if ( !file )
+		return false;
+	syntheticAssets.push_back(path);
+	for ( int y=0; y<=size; y++ )
+		for ( int x=0; x<=size; x++ )
+			fprintf(file, "v %f %f %f\n", x / (float)size, y / (float)size, 0.05f * sin(x * 0.3f) * cos(y * 0.2f));
+	for ( int y=0; y<=size; y++ )
+		for ( int x=0; x<=size; x++ )
+			fprintf(file, "vt %f %f\n", x / (float)size, y / (float)size);
+	for ( int y=0; y<=size; y++ )
+		for ( int x=0; x<=size; x++ )
+			fprintf(file, "vn %f %f %f\n", -0.015f * cos(x * 0.3f) * cos(y * 0.2f), 0.01f * sin(x * 0.3f) * sin(y * 0.2f), 1.0f);
+	for ( int y=0; y<size; y++ ){
+		for ( int x=0; x<size; x++ ){
+			int a = y*(size+1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1; // OBJ indices start at 1
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a,a,a, b,b,b, d,d,d);
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a,a,a, d,d,d, c,c,c);
+		}
+	}
+	return fclose(file) == 0;
+}
+
+static void writeLittleEndian(FILE * file, unsigned int value, int bytes){
+	for ( int i=0; i<bytes; i++ )
+		fputc((value >> (8*i)) & 0xFF, file);
+}
+
+// A 24bpp .BMP with noise
+static bool writeSyntheticBMP(const char * path, unsigned int width, unsigned int height){
+	FILE * file = fopen(path, "wb");
+	if ( !file )
+		return false;
+	syntheticAssets.push_back(path);
+	unsigned int rowSize = (width*3 + 3) & ~3u;
+	unsigned int imageSize = rowSize * height;
+	fputc('B', file); fputc('M', file);
+	writeLittleEndian(file, 54 + imageSize, 4);
+	writeLittleEndian(file, 0, 4);
+	writeLittleEndian(file, 54, 4);   // Where the pixels are
+	writeLittleEndian(file, 40, 4);   // BITMAPINFOHEADER
+	writeLittleEndian(file, width, 4);
+	writeLittleEndian(file, height, 4);
+	writeLittleEndian(file, 1, 2);    // Planes
+	writeLittleEndian(file, 24, 2);   // Bits per pixel
+	writeLittleEndian(file, 0, 4);    // No compression
+	writeLittleEndian(file, imageSize, 4);
+	for ( int i=0; i<4; i++ )
+		writeLittleEndian(file, 0, 4);
+	std::vector<unsigned char> row(rowSize, 0);
+	unsigned int seed = 7;
+	for ( unsigned int y=0; y<height; y++ ){
+		for ( unsigned int x=0; x<width*3; x++ )
+			row[x] = (unsigned char)(255 * random01(seed));
+		fwrite(&row[0], 1, rowSize, file);
+	}
+	return fclose(file) == 0;
+}
+
+// A DXT1 .DDS with all its mipmaps, with noise
+static bool writeSyntheticDDS(const char * path, unsigned int size){
+	FILE * file = fopen(path, "wb");
+	if ( !file )
+		return false;
+	syntheticAssets.push_back(path);
+	unsigned int mipCount = 1;
+	while ( (size >> (mipCount-1)) > 1 ) mipCount++;
+	fwrite("DDS ", 1, 4, file);
+	writeLittleEndian(file, 124, 4);                // Size of the header
+	writeLittleEndian(file, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000, 4); // CAPS, HEIGHT, WIDTH, PIXELFORMAT, MIPMAPCOUNT, LINEARSIZE
+	writeLittleEndian(file, size, 4);               // Height
+	writeLittleEndian(file, size, 4);               // Width
+	writeLittleEndian(file, (size/4)*(size/4)*8, 4); // Linear size
+	writeLittleEndian(file, 0, 4);                  // Depth
+	writeLittleEndian(file, mipCount, 4);
+	for ( int i=0; i<11; i++ )
+		writeLittleEndian(file, 0, 4);
+	writeLittleEndian(file, 32, 4);                 // Size of the pixel format
+	writeLittleEndian(file, 0x4, 4);                // FOURCC
+	fwrite("DXT1", 1, 4, file);
+	for ( int i=0; i<5; i++ )
+		writeLittleEndian(file, 0, 4);
+	writeLittleEndian(file, 0x1000 | 0x400000 | 0x8, 4); // TEXTURE, MIPMAP, COMPLEX
+	for ( int i=0; i<4; i++ )
+		writeLittleEndian(file, 0, 4);
+
+	unsigned int seed = 11;
+	for ( unsigned int level=0; level<mipCount; level++ ){
+		unsigned int mipSize = std::max(1u, size >> level);
+		unsigned int blocks = ((mipSize + 3) / 4) * ((mipSize + 3) / 4);
+		for ( unsigned int b=0; b<blocks*8; b++ )
+			fputc((int)(255 * random01(seed)), file);
+	}
+	return fclose(file) == 0;
+}
+
+// The benchmarks of benchMeshes, for each mesh : "loadOBJ/suzanne"...
+static const char * const meshBenchmarks[] = {
+	"loadOBJ/", "loadOBJ_parallel/", "indexVBO/", "indexVBO_IndexBuffer/", "indexVBO_weld/", "indexVBO_slow/",
+	"computeTangentBasis/", "indexVBO_TBN/", "computeTangentBasis_indexed/"
+};
+static const int meshBenchmarkCount = sizeof(meshBenchmarks) / sizeof(meshBenchmarks[0]);
+
+static const char * const mipmapBenchmarks[] = {
+	"generateMipmaps/box", "generateMipmaps/triangle", "generateMipmaps/kaiser", "generateMipmaps/kaiser_threads"
+};
+static const int mipmapBenchmarkCount = sizeof(mipmapBenchmarks) / sizeof(mipmapBenchmarks[0]);
+
+static void benchMeshes(){
+
+	struct MeshFile{ const char * name; const char * path; bool slow; };
+	MeshFile meshes[3] = {
+		{ "suzanne",         "../tutorial09_vbo_indexing/suzanne.obj",       true  },
+		{ "room_thickwalls", "../tutorial16_shadowmaps/room_thickwalls.obj", true  },
+		{ "synthetic",       "synthetic_grid.obj",                           false }, // 131072 triangles : too much for indexVBO_slow
+	};
+
+	for ( int m=0; m<3; m++ ){
+		std::string name = meshes[m].name;
+		const char * path = meshes[m].path;
+		if ( !selectedAny(meshBenchmarks, meshBenchmarkCount, name) )
+			continue;
+		double bytes = (double)fileSize(path);
+
+		std::vector<glm::vec3> vertices, normals;
+		std::vector<glm::vec2> uvs;
+		if ( !loadOBJ(path, vertices, uvs, normals) ){
+			fprintf(stderr, "Skipping %s : can't load %s\n", name.c_str(), path);
+			continue;
+		}
+		double triangles = vertices.size() / 3.0;
+
+		bench("loadOBJ/" + name, triangles, bytes, [&](){
+			std::vector<glm::vec3> v, n;
+			std::vector<glm::vec2> u;
+			loadOBJ(path, v, u, n);
+		});
+
+		bench("loadOBJ_parallel/" + name, triangles, bytes, [&](){
+			std::vector<glm::vec3> v, n;
+			std::vector<glm::vec2> u;
+			loadOBJ_parallel(path, v, u, n);
+		});
+
+		bench("indexVBO/" + name, (double)vertices.size(), 0, [&](){
+			std::vector<unsigned int> indices;
+			std::vector<glm::vec3> v, n;
+			std::vector<glm::vec2> u;
+			indexVBO(vertices, uvs, normals, indices, v, u, n);
+		});
+
+		bench("indexVBO_IndexBuffer/" + name, (double)vertices.size(), 0, [&](){
+			IndexBuffer indices;
+			std::vector<glm::vec3> v, n;
+			std::vector<glm::vec2> u;
+			indexVBO(vertices, uvs, normals, indices, v, u, n);
+		});
+
+		bench("indexVBO_weld/" + name, (double)vertices.size(), 0, [&](){
+			std::vector<unsigned int> indices;
+			std::vector<glm::vec3> v, n;
+			std::vector<glm::vec2> u;
+			indexVBO(vertices, uvs, normals, indices, v, u, n, true);
+		});
+
+		if ( meshes[m].slow ){
+			bench("indexVBO_slow/" + name, (double)vertices.size(), 0, [&](){
+				std::vector<unsigned short> indices;
+				std::vector<glm::vec3> v, n;
+				std::vector<glm::vec2> u;
+				indexVBO_slow(vertices, uvs, normals, indices, v, u, n);
+			});
+		}
+
+		// computeTangentBasis appends to its outputs
+		bench("computeTangentBasis/" + name, triangles, 0, [&](){
+			std::vector<glm::vec3> t, b;
+			computeTangentBasis(vertices, uvs, normals, t, b);
+		});
+		std::vector<glm::vec3> tangents, bitangents;
+		computeTangentBasis(vertices, uvs, normals, tangents, bitangents);
+
+		bench("indexVBO_TBN/" + name, (double)vertices.size(), 0, [&](){
+			std::vector<unsigned int> indices;
+			std::vector<glm::vec3> v, n, t, b;
+			std::vector<glm::vec2> u;
+			indexVBO_TBN(vertices, uvs, normals, tangents, bitangents, indices, v, u, n, t, b);
+		});
+
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> indexedVertices, indexedNormals;
+		std::vector<glm::vec2> indexedUVs;
+		indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVs, indexedNormals);
+		bench("computeTangentBasis_indexed/" + name, indices.size() / 3.0, 0, [&](){
+			std::vector<glm::vec4> t;
+			computeTangentBasis_indexed(indices, indexedVertices, indexedUVs, indexedNormals, t);
+		});
+	}
+}
+
+static void benchImages(){
+
+	struct ImageFile{ const char * name; const char * path; };
+	ImageFile images[4] = {
+		{ "bmp/uvtemplate",  "../tutorial05_textured_cube/uvtemplate.bmp" },
+		{ "bmp/synthetic",   "synthetic_noise.bmp" },
+		{ "dds/uvmap",       "../tutorial07_model_loading/uvmap.DDS" },
+		{ "dds/synthetic",   "synthetic_noise.DDS" },
+	};
+
+	for ( int i=0; i<4; i++ ){
+		const char * path = images[i].path;
+		if ( !selected(std::string("decode/") + images[i].name) )
+			continue;
+		Image image;
+		if ( !decodeImage(path, image) ){
+			fprintf(stderr, "Skipping %s : can't load %s\n", images[i].name, path);
+			continue;
+		}
+		double pixels = (double)image.width * image.height;
+		bench(std::string("decode/") + images[i].name, pixels, (double)fileSize(path), [&](){
+			Image decoded;
+			decodeImage(path, decoded);
+		});
+	}
+
+	// Mipmaps of the 1024x1024 synthetic .BMP
+	Image image;
+	if ( selectedAny(mipmapBenchmarks, mipmapBenchmarkCount, "") && decodeImage("synthetic_noise.bmp", image) ){
+		double pixels = (double)image.width * image.height * 4 / 3;
+		for ( int f=0; f<3; f++ ){
+			MipmapOptions mipmapOptions;
+			mipmapOptions.filter = MipmapFilter(f);
+			bench(mipmapBenchmarks[f], pixels, 0, [&](){
+				generateMipmaps(image, mipmapOptions);
+			});
+		}
+		ThreadPool pool;
+		MipmapOptions mipmapOptions;
+		mipmapOptions.pool = &pool;
+		bench(mipmapBenchmarks[3], pixels, 0, [&](){
+			generateMipmaps(image, mipmapOptions);
+		});
+	}
+}
+
+static void benchText(){
+
+	// 80 columns x 50 lines of text
+	std::string text;
+	for ( int i=0; i<4000; i++ )
+		text += (char)(' ' + i % 95);
+	std::vector<TextVertex> vertices(4 * text.size());
+	std::vector<unsigned int> indices(6 * text.size());
+
+	bench("generateTextQuads", (double)text.size(), 0, [&](){
+		for ( int line=0; line<50; line++ )
+			generateTextQuads(text.c_str() + line*80, 80, 10.0f, 10.0f + line*12.0f, 12.0f, &vertices[line*80*4]);
+	});
+
+	bench("generateQuadIndices", (double)text.size(), 0, [&](){
+		generateQuadIndices(0, (unsigned int)text.size(), &indices[0]);
+	});
+
+	Image grid;
+	GlyphSet glyphs;
+	if ( decodeImage("../tutorial11_2d_fonts/Holstein.DDS", grid) && glyphsFromGrid(grid, glyphs) ){
+		bench("computeKerning/Holstein", (double)glyphs.glyphs.size(), 0, [&](){
+			GlyphSet copy = glyphs;
+			computeKerning(copy);
+		});
+		computeKerning(glyphs);
+
+		FontAtlas font;
+		FontBakeOptions bakeOptions;
+		bakeOptions.downscale = 2;
+		bench("bakeFontAtlas/Holstein", (double)glyphs.glyphs.size(), 0, [&](){
+			bakeFontAtlas(glyphs, bakeOptions, font);
+		});
+		bakeOptions.distanceField = true;
+		bench("bakeFontAtlas/Holstein_sdf", (double)glyphs.glyphs.size(), 0, [&](){
+			bakeFontAtlas(glyphs, bakeOptions, font);
+		});
+
+		bench("generateFontQuads", (double)text.size(), 0, [&](){
+			for ( int line=0; line<50; line++ )
+				generateFontQuads(font, text.c_str() + line*80, 80, 10.0f, 10.0f + line*12.0f, 12.0f, &vertices[line*80*4]);
+		});
+	}
+}
+
+// The batch versions are only fast if they are right : checked first
+static bool benchQuaternions(){
+
+	if ( selected("quaternionTests") && !quaternionTests() ){
+		fprintf(stderr, "quaternionTests failed\n");
+		return false;
+	}
+
+	// A crowd
+	const size_t count = 50000;
+	unsigned int seed = 3;
+	std::vector<vec3> directions(count), ups(count);
+	std::vector<quat> q1(count), q2(count), out(count);
+	std::vector<float> soa[8][4];
+	for ( int a=0; a<8; a++ )
+		for ( int c=0; c<4; c++ )
+			soa[a][c].resize(count);
+	for ( size_t i=0; i<count; i++ ){
+		directions[i] = vec3(random01(seed) - 0.5f, random01(seed) - 0.5f, random01(seed) - 0.5f);
+		ups[i] = vec3(0.1f * random01(seed), 1.0f, 0.1f * random01(seed));
+		q1[i] = normalize(quat(random01(seed) - 0.5f, random01(seed) - 0.5f, random01(seed) - 0.5f, random01(seed) - 0.5f));
+		q2[i] = normalize(quat(random01(seed) - 0.5f, random01(seed) - 0.5f, random01(seed) - 0.5f, random01(seed) - 0.5f));
+		soa[0][0][i] = directions[i].x; soa[0][1][i] = directions[i].y; soa[0][2][i] = directions[i].z;
+		soa[1][0][i] = ups[i].x;        soa[1][1][i] = ups[i].y;        soa[1][2][i] = ups[i].z;
+		soa[2][0][i] = q1[i].w; soa[2][1][i] = q1[i].x; soa[2][2][i] = q1[i].y; soa[2][3][i] = q1[i].z;
+		soa[3][0][i] = q2[i].w; soa[3][1][i] = q2[i].x; soa[3][2][i] = q2[i].y; soa[3][3][i] = q2[i].z;
+	}
+	Vec3Arrays directionArrays = { &soa[0][0][0], &soa[0][1][0], &soa[0][2][0] };
+	Vec3Arrays upArrays        = { &soa[1][0][0], &soa[1][1][0], &soa[1][2][0] };
+	QuatArrays q1Arrays  = { &soa[2][0][0], &soa[2][1][0], &soa[2][2][0], &soa[2][3][0] };
+	QuatArrays q2Arrays  = { &soa[3][0][0], &soa[3][1][0], &soa[3][2][0], &soa[3][3][0] };
+	QuatArrays outArrays = { &soa[4][0][0], &soa[4][1][0], &soa[4][2][0], &soa[4][3][0] };
+
+	bench("RotationBetweenVectors/scalar", count, 0, [&](){
+		for ( size_t i=0; i<count; i++ ) out[i] = RotationBetweenVectors(directions[i], ups[i]);
+	});
+	bench("RotationBetweenVectors/batch", count, 0, [&](){
+		RotationBetweenVectors(directionArrays, upArrays, outArrays, count);
+	});
+	bench("LookAt/scalar", count, 0, [&](){
+		for ( size_t i=0; i<count; i++ ) out[i] = LookAt(directions[i], ups[i]);
+	});
+	bench("LookAt/batch", count, 0, [&](){
+		LookAt(directionArrays, upArrays, outArrays, count);
+	});
+	bench("RotateTowards/scalar", count, 0, [&](){
+		for ( size_t i=0; i<count; i++ ) out[i] = RotateTowards(q1[i], q2[i], 0.1f);
+	});
+	bench("RotateTowards/batch", count, 0, [&](){
+		RotateTowards(q1Arrays, q2Arrays, 0.1f, outArrays, count);
+	});
+	bench("Slerp/batch", count, 0, [&](){
+		Slerp(q1Arrays, q2Arrays, 0.3f, outArrays, count);
+	});
+	bench("Nlerp/batch", count, 0, [&](){
+		Nlerp(q1Arrays, q2Arrays, 0.3f, outArrays, count);
+	});
+	return true;
+}
+
+static void benchRandom(){
+
+	// The numbers for this many particles
+	const size_t count = 100000;
+	std::vector<unsigned int> bits(count*5);
+	std::vector<float> floats(count*5);
+	std::vector<glm::vec3> directions(count);
+	RandomGenerator random(42);
+	volatile unsigned int sink = 0;
+
+	// What tutorial 18 did : 8 calls to rand() per particle
+	bench("rand/8_per_particle", count, 0, [&](){
+		unsigned int sum = 0;
+		for ( size_t i=0; i<count*8; i++ ) sum += rand();
+		sink = sum;
+	});
+	bench("RandomGenerator/next", count*5, count*5*4, [&](){
+		unsigned int sum = 0;
+		for ( size_t i=0; i<count*5; i++ ) sum += random.next();
+		sink = sum;
+	});
+	bench("RandomGenerator/fill", count*5, count*5*4, [&](){
+		random.fill(&bits[0], bits.size());
+	});
+	bench("RandomGenerator/fillUniform", count*5, count*5*4, [&](){
+		random.fillUniform(&floats[0], floats.size());
+	});
+	bench("RandomGenerator/inCone", count, count*12, [&](){
+		for ( size_t i=0; i<count; i++ ) directions[i] = random.inCone(glm::vec3(0, 1, 0), 0.25f);
+	});
+	bench("RandomGenerator/onSphere", count, count*12, [&](){
+		for ( size_t i=0; i<count; i++ ) directions[i] = random.onSphere();
+	});
+
+	// 16 emitters, each with its own stream : no shared state between the jobs
+	ThreadPool pool;
+	const unsigned int emitters = 16;
+	char name[64];
+	snprintf(name, sizeof(name), "RandomGenerator/streams_threads/%u", pool.threadCount());
+	bench(name, count*5, count*5*4, [&](){
+		pool.parallelFor(emitters, [&](size_t e){
+			RandomGenerator stream(42, e);
+			size_t n = bits.size() / emitters;
+			stream.fill(&bits[e*n], n);
+		});
+	});
+	(void)sink;
+}
+
+// Like tutorial 18 : a fountain, with particles of all ages
+static void spawnFountain(ParticleSystem & particles, unsigned int count, unsigned int & seed){
+	for ( unsigned int i=0; i<count; i++ ){
+		ParticleSpawn particle;
+		glm::vec3 velocity = glm::vec3(0.0f, 10.0f, 0.0f) + 1.5f * glm::vec3(random01(seed) - 0.5f, random01(seed) - 0.5f, random01(seed) - 0.5f);
+		glm::vec3 gravity = particles.gravity();
+		float age = 5.0f * random01(seed);
+		particle.position = glm::vec3(0.0f, 0.0f, -20.0f) + velocity * age + gravity * (0.5f * age * age);
+		particle.velocity = velocity + gravity * age;
+		particle.r = (unsigned char)(255 * random01(seed));
+		particle.g = (unsigned char)(255 * random01(seed));
+		particle.b = (unsigned char)(255 * random01(seed));
+		particle.a = (unsigned char)(85 * random01(seed));
+		particle.size = 0.1f + 0.5f * random01(seed);
+		particle.life = 5.0f - age;
+		particles.spawn(particle);
+	}
+}
+
+// The same frames with and without threads must give exactly the same buffers
+static bool validateParticleThreads(ThreadPool & pool){
+	const unsigned int count = 100000;
+	ParticleSystem single(count), threaded(count);
+	std::vector<float> positionSize[2] = { std::vector<float>(4 * count), std::vector<float>(4 * count) };
+	std::vector<unsigned char> colors[2] = { std::vector<unsigned char>(4 * count), std::vector<unsigned char>(4 * count) };
+
+	for ( int frame=0; frame<30; frame++ ){
+		glm::vec3 camera(0.1f * frame, 1.0f, 5.0f);
+		for ( int threads=0; threads<2; threads++ ){
+			ParticleSystem & particles = threads ? threaded : single;
+			ThreadPool * framePool = threads ? &pool : NULL;
+			unsigned int seed = 17 + frame; // The same particles for both
+			spawnFountain(particles, frame == 0 ? count : count / 300, seed);
+			particles.update(1.0f / 60.0f, framePool);
+			if ( frame % 2 == 0 ) // The other frames : storage order
+				particles.sortBackToFront(camera, framePool);
+			particles.fillBuffers(&positionSize[threads][0], &colors[threads][0], framePool);
+		}
+		unsigned int n = single.count();
+		if ( threaded.count() != n ||
+		     memcmp(&positionSize[0][0], &positionSize[1][0], 16 * n) != 0 ||
+		     memcmp(&colors[0][0], &colors[1][0], 4 * n) != 0 ){
+			fprintf(stderr, "ParticleSystem : different results with %u threads, frame %d\n", pool.threadCount(), frame);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool benchParticles(){
+
+	ThreadPool pool;
+	if ( selected("ParticleSystem_threads_validation") && !validateParticleThreads(pool) )
+		return false;
+
+	unsigned int counts[2] = { 100000, 1000000 };
+	for ( int c=0; c<2; c++ ){
+		unsigned int count = counts[c];
+		char name[32];
+		sprintf(name, "%uk", count / 1000);
+		std::string suffix = name;
+
+		ParticleSystem particles(count);
+		particles.setGravity(glm::vec3(0.0f, -9.81f, 0.0f) * 0.5f);
+		std::vector<float> positionSize(4 * count);
+		std::vector<unsigned char> colors(4 * count);
+		glm::vec3 camera(0.0f, 0.0f, 5.0f);
+		unsigned int seed = 5;
+
+		// Each run starts from the same particles : the time to spawn them is not measured
+		spawnFountain(particles, count, seed);
+		particles.update(0.0f);
+		unsigned int alive = particles.count();
+
+		bench("ParticleSystem_update/" + suffix, alive, 0, [&](){
+			particles.update(0.0f); // Nobody dies, the work is the same each time
+		});
+		bench("ParticleSystem_sortBackToFront/" + suffix, alive, 0, [&](){
+			particles.sortBackToFront(camera);
+		});
+		bench("ParticleSystem_fillBuffers_sorted/" + suffix, alive, 16.0 * alive, [&](){
+			particles.fillBuffers(&positionSize[0], &colors[0]);
+		});
+		particles.update(0.0f);
+		bench("ParticleSystem_fillBuffers/" + suffix, alive, 16.0 * alive, [&](){
+			particles.fillBuffers(&positionSize[0], &colors[0]);
+		});
+
+		// A whole frame of tutorial 18, with 1/300 of the particles dying and
+		// as many new ones
+		bench("ParticleSystem_frame/" + suffix, alive, 0, [&](){
+			spawnFountain(particles, count - particles.count(), seed);
+			particles.update(1.0f / 60.0f);
+			particles.sortBackToFront(camera);
+			particles.fillBuffers(&positionSize[0], &colors[0]);
+		});
+		particles.setSortMode(PARTICLES_SORT_INCREMENTAL);
+		bench("ParticleSystem_frame_incremental/" + suffix, alive, 0, [&](){
+			spawnFountain(particles, count - particles.count(), seed);
+			particles.update(1.0f / 60.0f);
+			particles.sortBackToFront(camera);
+			particles.fillBuffers(&positionSize[0], &colors[0]);
+		});
+		particles.setSortMode(PARTICLES_SORT_RADIX);
+		bench("ParticleSystem_frame_threads/" + suffix, alive, 0, [&](){
+			spawnFountain(particles, count - particles.count(), seed);
+			particles.update(1.0f / 60.0f, &pool);
+			particles.sortBackToFront(camera, &pool);
+			particles.fillBuffers(&positionSize[0], &colors[0], &pool);
+		});
+	}
+
+	// 16 emitters of 64k particles, in the same buffers
+	{
+		const unsigned int emitterCount = 16;
+		const unsigned int count = 65536;
+		unsigned int seed = 13;
+		std::vector<ParticleSystem*> emitters;
+		for ( unsigned int i=0; i<emitterCount; i++ ){
+			emitters.push_back(new ParticleSystem(count));
+			emitters[i]->setGravity(glm::vec3(0.0f, -9.81f, 0.0f) * 0.5f);
+			spawnFountain(*emitters[i], count, seed);
+		}
+		std::vector<float> positionSize(4 * count * emitterCount);
+		std::vector<unsigned char> colors(4 * count * emitterCount);
+		glm::vec3 camera(0.0f, 0.0f, 5.0f);
+		for ( int threads=0; threads<2; threads++ ){
+			ThreadPool * emitterPool = threads ? &pool : NULL;
+			bench(threads ? "ParticleSystem_emitters_threads/16x64k" : "ParticleSystem_emitters/16x64k", emitterCount * count, 0, [&](){
+				for ( unsigned int i=0; i<emitterCount; i++ )
+					spawnFountain(*emitters[i], count - emitters[i]->count(), seed);
+				updateParticleSystems(&emitters[0], emitterCount, 1.0f / 60.0f, camera, emitterPool);
+				fillParticleBuffers(&emitters[0], emitterCount, &positionSize[0], &colors[0], emitterPool);
+			});
+		}
+		for ( unsigned int i=0; i<emitterCount; i++ )
+			delete emitters[i];
+	}
+
+	// Spawning when all the particles are taken : one frame of tutorial 18
+	// (160 new particles, then an update that doesn't kill any), with the
+	// policies that keep the capacity
+	const char * policyNames[2] = { "drop", "steal_oldest" };
+	for ( int policy=0; policy<2; policy++ ){
+		unsigned int seed = 9;
+		ParticleSystem particles(100000, ParticleOverflow(policy));
+		spawnFountain(particles, particles.capacity(), seed);
+		bench(std::string("ParticleSystem_spawn_full/") + policyNames[policy], 160, 0, [&](){
+			spawnFountain(particles, 160, seed);
+			particles.update(0.0f);
+		});
+	}
+	return true;
+}
+
+int main( int argc, char ** argv ){
+
+	options.minTime = 0.5;
+	options.human = false;
+	options.output = NULL;
+	const char * outputPath = NULL;
+	for ( int i=1; i<argc; i++ ){
+		if ( strcmp(argv[i], "--filter") == 0 && i+1 < argc ){
+			options.filter = argv[++i];
+		}else if ( strcmp(argv[i], "--time") == 0 && i+1 < argc ){
+			options.minTime = atof(argv[++i]);
+		}else if ( strcmp(argv[i], "--human") == 0 ){
+			options.human = true;
+		}else if ( strcmp(argv[i], "--output") == 0 && i+1 < argc ){
+			outputPath = argv[++i];
+		}else{
+			fprintf(stderr, "Usage : %s [--filter text] [--time seconds] [--human] [--output file]\n", argv[0]);
+			return 1;
+		}
+	}
+	if ( outputPath ){
+		options.output = fopen(outputPath, "w");
+		if ( !options.output ){
+			fprintf(stderr, "Can't open %s\n", outputPath);
+			return 1;
+		}
+	}else{
+		// The records keep the real stdout, the rest goes to stderr
+		fflush(stdout);
+		int recordsFd = dup(fileno(stdout));
+		if ( recordsFd >= 0 )
+			options.output = fdopen(recordsFd, "w");
+		if ( !options.output ){
+			fprintf(stderr, "Can't duplicate stdout\n");
+			return 1;
+		}
+	}
+	fflush(stdout);
+	dup2(fileno(stderr), fileno(stdout));
+
+	atexit(removeSyntheticAssets);
+	bool written = true;
+	if ( selectedAny(meshBenchmarks, meshBenchmarkCount, "synthetic") )
+		written = writeSyntheticOBJ("synthetic_grid.obj", 256) && written;
+	if ( selected("decode/bmp/synthetic") || selectedAny(mipmapBenchmarks, mipmapBenchmarkCount, "") )
+		written = writeSyntheticBMP("synthetic_noise.bmp", 1024, 1024) && written;
+	if ( selected("decode/dds/synthetic") )
+		written = writeSyntheticDDS("synthetic_noise.DDS", 2048) && written;
+	if ( !written ){
+		fprintf(stderr, "Can't write the synthetic assets in the current directory\n");
+		return 1;
+	}
+
+	benchMeshes();
+	benchImages();
+	benchText();
+	bool valid = benchQuaternions();
+	benchRandom();
+	valid = benchParticles() && valid;
+
+	fclose(options.output);
+	return valid ? 0 : 1;
+}
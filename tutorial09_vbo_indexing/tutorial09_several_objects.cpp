@@ -20,6 +20,7 @@ using namespace glm;
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 #include <common/vboindexer.hpp>
+#include <common/meshcache.hpp>
 
 int main( void )
 {
@@ -84,17 +85,26 @@ int main( void )
 	// Get a handle for our "myTextureSampler" uniform
 	GLuint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
 
-	// Read our .obj file
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals;
-	bool res = loadOBJ("suzanne.obj", vertices, uvs, normals);
-
-	std::vector<unsigned short> indices;
+	// Read our .obj file, already indexed, with simplified versions of it (LODs)
+	// for when it is far away : 50%, 25% and 12.5% of the triangles.
+	// The first run saves the result in suzanne.obj.lods-<hash>.meshcache; the next runs
+	// just map this file, until suzanne.obj changes. See common/meshcache.cpp
+	std::vector<float> lodRatios;
+	lodRatios.push_back(0.5f);
+	lodRatios.push_back(0.25f);
+	lodRatios.push_back(0.125f);
+	IndexBuffer indices; // All the LODs, one after the other
+	std::vector<LODRange> lods;
 	std::vector<glm::vec3> indexed_vertices;
 	std::vector<glm::vec2> indexed_uvs;
 	std::vector<glm::vec3> indexed_normals;
-	indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
+	bool res = loadIndexedOBJ_LOD_cached("suzanne.obj", lodRatios, indices, lods, indexed_vertices, indexed_uvs, indexed_normals);
+	if ( !res || lods.empty() ){
+		fprintf( stderr, "Failed to load suzanne.obj\n" );
+		glfwTerminate();
+		return -1;
+	}
+	const float meshSize = 2.0f; // suzanne.obj is about 2 units wide
 
 	// Load it into a VBO
 
@@ -117,7 +127,9 @@ int main( void )
 	GLuint elementbuffer;
 	glGenBuffers(1, &elementbuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0] , GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.sizeInBytes(), indices.data() , GL_STATIC_DRAW);
+	GLenum indexType = indices.use32bits ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	size_t indexSize = indices.use32bits ? sizeof(unsigned int) : sizeof(unsigned short);
 
 	// Get a handle for our "LightPosition" uniform
 	glUseProgram(programID);
@@ -147,6 +159,7 @@ int main( void )
 		computeMatricesFromInputs();
 		glm::mat4 ProjectionMatrix = getProjectionMatrix();
 		glm::mat4 ViewMatrix = getViewMatrix();
+		glm::vec3 cameraPosition = glm::vec3( glm::inverse(ViewMatrix)[3] );
 		
 		
 		////// Start of the rendering of the first object //////
@@ -212,12 +225,15 @@ int main( void )
 		// Index buffer
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
 
+		// The farther the object, the less triangles it needs
+		const LODRange & lod1 = lods[ chooseLOD(lods, meshSize, glm::distance(cameraPosition, glm::vec3(ModelMatrix1[3]))) ];
+
 		// Draw the triangles !
 		glDrawElements(
-			GL_TRIANGLES,      // mode
-			indices.size(),    // count
-			GL_UNSIGNED_SHORT,   // type
-			(void*)0           // element array buffer offset
+			GL_TRIANGLES,                        // mode
+			lod1.indexCount,                     // count
+			indexType,                           // type
+			(void*)(lod1.firstIndex * indexSize) // element array buffer offset
 		);
 
 
@@ -277,7 +293,8 @@ int main( void )
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
 
 		// Draw the triangles !
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
+		const LODRange & lod2 = lods[ chooseLOD(lods, meshSize, glm::distance(cameraPosition, glm::vec3(ModelMatrix2[3]))) ];
+		glDrawElements(GL_TRIANGLES, lod2.indexCount, indexType, (void*)(lod2.firstIndex * indexSize));
 
 
 		////// End of rendering of the second object //////
@@ -124,8 +124,10 @@ int main( void )
 	glUseProgram(programID);
 	GLuint LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
 
-	// Initialize our little text library with the Holstein font
-	initText2D( "Holstein.DDS" );
+	// Initialize our little text library with the Holstein font. The first
+	// time, the proportional version is made from the grid of Holstein.DDS.
+	if ( !initText2DFont( "Holstein.font", "Holstein.DDS" ) )
+		initText2D( "Holstein.DDS" );
 
 	// For speed computation
 	double lastTime = glfwGetTime();
@@ -81,10 +81,16 @@ int main( void )
 	GLuint ModelMatrixID = glGetUniformLocation(programID, "M");
 	GLuint ModelView3x3MatrixID = glGetUniformLocation(programID, "MV3x3");
 
-	// Load the texture
-	GLuint DiffuseTexture = loadDDS("diffuse.DDS");
-	GLuint NormalTexture = loadBMP_custom("normal.bmp");
-	GLuint SpecularTexture = loadDDS("specular.DDS");
+	// Load the textures. They are decoded at the same time, on several threads.
+	std::vector<std::string> texturePaths;
+	texturePaths.push_back("diffuse.DDS");
+	texturePaths.push_back("normal.bmp");
+	texturePaths.push_back("specular.DDS");
+	std::vector<GLuint> textures;
+	loadTextures(texturePaths, textures);
+	GLuint DiffuseTexture = textures[0];
+	GLuint NormalTexture = textures[1];
+	GLuint SpecularTexture = textures[2];
 	
 	// Get a handle for our "myTextureSampler" uniform
 	GLuint DiffuseTextureID  = glGetUniformLocation(programID, "DiffuseTextureSampler");
@@ -2,7 +2,6 @@
 #include <stdlib.h>
 
 #include <vector>
-#include <algorithm>
 
 #include <GL/glew.h>
 
@@ -11,56 +10,24 @@ GLFWwindow* window;
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/norm.hpp>
 using namespace glm;
 
 
 #include <common/shader.hpp>
 #include <common/texture.hpp>
 #include <common/controls.hpp>
+#include <common/threadpool.hpp>
+#include <common/particles.hpp>
+#include <common/random.hpp>
 
-// CPU representation of a particle
-struct Particle{
-	glm::vec3 pos, speed;
-	unsigned char r,g,b,a; // Color
-	float size, angle, weight;
-	float life; // Remaining life of the particle. if <0 : dead and unused.
-	float cameradistance; // *Squared* distance to the camera. if dead : -1.0f
-
-	bool operator<(const Particle& that) const {
-		// Sort in reverse order : far particles drawn first.
-		return this->cameradistance > that.cameradistance;
-	}
-};
-
+// CPU representation of the particles : see common/particles.hpp
+// When all the particles are taken, the oldest ones are overridden.
 const int MaxParticles = 100000;
-Particle ParticlesContainer[MaxParticles];
-int LastUsedParticle = 0;
-
-// Finds a Particle in ParticlesContainer which isn't used yet.
-// (i.e. life < 0);
-int FindUnusedParticle(){
-
-	for(int i=LastUsedParticle; i<MaxParticles; i++){
-		if (ParticlesContainer[i].life < 0){
-			LastUsedParticle = i;
-			return i;
-		}
-	}
+ParticleSystem Particles(MaxParticles, PARTICLES_STEAL_OLDEST);
 
-	for(int i=0; i<LastUsedParticle; i++){
-		if (ParticlesContainer[i].life < 0){
-			LastUsedParticle = i;
-			return i;
-		}
-	}
-
-	return 0; // All particles are taken, override the first one
-}
-
-void SortParticles(){
-	std::sort(&ParticlesContainer[0], &ParticlesContainer[MaxParticles]);
-}
+// The emitter's own random numbers : always the same fountain for the same
+// seed, and nothing shared with other emitters (see common/random.hpp)
+RandomGenerator Random(1234);
 
 int main( void )
 {
@@ -123,15 +90,12 @@ int main( void )
 	// fragment shader
 	GLuint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
 
-	
-	static GLfloat* g_particule_position_size_data = new GLfloat[MaxParticles * 4];
-	static GLubyte* g_particule_color_data         = new GLubyte[MaxParticles * 4];
 
-	for(int i=0; i<MaxParticles; i++){
-		ParticlesContainer[i].life = -1.0f;
-		ParticlesContainer[i].cameradistance = -1.0f;
-	}
+	// Simulate simple physics : the tutorial has always used half of the gravity
+	Particles.setGravity(glm::vec3(0.0f,-9.81f, 0.0f) * 0.5f);
 
+	// The particles are simulated, sorted and copied by blocks, on all the cores
+	ThreadPool pool;
 
 
 	GLuint Texture = loadDDS("particle.DDS");
@@ -196,78 +160,44 @@ int main( void )
 		if (newparticles > (int)(0.016f*10000.0))
 			newparticles = (int)(0.016f*10000.0);
 		
+		// All the random numbers of this frame at once : 5 per particle
+		static std::vector<unsigned int> randoms;
+		randoms.resize(newparticles*5);
+		if (newparticles > 0)
+			Random.fill(&randoms[0], randoms.size());
+
 		for(int i=0; i<newparticles; i++){
-			int particleIndex = FindUnusedParticle();
-			ParticlesContainer[particleIndex].life = 5.0f; // This particle will live 5 seconds.
-			ParticlesContainer[particleIndex].pos = glm::vec3(0,0,-20.0f);
-
-			float spread = 1.5f;
-			glm::vec3 maindir = glm::vec3(0.0f, 10.0f, 0.0f);
-			// Very bad way to generate a random direction; 
-			// See for instance http://stackoverflow.com/questions/5408276/python-uniform-spherical-distribution instead,
-			// combined with some user-controlled parameters (main direction, spread, etc)
-			glm::vec3 randomdir = glm::vec3(
-				(rand()%2000 - 1000.0f)/1000.0f,
-				(rand()%2000 - 1000.0f)/1000.0f,
-				(rand()%2000 - 1000.0f)/1000.0f
-			);
-			
-			ParticlesContainer[particleIndex].speed = maindir + randomdir*spread;
-
-
-			// Very bad way to generate a random color
-			ParticlesContainer[particleIndex].r = rand() % 256;
-			ParticlesContainer[particleIndex].g = rand() % 256;
-			ParticlesContainer[particleIndex].b = rand() % 256;
-			ParticlesContainer[particleIndex].a = (rand() % 256) / 3;
-
-			ParticlesContainer[particleIndex].size = (rand()%1000)/2000.0f + 0.1f;
-			
+			const unsigned int * bits = &randoms[i*5];
+			ParticleSpawn particle;
+			particle.life = 5.0f; // This particle will live 5 seconds.
+			particle.position = glm::vec3(0,0,-20.0f);
+
+			// Upwards, at most 0.25 radians (about 15 degrees) from the vertical,
+			// every direction of this cone being as likely as the others
+			glm::vec3 maindir = glm::vec3(0.0f, 1.0f, 0.0f);
+			float speed = 10.0f + 1.5f*uniformFloat(bits[2]);
+			particle.velocity = coneDirection(maindir, 0.25f, uniformFloat(bits[0]), uniformFloat(bits[1])) * speed;
+
+			// 4 random bytes
+			particle.r = bits[3] & 0xFF;
+			particle.g = (bits[3] >> 8) & 0xFF;
+			particle.b = (bits[3] >> 16) & 0xFF;
+			particle.a = (bits[3] >> 24) / 3;
+
+			particle.size = uniformFloat(bits[4])*0.5f + 0.1f;
+
+			Particles.spawn(particle);
 		}
 
 
 
-		// Simulate all particles
-		int ParticlesCount = 0;
-		for(int i=0; i<MaxParticles; i++){
+		// Simulate all particles : only the live ones are visited, and the
+		// dead ones are removed
+		Particles.update((float)delta, &pool);
 
-			Particle& p = ParticlesContainer[i]; // shortcut
-
-			if(p.life > 0.0f){
-
-				// Decrease life
-				p.life -= delta;
-				if (p.life > 0.0f){
-
-					// Simulate simple physics : gravity only, no collisions
-					p.speed += glm::vec3(0.0f,-9.81f, 0.0f) * (float)delta * 0.5f;
-					p.pos += p.speed * (float)delta;
-					p.cameradistance = glm::length2( p.pos - CameraPosition );
-					//ParticlesContainer[i].pos += glm::vec3(0.0f,10.0f, 0.0f) * (float)delta;
-
-					// Fill the GPU buffer
-					g_particule_position_size_data[4*ParticlesCount+0] = p.pos.x;
-					g_particule_position_size_data[4*ParticlesCount+1] = p.pos.y;
-					g_particule_position_size_data[4*ParticlesCount+2] = p.pos.z;
-												   
-					g_particule_position_size_data[4*ParticlesCount+3] = p.size;
-												   
-					g_particule_color_data[4*ParticlesCount+0] = p.r;
-					g_particule_color_data[4*ParticlesCount+1] = p.g;
-					g_particule_color_data[4*ParticlesCount+2] = p.b;
-					g_particule_color_data[4*ParticlesCount+3] = p.a;
-
-				}else{
-					// Particles that just died will be put at the end of the buffer in SortParticles();
-					p.cameradistance = -1.0f;
-				}
-
-				ParticlesCount++;
-
-			}
-		}
-
-		SortParticles();
+		// Far particles drawn first
+		Particles.sortBackToFront(CameraPosition, &pool);
+		int ParticlesCount = Particles.count();
 
 
 		//printf("%d ",ParticlesCount);
@@ -277,15 +207,29 @@ int main( void )
 		// There are much more sophisticated means to stream data from the CPU to the GPU, 
 		// but this is outside the scope of this tutorial.
 		// http://www.opengl.org/wiki/Buffer_Object_Streaming
-
-
-		glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
-		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-		glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLfloat) * 4, g_particule_position_size_data);
-
-		glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-		glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLubyte) * 4, g_particule_color_data);
+		// Here, the buffers are mapped, and the particles are written directly
+		// into them : no copy in between. GL_MAP_INVALIDATE_BUFFER_BIT is like
+		// buffer orphaning : the driver doesn't wait until the GPU is done with
+		// the previous frame.
+		if ( ParticlesCount > 0 ){
+			glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
+			GLfloat* position_size_data = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLfloat) * 4, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+			glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
+			GLubyte* color_data = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLubyte) * 4, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+			if ( position_size_data && color_data )
+				Particles.fillBuffers(position_size_data, color_data, &pool);
+			else
+				ParticlesCount = 0;
+
+			// If unmapping fails, the content of the buffer is lost : skip this frame
+			if ( glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE )
+				ParticlesCount = 0;
+			glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
+			if ( glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE )
+				ParticlesCount = 0;
+		}
 
 
 		glEnable(GL_BLEND);
@@ -370,7 +314,8 @@ int main( void )
 		   glfwWindowShouldClose(window) == 0 );
 
 
-	delete[] g_particule_position_size_data;
+	const ParticleStats & stats = Particles.stats();
+	printf("Particles : %llu spawned, %llu died, %llu overridden, %u at most at once\n", stats.spawned, stats.died, stats.stolen, stats.peak);
 
 	// Cleanup VBO and shader
 	glDeleteBuffers(1, &particles_color_buffer);